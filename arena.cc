@@ -0,0 +1,78 @@
+#include "arena.h"
+#include "profile.h"
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+
+namespace arena {
+
+    region::region(size_t capacity)
+        : peak(0), allocations(0)
+    {
+        // address space only; pages are backed as the arena first reaches them
+        void *p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("failed to reserve arena");
+        }
+
+        base = static_cast<char*>(p);
+        top = base;
+        end = base + capacity;
+    }
+
+    region::~region()
+    {
+        munmap(base, end - base);
+    }
+
+    void* region::allocate(size_t n)
+    {
+        ++allocations;
+
+        // operator new promises alignment for any fundamental type
+        size_t size = (std::max<size_t>(n, 1) + alignof(std::max_align_t) - 1)
+            & ~(alignof(std::max_align_t) - 1);
+
+        if (size > (size_t) (end - top)) {
+            return nullptr;
+        }
+
+        void *p = top;
+        top += size;
+
+        return p;
+    }
+
+    void region::reset()
+    {
+        peak = std::max<size_t>(peak, top - base);
+        top = base;
+        allocations = 0;
+    }
+
+    size_t region::used() const
+    {
+        return top - base;
+    }
+
+    scope::scope(region *r)
+        : r(r)
+    {}
+
+    scope::~scope()
+    {
+        if (r != nullptr) {
+            profile::count("arena_allocations", r->allocations);
+            profile::count("arena_bytes", r->used());
+            r->reset();
+        }
+    }
+
+    long scope::allocations() const
+    {
+        return r == nullptr ? 0 : r->allocations;
+    }
+
+}
@@ -0,0 +1,132 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace arena {
+
+    /*
+     * A bump allocator over one reserved range of address space.  Frees
+     * are no-ops and reset releases everything at once, so the objects a
+     * tool builds for every sample cost a pointer increment each instead
+     * of a malloc and a free.  Only memory requested explicitly through
+     * an allocator goes here; nothing else in the process is affected.
+     */
+    struct region {
+
+        region(size_t capacity);
+        ~region();
+
+        region(region const&) = delete;
+        region& operator=(region const&) = delete;
+
+        // null when full
+        void* allocate(size_t n);
+
+        bool owns(void const *p) const
+        {
+            return p >= base && p < end;
+        }
+
+        void reset();
+
+        size_t used() const;
+
+        size_t peak;
+
+        // allocate calls since the last reset
+        long allocations;
+
+    private:
+        char *base;
+        char *top;
+        char *end;
+
+    };
+
+    /*
+     * A standard allocator that draws from r, or from the heap when r is
+     * null or full.  Everything allocated must be gone before r is reset.
+     */
+    template <class T>
+    struct allocator {
+
+        using value_type = T;
+
+        region *r;
+
+        allocator(region *r)
+            : r(r)
+        {}
+
+        template <class U>
+        allocator(allocator<U> const& a)
+            : r(a.r)
+        {}
+
+        T* allocate(size_t n)
+        {
+            void *p = r == nullptr ? nullptr : r->allocate(n * sizeof(T));
+
+            if (p == nullptr) {
+                p = ::operator new(n * sizeof(T));
+            }
+
+            return static_cast<T*>(p);
+        }
+
+        void deallocate(T *p, size_t n)
+        {
+            if (r == nullptr || !r->owns(p)) {
+                ::operator delete(p);
+            }
+        }
+
+    };
+
+    template <class T, class U>
+    bool operator==(allocator<T> const& a, allocator<U> const& b)
+    {
+        return a.r == b.r;
+    }
+
+    template <class T, class U>
+    bool operator!=(allocator<T> const& a, allocator<U> const& b)
+    {
+        return a.r != b.r;
+    }
+
+    // std::make_shared with the object and its control block in r
+    template <class T, class... Args>
+    std::shared_ptr<T> make_shared(region *r, Args&&... args)
+    {
+        return std::allocate_shared<T>(allocator<T>(r), std::forward<Args>(args)...);
+    }
+
+    /*
+     * Resets r when the sample ends.  Declare it before anything that
+     * holds arena memory, so that it is destroyed after them.  A null
+     * region is allowed and does nothing.
+     */
+    struct scope {
+
+        scope(region *r);
+        ~scope();
+
+        scope(scope const&) = delete;
+        scope& operator=(scope const&) = delete;
+
+        // arena allocations since the scope began
+        long allocations() const;
+
+    private:
+        region *r;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "bench.h"
+#include "ebt/ebt.h"
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+
+namespace bench {
+
+    static std::atomic<long> alloc_count { 0 };
+    static std::atomic<long> alloc_bytes { 0 };
+
+    long allocations()
+    {
+        return alloc_count;
+    }
+
+    long allocated_bytes()
+    {
+        return alloc_bytes;
+    }
+
+    result run(std::string const& name, std::function<double()> f,
+        double items, double min_time)
+    {
+        static volatile double sink = 0;
+
+        // one untimed call to warm caches and lazily sized buffers
+        sink = sink + f();
+
+        long ops = 0;
+        long allocs = alloc_count;
+        long bytes = alloc_bytes;
+
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+
+        while (elapsed < min_time) {
+            sink = sink + f();
+            ++ops;
+
+            elapsed = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+
+        result r;
+        r.name = name;
+        r.ops = ops;
+        r.ns_per_op = elapsed * 1e9 / ops;
+        r.items_per_sec = items * ops / elapsed;
+        r.allocs_per_op = double(alloc_count - allocs) / ops;
+        r.bytes_per_op = double(alloc_bytes - bytes) / ops;
+
+        return r;
+    }
+
+    void print(std::ostream& os, result const& r)
+    {
+        os << std::left << std::setw(48) << r.name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(1) << r.ns_per_op << " ns/op"
+            << std::setw(14) << std::setprecision(1) << r.items_per_sec << " items/s"
+            << std::setw(10) << std::setprecision(1) << r.allocs_per_op << " allocs/op"
+            << std::setw(12) << std::setprecision(0) << r.bytes_per_op << " B/op"
+            << std::endl;
+
+        os.unsetf(std::ios::floatfield);
+    }
+
+    void save_tsv(std::ostream& os, std::vector<result> const& results)
+    {
+        os << "name\tops\tns_per_op\titems_per_sec\tallocs_per_op\tbytes_per_op\n";
+
+        for (auto& r: results) {
+            os << r.name << "\t" << r.ops << "\t" << r.ns_per_op << "\t" << r.items_per_sec
+                << "\t" << r.allocs_per_op << "\t" << r.bytes_per_op << "\n";
+        }
+    }
+
+    std::unordered_map<std::string, result> load_tsv(std::istream& is)
+    {
+        std::unordered_map<std::string, result> results;
+
+        std::string line;
+        std::getline(is, line);
+
+        while (std::getline(is, line)) {
+            std::vector<std::string> parts = ebt::split(line, "\t");
+
+            if (parts.size() != 6) {
+                continue;
+            }
+
+            result r;
+            r.name = parts[0];
+            r.ops = std::stol(parts[1]);
+            r.ns_per_op = std::stod(parts[2]);
+            r.items_per_sec = std::stod(parts[3]);
+            r.allocs_per_op = std::stod(parts[4]);
+            r.bytes_per_op = std::stod(parts[5]);
+
+            results[r.name] = r;
+        }
+
+        return results;
+    }
+
+}
+
+void* operator new(std::size_t size)
+{
+    bench::alloc_count += 1;
+    bench::alloc_bytes += size;
+
+    void *p = std::malloc(size == 0 ? 1 : size);
+
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <unordered_map>
+
+namespace bench {
+
+    /*
+     * Linking bench.o replaces the global operator new, so every binary
+     * that uses this harness counts its allocations.
+     */
+    long allocations();
+    long allocated_bytes();
+
+    struct result {
+        std::string name;
+        long ops;
+        double ns_per_op;
+        double items_per_sec;
+        double allocs_per_op;
+        double bytes_per_op;
+    };
+
+    /*
+     * Calls f until min_time seconds have passed.  f returns a value that
+     * is accumulated into a sink so the work cannot be optimized away;
+     * items is the number of units (frames, bytes, ...) per call.
+     */
+    result run(std::string const& name, std::function<double()> f,
+        double items, double min_time);
+
+    void print(std::ostream& os, result const& r);
+
+    void save_tsv(std::ostream& os, std::vector<result> const& results);
+
+    std::unordered_map<std::string, result> load_tsv(std::istream& is);
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <random>
+#include <chrono>
+#include "kmeans.h"
+#include "ivf.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "center-index-bench",
+        "Measure recall@1 of the center index against the exact scan",
+        {
+            {"centers", "", true},
+            {"index", "", false},
+            {"nprobe", "", true},
+            {"nquery", "", false},
+            {"noise", "", false},
+            {"seed", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    kmeans::center_file centers;
+    centers.open(args.at("centers"));
+
+    std::string index_file = args.at("centers") + ".ivf";
+    if (ebt::in(std::string("index"), args)) {
+        index_file = args.at("index");
+    }
+
+    ivf::index idx = ivf::load(index_file);
+
+    if (!ivf::matches(idx, centers)) {
+        std::cerr << index_file << " was built from other centers; rerun center-index" << std::endl;
+        exit(1);
+    }
+
+    int nquery = 1000;
+    if (ebt::in(std::string("nquery"), args)) {
+        nquery = std::stoi(args.at("nquery"));
+    }
+
+    double noise = 0.05;
+    if (ebt::in(std::string("noise"), args)) {
+        noise = std::stod(args.at("noise"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    std::default_random_engine gen { (unsigned long) seed };
+    std::uniform_int_distribution<int> center_dist { 0, centers.k - 1 };
+    std::normal_distribution<double> noise_dist { 0, noise };
+
+    // queries look like segment embeddings: a perturbed center, unit length
+    std::vector<la::vector<double>> queries;
+
+    for (int q = 0; q < nquery; ++q) {
+        double const *c = centers.center(center_dist(gen));
+
+        la::vector<double> v;
+        v.resize(centers.dim);
+
+        for (int d = 0; d < centers.dim; ++d) {
+            v(d) = c[d] + noise_dist(gen);
+        }
+
+        la::imul(v, 1.0 / la::norm(v));
+
+        queries.push_back(v);
+    }
+
+    std::vector<int> truth;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& q: queries) {
+        profile::scope prof { "exact_query" };
+
+        double dist;
+        truth.push_back(kmeans::nearest(centers, q, dist));
+    }
+
+    double exact_time = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / nquery;
+
+    if (output::enabled(output::results)) {
+        std::cout << "exact: " << exact_time << " us/query" << '\n';
+    }
+
+    for (auto& p: ebt::split(args.at("nprobe"), ",")) {
+        int nprobe = std::stoi(p);
+
+        int hit = 0;
+
+        start = std::chrono::steady_clock::now();
+
+        for (int q = 0; q < queries.size(); ++q) {
+            profile::scope prof { "ivf_query" };
+
+            double dist;
+            if (ivf::nearest(idx, centers, queries[q], nprobe, dist) == truth[q]) {
+                ++hit;
+            }
+        }
+
+        double time = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count() / nquery;
+
+        if (output::enabled(output::results)) {
+            std::cout << "nprobe: " << nprobe
+                << " recall@1: " << double(hit) / nquery
+                << " " << time << " us/query"
+                << " speedup: " << exact_time / time << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <cmath>
+#include "kmeans.h"
+#include "ivf.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "center-index",
+        "Build an inverted-file index over k-means centers",
+        {
+            {"centers", "", true},
+            {"nlist", "", false},
+            {"iter", "", false},
+            {"seed", "", false},
+            {"output", "", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    kmeans::center_file centers;
+    centers.open(args.at("centers"));
+
+    int nlist = std::ceil(std::sqrt(centers.k));
+    if (ebt::in(std::string("nlist"), args)) {
+        nlist = std::stoi(args.at("nlist"));
+    }
+
+    int iter = 10;
+    if (ebt::in(std::string("iter"), args)) {
+        iter = std::stoi(args.at("iter"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    std::string output = args.at("centers") + ".ivf";
+    if (ebt::in(std::string("output"), args)) {
+        output = args.at("output");
+    }
+
+    ivf::index idx;
+
+    {
+        profile::scope prof { "ivf_build" };
+        idx = ivf::build(centers, nlist, iter, seed);
+    }
+
+    int largest = 0;
+    for (auto& ell: idx.lists) {
+        largest = std::max<int>(largest, ell.size());
+    }
+
+    if (output::enabled(output::summary)) {
+        std::cout << "centers: " << idx.k << '\n';
+        std::cout << "lists: " << idx.nlist << '\n';
+        std::cout << "largest list: " << largest << '\n';
+    }
+
+    ivf::save(output, idx);
+
+    return 0;
+}
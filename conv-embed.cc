@@ -4,18 +4,27 @@
 #include <algorithm>
 #include "speech/speech.h"
 #include "unsupseg/embed.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
 
 using seg_t = embed::seg_t;
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-embed",
         "Calculate distance based on DTW-embedding",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"basis-batch", "", true},
-            {"target", "", true}
+            {"target", "", true},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -24,13 +33,15 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
     std::vector<seg_t> basis;
     std::ifstream basis_batch { args.at("basis-batch") };
 
@@ -41,6 +52,11 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
         basis.push_back(frames);
     }
 
@@ -57,21 +73,46 @@ int main(int argc, char *argv[])
     la::tensor<double> target_embed = embed::conv_embed(target_tensor, basis_tensor);
     la::imul(target_embed, 1.0 / la::norm(target_embed));
 
-    std::ifstream frame_batch { args.at("frame-batch") };
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
+
+    int nsample = 0;
 
     while (1) {
-        seg_t seg = speech::load_frame_batch(frame_batch);
+        seg_t seg;
 
-        if (!frame_batch) {
-            break;
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            if (!frame_batch.next(seg)) {
+                break;
+            }
         }
 
-        la::tensor<double> seg_tensor = embed::to_tensor(seg);
+        profile::count("segments");
+
+        la::tensor<double> seg_embed;
+
+        {
+            profile::scope prof { "conv_embed" };
+
+            la::tensor<double> seg_tensor = embed::to_tensor(seg);
+            seg_embed = embed::conv_embed(seg_tensor, basis_tensor);
+        }
 
-        la::tensor<double> seg_embed = embed::conv_embed(seg_tensor, basis_tensor);
         la::imul(seg_embed, 1.0 / la::norm(seg_embed));
 
-        std::cout << "dist: " << la::dot(seg_embed, target_embed) << std::endl;
+        double d = la::dot(seg_embed, target_embed);
+
+        if (output::enabled(output::results)) {
+            std::cout << "dist: " << d << '\n';
+        }
+
+        if (result.is_open()) {
+            result.write(nsample, 0, d);
+        }
+
+        ++nsample;
     }
 
     return 0;
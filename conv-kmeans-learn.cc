@@ -7,6 +7,11 @@
 #include "autodiff/autodiff.h"
 #include "nn/tensor-tree.h"
 #include "nn/nn.h"
+#include "frame-store.h"
+#include "patch-dist.h"
+#include "precision.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 
 std::shared_ptr<tensor_tree::vertex> make_tensor_tree()
@@ -62,13 +67,18 @@ void mvnorm_filters(la::tensor<double>& t)
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "conv-kmeans-learn",
         "Learn conv filters with k-means",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"param", "", true},
             {"output-param", "", true},
+            {"precision", "double (default) or float, for the patch distances", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
         }
     };
 
@@ -77,30 +87,33 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
     std::shared_ptr<tensor_tree::vertex> param = make_tensor_tree();
     tensor_tree::load_tensor(param, args.at("param"));
 
-    std::ifstream frame_batch;
+    frame_store::stream frame_batch;
     frame_batch.open(args.at("frame-batch"));
 
     auto& filters = tensor_tree::get_tensor(param->children[0]);
 
-    la::tensor<double> filter_energy;
-    filter_energy.resize({filters.size(2)});
+    std::vector<double> filter_energy = patch_dist::filter_energy(filters);
 
-    for (int i = 0; i < filters.size(0); ++i) {
-        for (int j = 0; j < filters.size(1); ++j) {
-            for (int c = 0; c < filters.size(2); ++c) {
-                filter_energy({c}) += filters({i, j, c}) * filters({i, j, c});
-            }
-        }
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    patch_dist::filters32 filters32;
+
+    if (prec == precision::scalar::f32) {
+        filters32 = patch_dist::make_filters32(filters);
     }
 
     std::vector<std::vector<std::pair<double, int>>> stat;
@@ -115,10 +128,14 @@ int main(int argc, char *argv[])
     int nsample = 0;
 
     while (1) {
-        embed::seg_t seg = speech::load_frame_batch(frame_batch);
+        embed::seg_t seg;
 
-        if (!frame_batch) {
-            break;
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            if (!frame_batch.next(seg)) {
+                break;
+            }
         }
 
         la::tensor<double> seg_tensor = embed::to_tensor(seg);
@@ -127,79 +144,48 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        la::tensor<double> seg_lin;
-        seg_lin.resize({seg_tensor.size(0) - filters.size(0) + 1, seg_tensor.size(1) - filters.size(1) + 1,
-            filters.size(0) * filters.size(1)});
-
-        la::corr_linearize_valid(seg_lin, seg_tensor, filters.size(0), filters.size(1));
-
-        la::tensor<double> patch_energy;
-        patch_energy.resize({seg_lin.size(0), seg_lin.size(1)});
-
-        for (int i = 0; i < seg_lin.size(0); ++i) {
-            for (int j = 0; j < seg_lin.size(1); ++j) {
-                double sum = 0;
-                for (int c = 0; c < seg_lin.size(2); ++c) {
-                    sum += seg_lin({i, j, c}) * seg_lin({i, j, c});
-                }
-                patch_energy({i, j}) = sum;
-            }
-        }
-
-
-        la::tensor<double> res = la::mul(seg_lin, filters);
-
-        for (int i = 0; i < res.size(0); ++i) {
-            for (int j = 0; j < res.size(1); ++j) {
-                for (int c = 0; c < res.size(2); ++c) {
-                    res({i, j, c}) = patch_energy({i, j}) - 2 * res({i, j, c}) + filter_energy({c});
-                }
-            }
-        }
+        profile::scope prof { "patch_filter_dist" };
+        profile::count("segments");
 
-        double inf = std::numeric_limits<double>::infinity();
-        la::tensor<double> min;
-        min.resize({res.size(2)}, inf);
+        std::vector<double> min;
         std::vector<std::pair<int, int>> argmin;
-        argmin.resize(res.size(2));
-
-        for (int i = 0; i < res.size(0); ++i) {
-            for (int j = 0; j < res.size(1); ++j) {
-                for (int c = 0; c < res.size(2); ++c) {
-                    if (res({i, j, c}) < min({c})) {
-                        min({c}) = res({i, j, c});
-                        argmin[c] = std::make_pair(i, j);
-                    }
-                }
-            }
+
+        if (prec == precision::scalar::f32) {
+            patch_dist::nearest(precision::convert<float>(seg), filters32, min, argmin);
+        } else {
+            patch_dist::nearest(seg_tensor, filters, filter_energy, min, argmin);
         }
 
         double loss_sum = 0;
 
-        for (int c = 0; c < min.size(0); ++c) {
-            loss_sum += min({c});
+        for (int c = 0; c < min.size(); ++c) {
+            loss_sum += min[c];
         }
 
-        std::cout << "sample: " << nsample << std::endl;
-        std::cout << "loss: " << loss_sum / min.size(0) << std::endl;
-        std::cout << std::endl;
+        if (output::enabled(output::detail)) {
+            std::cout << "sample: " << nsample << '\n';
+            std::cout << "loss: " << loss_sum / min.size() << '\n';
+            std::cout << '\n';
+        }
 
-        for (int c = 0; c < res.size(2); ++c) {
+        for (int c = 0; c < filters.size(2); ++c) {
             la::tensor<double> example;
-            example.resize({seg_lin.size(2)});
+            example.resize({filters.size(0) * filters.size(1)});
 
-            for (int d = 0; d < seg_lin.size(2); ++d) {
-                example.data()[d] = seg_lin({argmin[c].first, argmin[c].second, d});
+            for (int d = 0; d < example.vec_size(); ++d) {
+                example.data()[d] = seg[argmin[c].first + d / filters.size(1)][argmin[c].second + d % filters.size(1)];
             }
 
             examples.push_back(example);
-            stat[c].push_back(std::make_pair(min({c}), examples.size() - 1));
+            stat[c].push_back(std::make_pair(min[c], examples.size() - 1));
             std::push_heap(stat[c].begin(), stat[c].end(), less);
         }
 
         ++nsample;
     }
 
+    profile::scope prof { "update" };
+
     std::vector<int> count;
     count.resize(stat.size());
 
@@ -225,7 +211,9 @@ int main(int argc, char *argv[])
         }
     }
 
-    std::cout << "loss: " << loss / total_count << std::endl;
+    if (output::enabled(output::summary)) {
+        std::cout << "loss: " << loss / total_count << '\n';
+    }
 
     for (int c = 0; c < filters.size(2); ++c) {
         for (int i = 0; i < filters.size(0); ++i) {
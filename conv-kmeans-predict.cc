@@ -7,6 +7,11 @@
 #include "autodiff/autodiff.h"
 #include "nn/tensor-tree.h"
 #include "nn/nn.h"
+#include "frame-store.h"
+#include "patch-dist.h"
+#include "precision.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 
 std::shared_ptr<tensor_tree::vertex> make_tensor_tree()
@@ -20,13 +25,20 @@ std::shared_ptr<tensor_tree::vertex> make_tensor_tree()
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "conv-kmeans-predict",
         "Predict with learned filters",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"param", "", true},
             {"cluster", "", true},
+            {"precision", "double (default) or float, for the patch distances", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -35,30 +47,37 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
     std::shared_ptr<tensor_tree::vertex> param = make_tensor_tree();
     tensor_tree::load_tensor(param, args.at("param"));
 
-    std::ifstream frame_batch;
-    frame_batch.open(args.at("frame-batch"));
+    // the thresholds take a pass before the assignment pass
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"), true);
 
     auto& filters = tensor_tree::get_tensor(param->children[0]);
 
-    la::tensor<double> filter_energy;
-    filter_energy.resize({filters.size(2)});
+    std::vector<double> filter_energy = patch_dist::filter_energy(filters);
 
-    for (int i = 0; i < filters.size(0); ++i) {
-        for (int j = 0; j < filters.size(1); ++j) {
-            for (int c = 0; c < filters.size(2); ++c) {
-                filter_energy({c}) += filters({i, j, c}) * filters({i, j, c});
-            }
-        }
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    patch_dist::filters32 filters32;
+
+    if (prec == precision::scalar::f32) {
+        filters32 = patch_dist::make_filters32(filters);
     }
 
     std::vector<std::vector<double>> stat;
@@ -71,13 +90,19 @@ int main(int argc, char *argv[])
     int nsample = 0;
 
     while (1) {
-        embed::seg_t seg = speech::load_frame_batch(frame_batch);
+        embed::seg_t seg;
+
+        {
+            profile::scope prof { "load_frame_batch" };
 
-        if (!frame_batch) {
-            break;
+            if (!frame_batch.next(seg)) {
+                break;
+            }
         }
 
-        std::cerr << "sample: " << nsample << "\r";
+        if (output::enabled(output::detail)) {
+            std::cerr << "sample: " << nsample << "\r";
+        }
 
         la::tensor<double> seg_tensor = embed::to_tensor(seg);
 
@@ -85,62 +110,39 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        la::tensor<double> seg_lin;
-        seg_lin.resize({seg_tensor.size(0) - filters.size(0) + 1,
-            seg_tensor.size(1) - filters.size(1) + 1,
-            filters.size(0) * filters.size(1)});
-
-        la::corr_linearize_valid(seg_lin, seg_tensor, filters.size(0), filters.size(1));
+        profile::scope prof { "patch_filter_dist" };
+        profile::count("segments");
 
-        la::tensor<double> patch_energy;
-        patch_energy.resize({seg_lin.size(0), seg_lin.size(1)});
+        std::vector<double> min;
+        std::vector<std::pair<int, int>> argmin;
 
-        for (int i = 0; i < seg_lin.size(0); ++i) {
-            for (int j = 0; j < seg_lin.size(1); ++j) {
-                double sum = 0;
-                for (int c = 0; c < seg_lin.size(2); ++c) {
-                    sum += seg_lin({i, j, c}) * seg_lin({i, j, c});
-                }
-                patch_energy({i, j}) = sum;
-            }
+        if (prec == precision::scalar::f32) {
+            patch_dist::nearest(precision::convert<float>(seg), filters32, min, argmin);
+        } else {
+            patch_dist::nearest(seg_tensor, filters, filter_energy, min, argmin);
         }
 
-
-        la::tensor<double> res = la::mul(seg_lin, filters);
-
-        for (int i = 0; i < res.size(0); ++i) {
-            for (int j = 0; j < res.size(1); ++j) {
-                for (int c = 0; c < res.size(2); ++c) {
-                    res({i, j, c}) = patch_energy({i, j}) - 2 * res({i, j, c}) + filter_energy({c});
-                }
-            }
+        for (int c = 0; c < filters.size(2); ++c) {
+            stat[c].push_back(min[c]);
         }
 
-        double inf = std::numeric_limits<double>::infinity();
-        la::tensor<double> min;
-        min.resize({res.size(2)}, inf);
-        std::vector<std::pair<int, int>> argmin;
-        argmin.resize(res.size(2));
-
-        for (int i = 0; i < res.size(0); ++i) {
-            for (int j = 0; j < res.size(1); ++j) {
-                for (int c = 0; c < res.size(2); ++c) {
-                    if (res({i, j, c}) < min({c})) {
-                        min({c}) = res({i, j, c});
-                        argmin[c] = std::make_pair(i, j);
-                    }
+        if (result.is_open()) {
+            int best = 0;
+            for (int c = 1; c < filters.size(2); ++c) {
+                if (min[c] < min[best]) {
+                    best = c;
                 }
             }
-        }
 
-        for (int c = 0; c < res.size(2); ++c) {
-            stat[c].push_back(min({c}));
+            result.write(nsample, best, min[best]);
         }
 
         ++nsample;
     }
 
-    std::cerr << std::endl;
+    if (output::enabled(output::detail)) {
+        std::cerr << std::endl;
+    }
 
     std::vector<std::vector<double>> stat_heap = stat;
     for (int c = 0; c < stat_heap.size(); ++c) {
@@ -159,20 +161,25 @@ int main(int argc, char *argv[])
         threshold.push_back(t);
     }
 
-    frame_batch.close();
-    frame_batch.open(args.at("frame-batch"));
+    frame_batch.rewind();
 
     nsample = 0;
     int cluster = std::stoi(args.at("cluster"));
 
     while (1) {
-        embed::seg_t seg = speech::load_frame_batch(frame_batch);
+        embed::seg_t seg;
+
+        {
+            profile::scope prof { "load_frame_batch" };
 
-        if (!frame_batch) {
-            break;
+            if (!frame_batch.next(seg)) {
+                break;
+            }
         }
 
-        std::cerr << "sample: " << nsample << "\r";
+        if (output::enabled(output::detail)) {
+            std::cerr << "sample: " << nsample << "\r";
+        }
 
         la::tensor<double> seg_tensor = embed::to_tensor(seg);
 
@@ -180,23 +187,25 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        if (stat[cluster][nsample] < threshold[cluster]) {
-            std::cout << nsample << ".logmel" << std::endl;
+        if (stat[cluster][nsample] < threshold[cluster] && output::enabled(output::results)) {
+            std::cout << nsample << ".logmel" << '\n';
 
             for (int i = 0; i < seg.size(); ++i) {
                 for (int j = 0; j < seg[i].size(); ++j) {
                     std::cout << seg[i][j] << " ";
                 }
-                std::cout << std::endl;
+                std::cout << '\n';
             }
 
-            std::cout << "." << std::endl;
+            std::cout << "." << '\n';
         }
 
         ++nsample;
     }
 
-    std::cerr << std::endl;
+    if (output::enabled(output::detail)) {
+        std::cerr << std::endl;
+    }
 
     return 0;
 }
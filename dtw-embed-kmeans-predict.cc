@@ -4,19 +4,39 @@
 #include <algorithm>
 #include "speech/speech.h"
 #include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "par-embed.h"
+#include "kmeans.h"
+#include "precision.h"
+#include "ivf.h"
+#include "hkmeans.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 
 using seg_t = std::vector<std::vector<double>>;
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-embed-kmeans",
         "Cluster reference vectors with k-means",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"basis-batch", "", true},
             {"centers", "", true},
+            {"precision", "double (default) or float, for the dtw embedding and the exhaustive center search", false},
+            {"index", "", false},
+            {"nprobe", "", false},
+            {"tree", "", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -25,13 +45,15 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
     std::vector<seg_t> basis;
     std::ifstream basis_batch { args.at("basis-batch") };
 
@@ -42,67 +64,125 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
         basis.push_back(frames);
     }
 
     basis_batch.close();
 
-    std::ifstream frame_batch;
+    thread_pool::pool& pool = thread_pool::global();
+
+    par_embed::basis_chunks basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+
+    frame_store::stream frame_batch;
     frame_batch.open(args.at("frame-batch"));
 
-    std::vector<la::vector<double>> centers;
+    precision::scalar prec = precision::scalar::f64;
 
-    if (ebt::in(std::string("centers"), args)) {
-        std::ifstream centers_ifs { args.at("centers") };
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
 
-        std::string line;
+    kmeans::center_file centers;
+    centers.open(args.at("centers"));
 
-        while (std::getline(centers_ifs, line)) {
-            auto parts = ebt::split(line);
+    if (prec == precision::scalar::f32) {
+        basis_chunks.make_f32();
+        centers.make_f32();
+    }
 
-            la::vector<double> v;
-            v.resize(parts.size());
+    ivf::index idx;
+    int nprobe = 8;
 
-            int d = 0;
-            for (auto& p: parts) {
-                v(d) = std::stod(p);
-                ++d;
-            }
+    if (ebt::in(std::string("index"), args)) {
+        idx = ivf::load(args.at("index"));
 
-            centers.push_back(v);
+        if (!ivf::matches(idx, centers)) {
+            std::cerr << args.at("index") << " was built from other centers; rerun center-index" << std::endl;
+            exit(1);
         }
     }
 
+    if (ebt::in(std::string("nprobe"), args)) {
+        nprobe = std::stoi(args.at("nprobe"));
+    }
+
+    hkmeans::tree tree;
+
+    if (ebt::in(std::string("tree"), args)) {
+        tree = hkmeans::load(args.at("tree"));
+    }
+
     int nsample = 0;
+    int batch_size = 4 * pool.size();
 
-    while (1) {
-        seg_t seg = speech::load_frame_batch(frame_batch);
+    bool more = true;
 
-        if (!frame_batch) {
-            break;
+    while (more) {
+        std::vector<seg_t> segs;
+
+        while (segs.size() < batch_size) {
+            profile::scope prof { "load_frame_batch" };
+
+            seg_t seg;
+
+            if (!frame_batch.next(seg)) {
+                more = false;
+                break;
+            }
+
+            segs.push_back(seg);
         }
 
-        la::vector<double> seg_embed = embed::dtw_embed(seg, basis);
-        la::imul(seg_embed, 1.0 / la::norm(seg_embed));
+        profile::count("segments", segs.size());
 
-        double inf = std::numeric_limits<double>::infinity();
-        double min = inf;
-        int argmin = -1;
+        std::vector<la::vector<double>> seg_embeds;
 
-        for (int k = 0; k < centers.size(); ++k) {
-            double dist = la::norm(la::sub(centers[k], seg_embed));
+        {
+            profile::scope prof { "dtw_embed" };
 
-            if (dist < min) {
-                min = dist;
-                argmin = k;
+            if (prec == precision::scalar::f32) {
+                seg_embeds = par_embed::dtw_embed(precision::convert<float>(segs), basis_chunks, pool);
+            } else {
+                seg_embeds = par_embed::dtw_embed(segs, basis_chunks, pool);
             }
         }
 
-        std::cout << "sample: " << nsample << std::endl;
-        std::cout << "id: " << argmin << std::endl;
-        std::cout << std::endl;
+        for (auto& seg_embed: seg_embeds) {
+            la::imul(seg_embed, 1.0 / la::norm(seg_embed));
+
+            profile::scope prof { "assign" };
 
-        ++nsample;
+            double min;
+            int argmin;
+
+            if (ebt::in(std::string("tree"), args)) {
+                argmin = hkmeans::nearest(tree, seg_embed, min);
+            } else if (ebt::in(std::string("index"), args)) {
+                argmin = ivf::nearest(idx, centers, seg_embed, nprobe, min);
+            } else if (prec == precision::scalar::f32) {
+                argmin = kmeans::nearest_f32(centers, seg_embed.data(), min);
+            } else {
+                argmin = kmeans::nearest(centers, seg_embed, min);
+            }
+
+            if (output::enabled(output::results)) {
+                std::cout << "sample: " << nsample << '\n';
+                std::cout << "id: " << argmin << '\n';
+                std::cout << '\n';
+            }
+
+            if (result.is_open()) {
+                result.write(nsample, argmin, min);
+            }
+
+            ++nsample;
+        }
     }
 
     return 0;
@@ -4,24 +4,47 @@
 #include <algorithm>
 #include "speech/speech.h"
 #include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "par-embed.h"
+#include "kmeans.h"
+#include "hkmeans.h"
+#include "precision.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 
 using seg_t = std::vector<std::vector<double>>;
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-embed-kmeans",
         "Cluster reference vectors with k-means",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"basis-batch", "", true},
             {"k", "", true},
             {"centers", "", false},
-            {"output-centers", "", true},
+            {"output-centers", "", false},
             {"iter", "", true},
             {"seed", "", false},
             {"shuffle", "", false},
+            {"shard", "", false},
+            {"output-stat", "", false},
+            {"output-format", "", false},
+            {"checkpoint", "", false},
+            {"resume", "", false},
+            {"tree-branch", "", false},
+            {"output-tree", "", false},
+            {"precision", "double (default) or float, for the dtw embedding and the assignment", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -30,13 +53,15 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
     std::vector<seg_t> basis;
     std::ifstream basis_batch { args.at("basis-batch") };
 
@@ -47,11 +72,40 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
         basis.push_back(frames);
     }
 
     basis_batch.close();
 
+    thread_pool::pool& pool = thread_pool::global();
+
+    par_embed::basis_chunks basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+    int batch_size = 4 * pool.size();
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    if (prec == precision::scalar::f32) {
+        basis_chunks.make_f32();
+    }
+
+    auto embed_all = [&](std::vector<seg_t> const& segs) -> std::vector<la::vector<double>> {
+        if (prec == precision::scalar::f32) {
+            return par_embed::dtw_embed(precision::convert<float>(segs), basis_chunks, pool);
+        } else {
+            return par_embed::dtw_embed(segs, basis_chunks, pool);
+        }
+    };
+
     int iter = std::stod(args.at("iter"));
     int kcluster = std::stoi(args.at("k"));
 
@@ -62,10 +116,37 @@ int main(int argc, char *argv[])
 
     std::default_random_engine gen { seed };
 
-    std::string output_centers = args.at("output-centers");
+    int shard = 0;
+    int nshard = 1;
+
+    if (ebt::in(std::string("shard"), args)) {
+        if (!kmeans::parse_shard(args.at("shard"), shard, nshard)) {
+            std::cerr << "bad shard " << args.at("shard") << ", expecting i/n" << std::endl;
+            exit(1);
+        }
+
+        if (!ebt::in(std::string("centers"), args) || !ebt::in(std::string("output-stat"), args)) {
+            std::cerr << "--shard requires --centers and --output-stat" << std::endl;
+            exit(1);
+        }
+
+        // the centers only change when the shards are merged
+        iter = 1;
+    } else if (!ebt::in(std::string("output-centers"), args)) {
+        std::cerr << "--output-centers is required" << std::endl;
+        exit(1);
+    }
+
+    std::string checkpoint;
+
+    if (ebt::in(std::string("checkpoint"), args)) {
+        checkpoint = args.at("checkpoint");
+    } else if (ebt::in(std::string("output-centers"), args)) {
+        checkpoint = args.at("output-centers") + ".ckpt";
+    }
 
-    speech::batch_indices frame_batch;
-    frame_batch.open(args.at("frame-batch"));
+    frame_store::batch frame_batch;
+    frame_batch.open(args.at("frame-batch"), pool);
 
     std::vector<int> sample_indices;
     sample_indices.resize(frame_batch.pos.size());
@@ -82,57 +163,164 @@ int main(int argc, char *argv[])
         }
     }
 
+    // every shard shuffles with the same seed, so the slices are disjoint
+    int sample_begin = (long) frame_batch.pos.size() * shard / nshard;
+    int sample_end = (long) frame_batch.pos.size() * (shard + 1) / nshard;
+
+    frame_batch.pos = std::vector<unsigned long> { frame_batch.pos.begin() + sample_begin,
+        frame_batch.pos.begin() + sample_end };
+
     std::vector<la::vector<double>> centers;
 
     if (ebt::in(std::string("centers"), args)) {
-        std::ifstream centers_ifs { args.at("centers") };
+        centers = kmeans::load_centers(args.at("centers"));
+    }
 
-        std::string line;
+    if (ebt::in(std::string("shard"), args) && centers.size() != kcluster) {
+        std::cerr << "--shard needs all " << kcluster << " centers, got " << centers.size() << std::endl;
+        exit(1);
+    }
 
-        while (std::getline(centers_ifs, line)) {
-            auto parts = ebt::split(line);
+    std::vector<std::pair<la::vector<double>, int>> stat;
 
-            la::vector<double> v;
-            v.resize(parts.size());
+    if (ebt::in(std::string("tree-branch"), args)) {
+        if (ebt::in(std::string("shard"), args)) {
+            std::cerr << "--tree-branch does not support --shard" << std::endl;
+            exit(1);
+        }
 
-            int d = 0;
-            for (auto& p: parts) {
-                v(d) = std::stod(p);
-                ++d;
+        // the tree is built in one go; a checkpoint would replace its leaves
+        if (ebt::in(std::string("resume"), args)) {
+            std::cerr << "--tree-branch does not support --resume" << std::endl;
+            exit(1);
+        }
+
+        // every level of the tree revisits the points, so embed them once
+        std::vector<la::vector<double>> points;
+
+        for (int n = 0; n < frame_batch.pos.size(); n += batch_size) {
+            std::vector<seg_t> segs;
+
+            for (int m = n; m < std::min<int>(n + batch_size, frame_batch.pos.size()); ++m) {
+                segs.push_back(frame_batch.at(m));
             }
 
-            centers.push_back(v);
+            profile::scope prof { "dtw_embed" };
+
+            for (auto& seg_embed: embed_all(segs)) {
+                la::imul(seg_embed, 1.0 / la::norm(seg_embed));
+                points.push_back(seg_embed);
+            }
         }
+
+        profile::scope prof { "tree_build" };
+
+        hkmeans::tree t = hkmeans::build(points, kcluster,
+            std::stoi(args.at("tree-branch")), iter, seed);
+
+        double loss = 0;
+
+        for (int n = 0; n < points.size(); ++n) {
+            double dist;
+            int leaf = hkmeans::nearest(t, points[n], dist);
+            loss += dist;
+
+            if (result.is_open()) {
+                result.write(sample_begin + n, leaf, dist);
+            }
+        }
+
+        if (output::enabled(output::summary)) {
+            std::cout << "leaves: " << t.nleaf() << '\n';
+            std::cout << "nodes: " << t.center.size() << '\n';
+            std::cout << "loss: " << loss / points.size() << '\n';
+        }
+
+        if (ebt::in(std::string("output-tree"), args)) {
+            hkmeans::save(args.at("output-tree"), t);
+        }
+
+        centers = hkmeans::leaves(t);
+        iter = 0;
     }
 
-    std::vector<std::pair<la::vector<double>, int>> stat;
-    for (int k = 0; k < kcluster; ++k) {
-        la::vector<double> v;
-        v.resize(basis.size());
-        stat.push_back(std::make_pair(v, 0));
+    int start_iter = 0;
+
+    if (ebt::in(std::string("resume"), args) && kmeans::is_binary(checkpoint)) {
+        kmeans::center_file ckpt;
+        ckpt.open(checkpoint);
+
+        // the stat is written before the centers, so it is never behind
+        centers = kmeans::load_centers(checkpoint);
+
+        kmeans::stat_t ckpt_stat = kmeans::load_stat(checkpoint + ".stat", centers);
+
+        if (ckpt_stat.iteration != ckpt.iteration) {
+            kmeans::update(centers, ckpt_stat);
+        }
+
+        start_iter = ckpt_stat.iteration;
+
+        if (output::enabled(output::summary)) {
+            std::cout << "resume from iteration " << start_iter << '\n';
+        }
     }
 
-    for (int i = 0; i < iter; ++i) {
+    for (int i = start_iter; i < iter; ++i) {
+
+        // every pass is one Lloyd step from the current centers, the same
+        // update kmeans-merge makes from shard stats
+        stat = kmeans::make_stat(kcluster, basis.size()).stat;
+
+        // the centers only move between passes, so a pass searches one
+        // float copy of them, made once all k are seeded
+        kmeans::center_file centers32;
+        bool stale = true;
 
         std::vector<int> cluster_id;
         double loss = 0;
 
         int nsample = 0;
 
+        std::vector<la::vector<double>> seg_embeds;
+        int batch_start = 0;
+
         while (nsample < frame_batch.pos.size()) {
-            seg_t seg = speech::load_frame_batch(frame_batch.at(nsample));
+            if (nsample == batch_start + seg_embeds.size()) {
+                std::vector<seg_t> segs;
+
+                for (int n = nsample; n < std::min<int>(nsample + batch_size, frame_batch.pos.size()); ++n) {
+                    profile::scope prof { "load_frame_batch" };
+                    segs.push_back(frame_batch.at(n));
+                }
+
+                profile::scope prof { "dtw_embed" };
+                seg_embeds = embed_all(segs);
+                batch_start = nsample;
+            }
 
-            la::vector<double> seg_embed = embed::dtw_embed(seg, basis);
+            la::vector<double>& seg_embed = seg_embeds[nsample - batch_start];
             la::imul(seg_embed, 1.0 / la::norm(seg_embed));
 
             double inf = std::numeric_limits<double>::infinity();
             double min = inf;
             int argmin = -1;
 
+            profile::scope prof { "assign" };
+            profile::count("segments");
+
             if (centers.size() < kcluster) {
                 centers.push_back(seg_embed);
                 argmin = centers.size() - 1;
                 min = 0;
+            } else if (prec == precision::scalar::f32) {
+                if (stale) {
+                    centers32.assign(centers);
+                    centers32.make_f32();
+                    stale = false;
+                }
+
+                argmin = kmeans::nearest_f32(centers32, seg_embed.data(), min);
             } else {
                 for (int k = 0; k < kcluster; ++k) {
                     double dist = la::norm(la::sub(centers[k], seg_embed));
@@ -150,45 +338,69 @@ int main(int argc, char *argv[])
             la::iadd(stat[argmin].first, seg_embed);
             stat[argmin].second += 1;
 
-            std::cout << "sample: " << nsample << std::endl;
-            std::cout << "id: " << argmin << std::endl;
-            std::cout << "running loss: " << loss / (nsample + 1) << std::endl;
-            std::cout << std::endl;
+            if (output::enabled(output::detail)) {
+                std::cout << "sample: " << sample_begin + nsample << '\n';
+                std::cout << "id: " << argmin << '\n';
+                std::cout << "running loss: " << loss / (nsample + 1) << '\n';
+                std::cout << '\n';
+            }
+
+            if (result.is_open() && (i == iter - 1)) {
+                result.write(sample_begin + nsample, argmin, min);
+            }
 
             ++nsample;
         }
 
-        std::cout << "loss: " << loss / nsample << std::endl;
-
-        for (int k = 0; k < kcluster; ++k) {
-            centers[k] = la::mul(stat[k].first, 1.0 / stat[k].second);
+        if (output::enabled(output::summary)) {
+            std::cout << "loss: " << loss / nsample << '\n';
         }
 
-        std::ofstream centers_ofs { "centers-tmp" };
-        for (int k = 0; k < kcluster; ++k) {
-            for (int d = 0; d < centers[k].size(); ++d) {
-                centers_ofs << centers[k](d);
-                if (d != centers[k].size() - 1) {
-                    centers_ofs << " ";
-                }
+        if (ebt::in(std::string("shard"), args)) {
+            kmeans::stat_t shard_stat = kmeans::make_stat(centers.size(), centers.front().size());
+
+            for (int k = 0; k < stat.size(); ++k) {
+                shard_stat.stat[k] = stat[k];
             }
-            centers_ofs << std::endl;
-        }
-        centers_ofs.close();
 
-    }
+            shard_stat.loss = loss;
+            shard_stat.nsample = nsample;
 
-    std::ofstream centers_ofs { output_centers };
-    for (int k = 0; k < kcluster; ++k) {
-        for (int d = 0; d < centers[k].size(); ++d) {
-            centers_ofs << centers[k](d);
-            if (d != centers[k].size() - 1) {
-                centers_ofs << " ";
+            int base_iter = 0;
+
+            if (kmeans::is_binary(args.at("centers"))) {
+                kmeans::center_file f;
+                f.open(args.at("centers"));
+                base_iter = f.iteration;
             }
+
+            shard_stat.iteration = base_iter + 1;
+
+            kmeans::save_stat(args.at("output-stat"), shard_stat);
+
+            return 0;
         }
-        centers_ofs << std::endl;
+
+        kmeans::stat_t ckpt_stat = kmeans::make_stat(0, 0);
+        ckpt_stat.stat = stat;
+        ckpt_stat.loss = loss;
+        ckpt_stat.nsample = nsample;
+        ckpt_stat.iteration = i + 1;
+
+        kmeans::update(centers, ckpt_stat);
+
+        profile::scope prof { "checkpoint" };
+
+        kmeans::save_stat(checkpoint + ".stat", ckpt_stat);
+        kmeans::save_centers_bin(checkpoint, centers, i + 1);
+
+    }
+
+    if (ebt::in(std::string("output-format"), args) && args.at("output-format") == "bin") {
+        kmeans::save_centers_bin(args.at("output-centers"), centers, iter);
+    } else {
+        kmeans::save_centers(args.at("output-centers"), centers);
     }
-    centers_ofs.close();
 
     return 0;
 }
@@ -4,18 +4,32 @@
 #include <algorithm>
 #include "speech/speech.h"
 #include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "par-embed.h"
+#include "frame-store.h"
+#include "precision.h"
+#include "profile.h"
+#include "output.h"
 
 using seg_t = std::vector<std::vector<double>>;
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-embed",
         "Calculate distance based on DTW-embedding",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"basis-batch", "", true},
-            {"target", "", true}
+            {"target", "", true},
+            {"precision", "double (default) or float, for the dtw embedding", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -24,13 +38,15 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
     std::vector<seg_t> basis;
     std::ifstream basis_batch { args.at("basis-batch") };
 
@@ -41,32 +57,95 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
         basis.push_back(frames);
     }
 
     basis_batch.close();
 
+    thread_pool::pool& pool = thread_pool::global();
+
+    par_embed::basis_chunks basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    if (prec == precision::scalar::f32) {
+        basis_chunks.make_f32();
+    }
+
+    auto embed_all = [&](std::vector<seg_t> const& segs) -> std::vector<la::vector<double>> {
+        if (prec == precision::scalar::f32) {
+            return par_embed::dtw_embed(precision::convert<float>(segs), basis_chunks, pool);
+        } else {
+            return par_embed::dtw_embed(segs, basis_chunks, pool);
+        }
+    };
+
     std::ifstream target_ifs { args.at("target") };
     seg_t target = speech::load_frame_batch(target_ifs);
     target_ifs.close();
 
-    la::vector<double> target_embed = embed::dtw_embed(target, basis);
+    la::vector<double> target_embed = embed_all(std::vector<seg_t> { target }).front();
     la::imul(target_embed, 1.0 / la::norm(target_embed));
 
-    std::ifstream frame_batch { args.at("frame-batch") };
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
 
-    while (1) {
-        seg_t seg = speech::load_frame_batch(frame_batch);
+    int batch_size = 4 * pool.size();
+    int nsample = 0;
 
-        if (!frame_batch) {
-            break;
+    bool more = true;
+
+    while (more) {
+        std::vector<seg_t> segs;
+
+        while (segs.size() < batch_size) {
+            profile::scope prof { "load_frame_batch" };
+
+            seg_t seg;
+
+            if (!frame_batch.next(seg)) {
+                more = false;
+                break;
+            }
+
+            segs.push_back(seg);
+        }
+
+        profile::count("segments", segs.size());
+
+        std::vector<la::vector<double>> seg_embeds;
+
+        {
+            profile::scope prof { "dtw_embed" };
+            seg_embeds = embed_all(segs);
         }
 
-        la::vector<double> seg_embed = embed::dtw_embed(seg, basis);
-        la::imul(seg_embed, 1.0 / la::norm(seg_embed));
+        for (auto& seg_embed: seg_embeds) {
+            la::imul(seg_embed, 1.0 / la::norm(seg_embed));
 
-        // std::cout << "dist: " << la::dot(seg_embed, target_embed) << std::endl;
-        std::cout << "dist: " << la::norm(la::sub(seg_embed, target_embed)) << std::endl;
+            double d = la::norm(la::sub(seg_embed, target_embed));
+
+            // std::cout << "dist: " << la::dot(seg_embed, target_embed) << std::endl;
+            if (output::enabled(output::results)) {
+                std::cout << "dist: " << d << '\n';
+            }
+
+            if (result.is_open()) {
+                result.write(nsample, 0, d);
+            }
+
+            ++nsample;
+        }
     }
 
     return 0;
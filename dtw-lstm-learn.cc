@@ -3,7 +3,11 @@
 #include "speech/speech.h"
 #include "nn/lstm-frame.h"
 #include "unsupseg/dtw.h"
-#include "nn/lstm-tensor-tree.h"
+#include "lstm-embed.h"
+#include "frame-store.h"
+#include "arena.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 #include <algorithm>
 
@@ -11,23 +15,11 @@ std::vector<std::vector<double>>
 sample_seg(std::vector<std::vector<double>> const& frames,
     std::default_random_engine& gen);
 
-std::vector<std::shared_ptr<autodiff::op_t>>
-to_op(std::vector<std::vector<double>> const& frames,
-    autodiff::computation_graph& comp_graph);
-
-std::shared_ptr<tensor_tree::vertex>
-make_tensor_tree(int layer);
-
-std::shared_ptr<autodiff::op_t>
-embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
-    int layer,
-    std::shared_ptr<tensor_tree::vertex> var_tree);
-
 struct learning_env {
 
     learning_env(std::unordered_map<std::string, std::string> const& args);
 
-    speech::batch_indices frame_batch;
+    frame_store::batch frame_batch;
 
     int layer;
     std::shared_ptr<tensor_tree::vertex> param;
@@ -40,6 +32,8 @@ struct learning_env {
 
     std::shared_ptr<tensor_tree::optimizer> opt;
 
+    std::unique_ptr<arena::region> graph_arena;
+
     std::unordered_map<std::string, std::string> args;
 
     void run();
@@ -48,11 +42,13 @@ struct learning_env {
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-lstm-learn",
         "Train an LSTM to produce embeddings that respect DTW",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"param", "", true},
             {"opt-data", "", true},
             {"output-param", "", true},
@@ -62,6 +58,9 @@ int main(int argc, char *argv[])
             {"const-step-update", "", false},
             {"seed", "", false},
             {"shuffle", "", false},
+            {"arena", "allocate each sample's transcribers and loss gradients in an arena", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
         }
     };
 
@@ -70,14 +69,13 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args
         = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
     learning_env env { args };
 
     env.run();
@@ -89,13 +87,13 @@ learning_env::learning_env(
     std::unordered_map<std::string, std::string> const& args)
     : args{args}
 {
-    frame_batch.open(args.at("frame-batch"));
+    frame_batch.open(args.at("frame-batch"), thread_pool::global());
 
     std::string line;
     std::ifstream param_ifs {args.at("param")};
     std::getline(param_ifs, line);
     layer = std::stoi(line);
-    param = make_tensor_tree(layer);
+    param = lstm_embed::make_tensor_tree(layer);
     tensor_tree::load_tensor(param, param_ifs);
     param_ifs.close();
 
@@ -124,6 +122,11 @@ learning_env::learning_env(
 
     gen = std::default_random_engine{seed};
 
+    if (ebt::in(std::string("arena"), args)) {
+        // address space only; pages are backed as samples need them
+        graph_arena.reset(new arena::region(1L << 30));
+    }
+
     if (ebt::in(std::string("shuffle"), args)) {
         std::vector<int> sample_indices;
         for (int i = 0; i < frame_batch.pos.size(); ++i) {
@@ -144,34 +147,85 @@ void learning_env::run()
     int nsample = 0;
 
     while (nsample < frame_batch.pos.size() - 2) {
+        arena::scope mem { graph_arena.get() };
+
         autodiff::computation_graph comp_graph;
         std::shared_ptr<tensor_tree::vertex> var_tree = tensor_tree::make_var_tree(comp_graph, param);
 
         std::shared_ptr<lstm::transcriber> transcriber;
 
-        std::vector<std::vector<double>> frames = speech::load_frame_batch(frame_batch.at(nsample));
+        std::vector<std::vector<double>> frames;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+            frames = frame_batch.at(nsample);
+        }
+
         std::vector<std::vector<double>> seg1 = sample_seg(frames, gen);
         ++nsample;
-        auto seg1_op = to_op(seg1, comp_graph);
-        auto e1 = embed(seg1_op, layer, var_tree);
-        std::cout << "seg 1: " << seg1.size() << std::endl;
+        auto seg1_op = lstm_embed::to_op(seg1, comp_graph);
+
+        std::shared_ptr<autodiff::op_t> e1;
+
+        {
+            profile::scope prof { "lstm_embed" };
+            e1 = lstm_embed::embed(seg1_op, layer, var_tree, graph_arena.get());
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cout << "seg 1: " << seg1.size() << '\n';
+        }
+
+        {
+            profile::scope prof { "load_frame_batch" };
+            frames = frame_batch.at(nsample);
+        }
 
-        frames = speech::load_frame_batch(frame_batch.at(nsample));
         std::vector<std::vector<double>> seg2 = sample_seg(frames, gen);
         ++nsample;
-        auto seg2_op = to_op(seg2, comp_graph);
-        auto e2 = embed(seg2_op, layer, var_tree);
-        std::cout << "seg 2: " << seg2.size() << std::endl;
+        auto seg2_op = lstm_embed::to_op(seg2, comp_graph);
+
+        std::shared_ptr<autodiff::op_t> e2;
+
+        {
+            profile::scope prof { "lstm_embed" };
+            e2 = lstm_embed::embed(seg2_op, layer, var_tree, graph_arena.get());
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cout << "seg 2: " << seg2.size() << '\n';
+        }
+
+        {
+            profile::scope prof { "load_frame_batch" };
+            frames = frame_batch.at(nsample);
+        }
 
-        frames = speech::load_frame_batch(frame_batch.at(nsample));
         std::vector<std::vector<double>> seg3 = sample_seg(frames, gen);
         ++nsample;
-        auto seg3_op = to_op(seg3, comp_graph);
-        auto e3 = embed(seg3_op, layer, var_tree);
-        std::cout << "seg 3: " << seg3.size() << std::endl;
+        auto seg3_op = lstm_embed::to_op(seg3, comp_graph);
+
+        std::shared_ptr<autodiff::op_t> e3;
+
+        {
+            profile::scope prof { "lstm_embed" };
+            e3 = lstm_embed::embed(seg3_op, layer, var_tree, graph_arena.get());
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cout << "seg 3: " << seg3.size() << '\n';
+        }
+
+        double d12;
+        double d13;
 
-        double d12 = dtw::dtw(seg1, seg2);
-        double d13 = dtw::dtw(seg1, seg3);
+        {
+            profile::scope prof { "dtw" };
+            d12 = dtw::dtw(seg1, seg2);
+            d13 = dtw::dtw(seg1, seg3);
+        }
+
+        profile::count("segments", 3);
 
         std::shared_ptr<autodiff::op_t> near;
         std::shared_ptr<autodiff::op_t> far;
@@ -192,26 +246,36 @@ void learning_env::run()
                 - autodiff::get_output<double>(near) + autodiff::get_output<double>(far));
         }
 
-        std::cout << "loss: " << loss << std::endl;
+        if (output::enabled(output::summary)) {
+            std::cout << "loss: " << loss << '\n';
+        }
 
         if (loss > 0) {
-            near->grad = std::make_shared<double>(-1);
-            far->grad = std::make_shared<double>(1);
+            near->grad = arena::make_shared<double>(graph_arena.get(), -1);
+            far->grad = arena::make_shared<double>(graph_arena.get(), 1);
 
-            auto topo_order = autodiff::natural_topo_order(comp_graph);
-            autodiff::guarded_grad(topo_order, autodiff::grad_funcs);
+            {
+                profile::scope prof { "guarded_grad" };
+                auto topo_order = autodiff::natural_topo_order(comp_graph);
+                autodiff::guarded_grad(topo_order, autodiff::grad_funcs);
+            }
 
-            auto grad = make_tensor_tree(layer);
+            auto grad = lstm_embed::make_tensor_tree(layer);
             tensor_tree::copy_grad(grad, var_tree);
 
             double n = tensor_tree::norm(grad);
 
-            std::cout << "grad norm: " << n << std::endl;
+            if (output::enabled(output::detail)) {
+                std::cout << "grad norm: " << n << '\n';
+            }
 
             if (ebt::in(std::string("clip"), args)) {
                 if (n > clip) {
                     tensor_tree::imul(grad, clip / n);
-                    std::cout << "gradient clipped" << std::endl;
+
+                    if (output::enabled(output::detail)) {
+                        std::cout << "gradient clipped" << '\n';
+                    }
                 }
             }
 
@@ -220,18 +284,29 @@ void learning_env::run()
 
             double v1 = v.data()[0];
 
-            opt->update(grad);
+            {
+                profile::scope prof { "opt_update" };
+                opt->update(grad);
+            }
 
             double v2 = v.data()[0];
 
-            std::cout << "weight: " << v1 << " update: " << v2 - v1
-                << " rate: " << (v2 - v1) / v1 << std::endl;
+            if (output::enabled(output::detail)) {
+                std::cout << "weight: " << v1 << " update: " << v2 - v1
+                    << " rate: " << (v2 - v1) / v1 << '\n';
+            }
 
         }
 
-        std::cout << "norm: " << tensor_tree::norm(param) << std::endl;
+        if (output::enabled(output::detail)) {
+            std::cout << "norm: " << tensor_tree::norm(param) << '\n';
+
+            if (graph_arena != nullptr) {
+                std::cout << "arena allocations: " << mem.allocations() << '\n';
+            }
 
-        std::cout << std::endl;
+            std::cout << '\n';
+        }
     }
 
     std::ofstream param_ofs { args.at("output-param") };
@@ -260,7 +335,9 @@ sample_seg(std::vector<std::vector<double>> const& frames,
 
     int end_time = std::min<int>(start_time + dur * 4, frames.size() - 1);
 
-    std::cout << "start: " << start_time << " end: " << end_time << std::endl;
+    if (output::enabled(output::detail)) {
+        std::cout << "start: " << start_time << " end: " << end_time << '\n';
+    }
 
     std::vector<std::vector<double>> seg_frames;
 
@@ -271,70 +348,3 @@ sample_seg(std::vector<std::vector<double>> const& frames,
     return seg_frames;
 }
 
-std::vector<std::shared_ptr<autodiff::op_t>>
-to_op(std::vector<std::vector<double>> const& frames,
-    autodiff::computation_graph& comp_graph)
-{
-    std::vector<std::shared_ptr<autodiff::op_t>> result;
-
-    for (auto& f: frames) {
-        result.push_back(comp_graph.var(la::tensor<double>{la::vector<double>{f}}));
-    }
-
-    return result;
-}
-
-std::shared_ptr<tensor_tree::vertex>
-make_tensor_tree(int layer)
-{
-    // tensor_tree::vertex result { tensor_tree::tensor_t::nil };
-
-    lstm::multilayer_lstm_tensor_tree_factory factory {
-        std::make_shared<lstm::bi_lstm_tensor_tree_factory>(
-        lstm::bi_lstm_tensor_tree_factory {
-            std::make_shared<lstm::dyer_lstm_tensor_tree_factory>(
-                lstm::dyer_lstm_tensor_tree_factory{})
-        }),
-        layer
-    };
-
-    // result.children.push_back(factory());
-    // result.children.push_back(tensor_tree::make_tensor("projection weight"));
-    // result.children.push_back(tensor_tree::make_tensor("projection bias"));
-
-    // return std::make_shared<tensor_tree::vertex>(result);
-
-    return std::shared_ptr<tensor_tree::vertex>(factory());
-}
-
-std::shared_ptr<autodiff::op_t>
-embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
-    int layer,
-    std::shared_ptr<tensor_tree::vertex> var_tree)
-{
-    std::shared_ptr<lstm::step_transcriber> step;
-
-    step = std::make_shared<lstm::dyer_lstm_step_transcriber>(
-        lstm::dyer_lstm_step_transcriber{});
-
-    lstm::layered_transcriber result;
-
-    for (int i = 0; i < layer; ++i) {
-        std::shared_ptr<lstm::transcriber> trans;
-
-        trans = std::make_shared<lstm::lstm_transcriber>(
-            lstm::lstm_transcriber { step });
-
-        trans = std::make_shared<lstm::bi_transcriber>(
-            lstm::bi_transcriber { trans });
-
-        result.layer.push_back(trans);
-    }
-
-    std::shared_ptr<lstm::transcriber> trans = std::make_shared<lstm::layered_transcriber>(result);
-
-    std::vector<std::shared_ptr<autodiff::op_t>> feat = (*trans)(var_tree, seg_frames);
-
-    return autodiff::add(feat);
-}
-
@@ -3,31 +3,24 @@
 #include "speech/speech.h"
 #include "nn/lstm-frame.h"
 #include "unsupseg/dtw.h"
-#include "nn/lstm-tensor-tree.h"
+#include "lstm-embed.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 #include <algorithm>
 
-std::vector<std::shared_ptr<autodiff::op_t>>
-to_op(std::vector<std::vector<double>> const& frames,
-    autodiff::computation_graph& comp_graph);
-
-std::shared_ptr<tensor_tree::vertex>
-make_tensor_tree(int layer);
-
-std::shared_ptr<autodiff::op_t>
-embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
-    int layer,
-    std::shared_ptr<tensor_tree::vertex> var_tree);
-
 struct prediction_env {
 
     prediction_env(std::unordered_map<std::string, std::string> const& args);
 
-    std::ifstream seg_batch;
+    frame_store::stream seg_batch;
 
     int layer;
     std::shared_ptr<tensor_tree::vertex> param;
 
+    output::result_writer result;
+
     std::unordered_map<std::string, std::string> args;
 
     void run();
@@ -36,13 +29,19 @@ struct prediction_env {
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw-lstm-predict",
         "Predict distance",
         {
-            {"seg-batch", "", true},
+            {"seg-batch", "text batch, frame store, or - for stdin", true},
             {"target", "", true},
             {"param", "", true},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -51,14 +50,13 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args
         = ebt::parse_args(argc, argv, spec);
 
+    output::setup(args);
+
     prediction_env env { args };
 
     env.run();
@@ -76,9 +74,11 @@ prediction_env::prediction_env(
     std::ifstream param_ifs {args.at("param")};
     std::getline(param_ifs, line);
     layer = std::stoi(line);
-    param = make_tensor_tree(layer);
+    param = lstm_embed::make_tensor_tree(layer);
     tensor_tree::load_tensor(param, param_ifs);
     param_ifs.close();
+
+    result.open(args);
 }
 
 void prediction_env::run()
@@ -95,89 +95,43 @@ void prediction_env::run()
 
         std::shared_ptr<lstm::transcriber> transcriber;
 
-        std::vector<std::vector<double>> seg = speech::load_frame_batch(seg_batch);
-        ++nsample;
-
-        if (!seg_batch) {
-            break;
-        }
-
-        auto seg_op = to_op(seg, comp_graph);
-        auto e1 = embed(seg_op, layer, var_tree);
-        auto target_op = to_op(target, comp_graph);
-        auto e2 = embed(target_op, layer, var_tree);
-
-        auto dist = autodiff::norm(autodiff::sub(e1, e2));
-
-        std::cout << "dist: " << autodiff::get_output<double>(dist) << std::endl;
-    }
-
-}
-
-std::vector<std::shared_ptr<autodiff::op_t>>
-to_op(std::vector<std::vector<double>> const& frames,
-    autodiff::computation_graph& comp_graph)
-{
-    std::vector<std::shared_ptr<autodiff::op_t>> result;
+        std::vector<std::vector<double>> seg;
 
-    for (auto& f: frames) {
-        result.push_back(comp_graph.var(la::tensor<double>{la::vector<double>{f}}));
-    }
-
-    return result;
-}
-
-std::shared_ptr<tensor_tree::vertex>
-make_tensor_tree(int layer)
-{
-    // tensor_tree::vertex result { tensor_tree::tensor_t::nil };
-
-    lstm::multilayer_lstm_tensor_tree_factory factory {
-        std::make_shared<lstm::bi_lstm_tensor_tree_factory>(
-        lstm::bi_lstm_tensor_tree_factory {
-            std::make_shared<lstm::dyer_lstm_tensor_tree_factory>(
-                lstm::dyer_lstm_tensor_tree_factory{})
-        }),
-        layer
-    };
-
-    // result.children.push_back(factory());
-    // result.children.push_back(tensor_tree::make_tensor("projection weight"));
-    // result.children.push_back(tensor_tree::make_tensor("projection bias"));
+        {
+            profile::scope prof { "load_frame_batch" };
 
-    // return std::make_shared<tensor_tree::vertex>(result);
+            if (!seg_batch.next(seg)) {
+                break;
+            }
+        }
 
-    return std::shared_ptr<tensor_tree::vertex>(factory());
-}
+        ++nsample;
 
-std::shared_ptr<autodiff::op_t>
-embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
-    int layer,
-    std::shared_ptr<tensor_tree::vertex> var_tree)
-{
-    std::shared_ptr<lstm::step_transcriber> step;
+        profile::count("segments");
 
-    step = std::make_shared<lstm::dyer_lstm_step_transcriber>(
-        lstm::dyer_lstm_step_transcriber{});
+        std::shared_ptr<autodiff::op_t> e1;
+        std::shared_ptr<autodiff::op_t> e2;
 
-    lstm::layered_transcriber result;
+        {
+            profile::scope prof { "lstm_embed" };
+            auto seg_op = lstm_embed::to_op(seg, comp_graph);
+            e1 = lstm_embed::embed(seg_op, layer, var_tree);
+            auto target_op = lstm_embed::to_op(target, comp_graph);
+            e2 = lstm_embed::embed(target_op, layer, var_tree);
+        }
 
-    for (int i = 0; i < layer; ++i) {
-        std::shared_ptr<lstm::transcriber> trans;
+        auto dist = autodiff::norm(autodiff::sub(e1, e2));
 
-        trans = std::make_shared<lstm::lstm_transcriber>(
-            lstm::lstm_transcriber { step });
+        double d = autodiff::get_output<double>(dist);
 
-        trans = std::make_shared<lstm::bi_transcriber>(
-            lstm::bi_transcriber { trans });
+        if (output::enabled(output::results)) {
+            std::cout << "dist: " << d << '\n';
+        }
 
-        result.layer.push_back(trans);
+        if (result.is_open()) {
+            result.write(nsample - 1, 0, d);
+        }
     }
 
-    std::shared_ptr<lstm::transcriber> trans = std::make_shared<lstm::layered_transcriber>(result);
-
-    std::vector<std::shared_ptr<autodiff::op_t>> feat = (*trans)(var_tree, seg_frames);
-
-    return autodiff::add(feat);
 }
 
@@ -2,18 +2,31 @@
 #include "ebt/ebt.h"
 #include <fstream>
 #include <algorithm>
+#include <limits>
 #include "speech/speech.h"
 #include "unsupseg/dtw.h"
+#include "frame-store.h"
+#include "spans.h"
+#include "precision.h"
+#include "profile.h"
+#include "output.h"
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "dtw",
         "Calculate DTW distance",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"target", "", true},
             {"target-norm", "", false},
+            {"precision", "double (default) or float", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -22,33 +35,85 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::echo(argc, argv);
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
-    std::ifstream frame_batch { args.at("frame-batch") };
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
 
     std::ifstream target_ifs { args.at("target") };
     std::vector<std::vector<double>> target = speech::load_frame_batch(target_ifs);
     target_ifs.close();
 
+    if (target.size() == 0) {
+        std::cerr << "empty target " << args.at("target") << std::endl;
+        exit(1);
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    // the float path runs the dtw of spans::dtw_start, whose frame
+    // distance and recurrence are those of dtw::dtw
+    std::vector<std::vector<std::vector<float>>> target32;
+
+    if (prec == precision::scalar::f32) {
+        target32.push_back(precision::convert<float>(target));
+    }
+
+    int nsample = 0;
+
     while (1) {
-        std::vector<std::vector<double>> frames = speech::load_frame_batch(frame_batch);
+        std::vector<std::vector<double>> frames;
+
+        {
+            profile::scope prof { "load_frame_batch" };
 
-        if (!frame_batch) {
-            break;
+            if (!frame_batch.next(frames)) {
+                break;
+            }
         }
 
-        double d = dtw::dtw(frames, target);
+        profile::count("segments");
+
+        double d;
+
+        {
+            profile::scope prof { "dtw" };
+
+            if (prec == precision::scalar::f32) {
+                // the whole segment is the one span of its own length
+                int n = frames.size();
+                d = std::numeric_limits<double>::infinity();
+                spans::dtw_start(precision::convert<float>(frames), target32, 0, n, n, &d);
+            } else {
+                d = dtw::dtw(frames, target);
+            }
+        }
 
         if (ebt::in(std::string("target-norm"), args)) {
             d = d / target.size();
         }
 
-        std::cout << "dist: " << d << std::endl;
+        if (output::enabled(output::results)) {
+            std::cout << "dist: " << d << '\n';
+        }
+
+        if (result.is_open()) {
+            result.write(nsample, 0, d);
+        }
+
+        ++nsample;
     }
 
     return 0;
@@ -0,0 +1,298 @@
+#!/bin/bash
+#
+# End-to-end throughput and regression run over a synthetic corpus.
+#
+#   e2e-bench.sh [-s scale] [-w workdir] [-g golden] [-t threshold] [-u]
+#
+# Every tool runs on data from synth-data.  Wall time and peak RSS come
+# from /usr/bin/time.  Outputs are compared with golden/<tool>.out (the
+# command-line echo on the first line is dropped), and segments/second
+# with golden/throughput.tsv.  -u rewrites the golden files instead of
+# checking them.  Every frame-pack codec is unpacked again and checked
+# against the text within its tolerance, and the DTW spans of span-embed
+# are checked against the library at both precisions.  The LSTM and RSG
+# tools need trained parameters; they run only when
+# LSTM_PARAM/LSTM_OPT_DATA and RSG_PARAM/RSG_OPT_DATA point at them.
+
+set -u
+
+bin=$(cd "$(dirname "$0")" && pwd)
+scale=1
+work=e2e-work
+golden=e2e-golden
+threshold=0.2
+update=0
+
+while getopts "s:w:g:t:u" opt; do
+    case $opt in
+        s) scale=$OPTARG ;;
+        w) work=$OPTARG ;;
+        g) golden=$OPTARG ;;
+        t) threshold=$OPTARG ;;
+        u) update=1 ;;
+        *) exit 1 ;;
+    esac
+done
+
+mkdir -p $work/data $work/out $golden
+
+nutt=$((20 * scale))
+nseg=$((100 * scale))
+
+$bin/synth-data --output-dir=$work/data --nutt=$nutt --nseg=$nseg --seed=1 > /dev/null || exit 1
+
+d=$work/data
+fail=0
+summary=$work/throughput.tsv
+
+echo -e "tool\tsegments\tseconds\tseg_per_sec\tpeak_rss_kb" > $summary
+
+# run <name> <segments processed> <command...>
+run() {
+    local name=$1
+    local nsample=$2
+    shift 2
+
+    /usr/bin/time -f "%e %M" -o $work/out/$name.time "$@" > $work/out/$name.raw 2> $work/out/$name.err
+
+    if [ $? -ne 0 ]; then
+        echo "$name: FAILED, see $work/out/$name.err"
+        fail=1
+        return
+    fi
+
+    tail -n +2 $work/out/$name.raw > $work/out/$name.out
+
+    read sec rss < <(tail -n 1 $work/out/$name.time)
+    local rate=$(awk -v n=$nsample -v s=$sec 'BEGIN { printf "%.2f", (s > 0 ? n / s : n / 0.01) }')
+
+    echo -e "$name\t$nsample\t$sec\t$rate\t$rss" >> $summary
+    printf "%-28s %8s seg/s %8s s %10s KB\n" $name $rate $sec $rss
+
+    if [ $update -eq 1 ]; then
+        cp $work/out/$name.out $golden/$name.out
+        return
+    fi
+
+    if [ ! -f $golden/$name.out ]; then
+        echo "$name: no golden output"
+    elif ! cmp -s $work/out/$name.out $golden/$name.out; then
+        echo "$name: output differs from $golden/$name.out"
+        fail=1
+    fi
+
+    if [ -f $golden/throughput.tsv ]; then
+        local base=$(awk -v n=$name '$1 == n { print $4 }' $golden/throughput.tsv)
+
+        if [ -n "$base" ] && awk -v r=$rate -v b=$base -v t=$threshold 'BEGIN { exit !(r < b * (1 - t)) }'; then
+            echo "$name: throughput $rate seg/s is below $base seg/s by more than $threshold"
+            fail=1
+        fi
+    fi
+}
+
+run dtw $nseg $bin/dtw --frame-batch=$d/seg.logmel --target=$d/target.logmel
+run dtw-embed $nseg $bin/dtw-embed --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel --target=$d/target.logmel
+run conv-embed $nseg $bin/conv-embed --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel --target=$d/target.logmel
+
+run dtw-embed-kmeans $((2 * nseg)) $bin/dtw-embed-kmeans --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --k=10 --iter=2 --seed=1 --output-centers=$work/out/dtw-centers
+run dtw-embed-kmeans-predict $nseg $bin/dtw-embed-kmeans-predict --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --centers=$work/out/dtw-centers
+
+run conv-embed-kmeans $((2 * nseg)) $bin/conv-embed-kmeans --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --k=10 --iter=2 --seed=1 --output-centers=$work/out/conv-centers
+run conv-embed-kmeans-predict $nseg $bin/conv-embed-kmeans-predict --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --centers=$work/out/conv-centers
+
+run conv-kmeans-learn $nseg $bin/conv-kmeans-learn --frame-batch=$d/seg.logmel --param=$d/conv-param \
+    --output-param=$work/out/conv-param
+run conv-kmeans-predict $((2 * nseg)) $bin/conv-kmeans-predict --frame-batch=$d/seg.logmel --param=$work/out/conv-param \
+    --cluster=0
+
+# the binary centers are read back by mmap, so a change to the KMCB
+# layout shows up as a differing prediction
+run dtw-embed-kmeans-bin $((2 * nseg)) $bin/dtw-embed-kmeans --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --k=10 --iter=2 --seed=1 --output-centers=$work/out/dtw-centers.bin --output-format=bin
+run dtw-embed-kmeans-predict-bin $nseg $bin/dtw-embed-kmeans-predict --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel \
+    --centers=$work/out/dtw-centers.bin
+
+run random-seg $nseg $bin/random-seg --frame-batch=$d/utt.logmel --nsegs=$nseg --duration=20,40 --seed=1
+
+# roundtrip <codec> <relative tolerance> <tolerance as a fraction of the range>
+#
+# Packs the utterances with frame-pack, unpacks them with frame-unpack and
+# checks names, frame counts and every value.  q16 and q8 quantize each
+# dimension of an utterance over its range, so their error is bounded by a
+# fraction of that range; f32 and f16 round each value on its own.
+roundtrip() {
+    local codec=$1
+    local store=$work/out/utt.$codec
+
+    if ! $bin/frame-pack --frame-batch=$d/utt.logmel --output=$store --codec=$codec > /dev/null 2> $store.err \
+        || ! $bin/frame-unpack --store=$store --output=$store.logmel 2>> $store.err; then
+        echo "frame-pack $codec: FAILED, see $store.err"
+        fail=1
+        return
+    fi
+
+    awk -v rel=$2 -v q=$3 -v other=$store.logmel '
+        function check(   t, j, lo, hi, err) {
+            for (j = 1; j <= dim; ++j) {
+                lo = a[1, j]
+                hi = a[1, j]
+
+                for (t = 2; t <= nframes; ++t) {
+                    lo = (a[t, j] < lo ? a[t, j] : lo)
+                    hi = (a[t, j] > hi ? a[t, j] : hi)
+                }
+
+                for (t = 1; t <= nframes; ++t) {
+                    err = a[t, j] - b[t, j]
+                    err = (err < 0 ? -err : err)
+
+                    if (err > rel * (a[t, j] < 0 ? -a[t, j] : a[t, j]) + q * (hi - lo) + 1e-6) {
+                        print name ": frame " t - 1 ", dimension " j - 1 ": " a[t, j] " unpacked as " b[t, j]
+                        bad = 1
+                        exit 1
+                    }
+                }
+            }
+        }
+
+        BEGIN {
+            header = 1
+        }
+
+        {
+            if ((getline line < other) <= 0) {
+                print "unpacked output ends early at " $0
+                bad = 1
+                exit 1
+            }
+
+            if (header) {
+                if (line != $0) {
+                    print "utterance " $0 " unpacked as " line
+                    bad = 1
+                    exit 1
+                }
+
+                name = $0
+                nframes = 0
+                header = 0
+                next
+            }
+
+            if ($0 == "." || line == ".") {
+                if ($0 != line) {
+                    print name ": frame counts differ"
+                    bad = 1
+                    exit 1
+                }
+
+                check()
+                header = 1
+                next
+            }
+
+            ++nframes
+            dim = split($0, x, " ")
+
+            if (split(line, y, " ") != dim) {
+                print name ": frame " nframes - 1 " has a different dimension"
+                bad = 1
+                exit 1
+            }
+
+            for (j = 1; j <= dim; ++j) {
+                a[nframes, j] = x[j] + 0
+                b[nframes, j] = y[j] + 0
+            }
+        }
+
+        END {
+            if (!bad && (getline line < other) > 0) {
+                print "unpacked output has extra lines"
+                bad = 1
+                exit 1
+            }
+        }' $d/utt.logmel > $store.diff
+
+    if [ $? -ne 0 ]; then
+        echo "frame-pack $codec: round trip differs, $(cat $store.diff)"
+        fail=1
+    else
+        printf "%-28s %8s\n" "frame-pack $codec" ok
+    fi
+}
+
+roundtrip f32 1e-6 0
+roundtrip f16 1e-3 0
+roundtrip q16 0 1e-4
+roundtrip q8 0 3e-3
+
+# spancheck <precision> <relative tolerance>
+#
+# spans::dtw_start has its own copy of the dtw::dtw recurrence, which the
+# float dtw and dtw_embed paths and segment also run.  span-embed --check
+# compares random spans of every segment with embed::dtw_embed from
+# libunsupseg.
+spancheck() {
+    local prec=$1
+    local out=$work/out/span-check.$prec
+
+    if ! $bin/span-embed --frame-batch=$d/seg.logmel --basis-batch=$d/basis.logmel --output=$out.spans \
+            --max-dur=20 --check=5 --seed=1 --precision=$prec --verbosity=summary > $out 2> $out.err; then
+        echo "span-embed $prec: FAILED, see $out.err"
+        fail=1
+        return
+    fi
+
+    local diff=$(awk '/^max relative difference:/ { print $4 }' $out)
+
+    if [ -z "$diff" ]; then
+        echo "span-embed $prec: no spans checked"
+        fail=1
+    elif awk -v x=$diff -v t=$2 'BEGIN { exit !(x > t) }'; then
+        echo "span-embed $prec: spans differ from embed::dtw_embed by $diff, more than $2"
+        fail=1
+    else
+        printf "%-28s %8s\n" "span-embed $prec" ok
+    fi
+}
+
+spancheck double 1e-9
+spancheck float 1e-5
+
+if [ -n "${LSTM_PARAM:-}" ] && [ -n "${LSTM_OPT_DATA:-}" ]; then
+    run dtw-lstm-learn $nseg $bin/dtw-lstm-learn --frame-batch=$d/seg.logmel --param=$LSTM_PARAM --opt-data=$LSTM_OPT_DATA \
+        --step-size=0.01 --seed=1 --output-param=$work/out/lstm-param --output-opt-data=$work/out/lstm-opt-data
+    run dtw-lstm-predict $nseg $bin/dtw-lstm-predict --seg-batch=$d/seg.logmel --target=$d/target.logmel \
+        --param=$work/out/lstm-param
+else
+    echo "dtw-lstm-learn, dtw-lstm-predict: skipped, LSTM_PARAM and LSTM_OPT_DATA not set"
+fi
+
+if [ -n "${RSG_PARAM:-}" ] && [ -n "${RSG_OPT_DATA:-}" ]; then
+    run rsg-unsup-learn $nseg $bin/rsg-unsup-learn --frame-batch=$d/seg.logmel --label-batch=$d/seg.label \
+        --label=$d/label-set --param=$RSG_PARAM --opt-data=$RSG_OPT_DATA --step-size=0.01 --seed=1 \
+        --output-param=$work/out/rsg-param --output-opt-data=$work/out/rsg-opt-data
+    run rsg-unsup-predict $nseg $bin/rsg-unsup-predict --frame-batch=$d/seg.logmel --label=$d/label-set \
+        --param=$work/out/rsg-param
+else
+    echo "rsg-unsup-learn, rsg-unsup-predict: skipped, RSG_PARAM and RSG_OPT_DATA not set"
+fi
+
+if [ $update -eq 1 ]; then
+    cp $summary $golden/throughput.tsv
+    echo "golden files updated in $golden"
+    exit 0
+fi
+
+if [ $fail -ne 0 ]; then
+    echo "FAIL"
+    exit 1
+fi
+
+echo "PASS"
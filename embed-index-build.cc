@@ -0,0 +1,167 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "text-batch.h"
+#include "thread-pool.h"
+#include "par-embed.h"
+#include "embed-index.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "embed-index-build",
+        "Embed a segment collection once into a searchable index",
+        {
+            {"frame-batch", "", true},
+            {"basis-batch", "", true},
+            {"mode", "dtw or conv", true},
+            {"output", "", true},
+            {"storage", "f64, f32 (default), f16 or i8", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    std::string mode = args.at("mode");
+
+    if (mode != "dtw" && mode != "conv") {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    embed_index::storage type = embed_index::storage::f32;
+
+    if (ebt::in(std::string("storage"), args) && !embed_index::parse_storage(args.at("storage"), type)) {
+        std::cerr << "unknown storage " << args.at("storage") << std::endl;
+        exit(1);
+    }
+
+    std::vector<seg_t> basis;
+    std::ifstream basis_batch { args.at("basis-batch") };
+
+    while (1) {
+        seg_t frames = speech::load_frame_batch(basis_batch);
+
+        if (!basis_batch) {
+            break;
+        }
+
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
+        basis.push_back(frames);
+    }
+
+    basis_batch.close();
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    par_embed::basis_chunks basis_chunks;
+    la::tensor<double> basis_tensor;
+
+    if (mode == "dtw") {
+        basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+    } else {
+        basis_tensor = embed::to_tensor(basis);
+    }
+
+    text_batch::file frame_batch;
+    frame_batch.open(args.at("frame-batch"), pool);
+
+    int nseg = frame_batch.size();
+
+    // conv embeddings have one entry per basis frame column, so the
+    // dimension is only known after the first segment
+    int dim = -1;
+
+    embed_index::writer writer;
+
+    int batch_size = 4 * pool.size();
+
+    for (int n = 0; n < nseg; n += batch_size) {
+        std::vector<seg_t> segs;
+        std::vector<std::string> ids;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            int end = std::min<int>(n + batch_size, nseg);
+
+            segs.resize(end - n);
+
+            for (int m = n; m < end; ++m) {
+                ids.push_back(frame_batch.name(m));
+            }
+
+            pool.parallel_for(end - n, [&](int i) {
+                segs[i] = frame_batch.load(n + i);
+            });
+        }
+
+        profile::count("segments", segs.size());
+
+        std::vector<la::vector<double>> seg_embeds;
+
+        {
+            profile::scope prof { "embed" };
+
+            if (mode == "dtw") {
+                seg_embeds = par_embed::dtw_embed(segs, basis_chunks, pool);
+            } else {
+                seg_embeds = par_embed::conv_embed(segs, basis_tensor, pool);
+            }
+        }
+
+        if (dim == -1) {
+            dim = seg_embeds.front().size();
+            writer.open(args.at("output"), nseg, dim, type);
+        }
+
+        profile::scope prof { "write" };
+
+        for (int i = 0; i < seg_embeds.size(); ++i) {
+            writer.write(seg_embeds[i], ids[i]);
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cerr << "segments: " << n + segs.size() << "\r";
+        }
+    }
+
+    if (dim == -1) {
+        std::cerr << "no segments in " << args.at("frame-batch") << std::endl;
+        exit(1);
+    }
+
+    writer.close();
+
+    if (output::enabled(output::summary)) {
+        std::cout << "segments: " << nseg << '\n';
+        std::cout << "dim: " << dim << '\n';
+    }
+
+    return 0;
+}
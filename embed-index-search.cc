@@ -0,0 +1,159 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "par-embed.h"
+#include "embed-index.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "embed-index-search",
+        "Find the segments nearest to each target in an embedding index",
+        {
+            {"index", "", true},
+            {"basis-batch", "", true},
+            {"mode", "dtw or conv, as the index was built", true},
+            {"target", "", true},
+            {"top", "", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
+    std::string mode = args.at("mode");
+
+    if (mode != "dtw" && mode != "conv") {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    int topn = 10;
+    if (ebt::in(std::string("top"), args)) {
+        topn = std::stoi(args.at("top"));
+    }
+
+    std::vector<seg_t> basis;
+    std::ifstream basis_batch { args.at("basis-batch") };
+
+    while (1) {
+        seg_t frames = speech::load_frame_batch(basis_batch);
+
+        if (!basis_batch) {
+            break;
+        }
+
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
+        basis.push_back(frames);
+    }
+
+    basis_batch.close();
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    par_embed::basis_chunks basis_chunks;
+    la::tensor<double> basis_tensor;
+
+    if (mode == "dtw") {
+        basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+    } else {
+        basis_tensor = embed::to_tensor(basis);
+    }
+
+    embed_index::index idx;
+    idx.open(args.at("index"));
+
+    std::ifstream target_batch { args.at("target") };
+
+    int ntarget = 0;
+
+    while (1) {
+        seg_t target;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+            target = speech::load_frame_batch(target_batch);
+        }
+
+        if (!target_batch) {
+            break;
+        }
+
+        la::vector<double> q;
+
+        {
+            profile::scope prof { "embed" };
+
+            if (mode == "dtw") {
+                q = par_embed::dtw_embed(target, basis_chunks, pool);
+            } else {
+                q = par_embed::conv_embed(std::vector<seg_t> { target }, basis_tensor, pool).front();
+            }
+        }
+
+        if (q.size() != idx.dim) {
+            std::cerr << "target embedding has dimension " << q.size()
+                << ", the index has " << idx.dim << std::endl;
+            exit(1);
+        }
+
+        la::imul(q, 1.0 / la::norm(q));
+
+        std::vector<std::pair<double, int>> hits;
+
+        {
+            profile::scope prof { "search" };
+            hits = embed_index::search(idx, q, topn, pool);
+        }
+
+        if (output::enabled(output::results)) {
+            std::cout << "target: " << ntarget << '\n';
+
+            for (int r = 0; r < hits.size(); ++r) {
+                std::cout << r << " " << idx.ids[hits[r].second] << " " << hits[r].first << '\n';
+            }
+
+            std::cout << '\n';
+        }
+
+        if (result.is_open()) {
+            for (auto& h: hits) {
+                result.write(ntarget, h.second, h.first);
+            }
+        }
+
+        ++ntarget;
+    }
+
+    return 0;
+}
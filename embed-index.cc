@@ -0,0 +1,433 @@
+#include "embed-index.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace embed_index {
+
+    static char const index_magic[4] = { 'E', 'M', 'B', 'I' };
+
+    struct index_header {
+        char magic[4];
+        int n;
+        int dim;
+        int type;
+    };
+
+    static size_t elem_size(storage type)
+    {
+        switch (type) {
+        case storage::f64: return 8;
+        case storage::f32: return 4;
+        case storage::f16: return 2;
+        default: return 1;
+        }
+    }
+
+    // rows are padded so the i8 scales that follow stay aligned
+    static size_t data_bytes(int n, int dim, storage type)
+    {
+        size_t bytes = (size_t) n * dim * elem_size(type);
+        return (bytes + 7) / 8 * 8;
+    }
+
+    bool parse_storage(std::string const& name, storage& s)
+    {
+        if (name == "f64") {
+            s = storage::f64;
+        } else if (name == "f32") {
+            s = storage::f32;
+        } else if (name == "f16") {
+            s = storage::f16;
+        } else if (name == "i8") {
+            s = storage::i8;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    uint16_t to_half(float f)
+    {
+        uint32_t x;
+        std::memcpy(&x, &f, sizeof(x));
+
+        uint16_t sign = (x >> 16) & 0x8000;
+        int exp = int((x >> 23) & 0xff) - 127 + 15;
+        uint32_t mant = x & 0x7fffff;
+
+        // NaN stays NaN (quiet) rather than turning into inf
+        if (((x >> 23) & 0xff) == 0xff && mant != 0) {
+            return sign | 0x7e00;
+        }
+
+        if (exp >= 31) {
+            return sign | 0x7c00;
+        }
+
+        if (exp <= 0) {
+            if (exp < -10) {
+                return sign;
+            }
+
+            // subnormal, with the implicit bit made explicit
+            mant |= 0x800000;
+            int shift = 14 - exp;
+            uint16_t h = mant >> shift;
+
+            if ((mant >> (shift - 1)) & 1) {
+                ++h;
+            }
+
+            return sign | h;
+        }
+
+        uint16_t h = sign | (exp << 10) | (mant >> 13);
+
+        // round to nearest; a carry into the exponent is still correct
+        if (mant & 0x1000) {
+            ++h;
+        }
+
+        return h;
+    }
+
+    static float decode_half(uint16_t h)
+    {
+        uint32_t sign = uint32_t(h & 0x8000) << 16;
+        int exp = (h >> 10) & 0x1f;
+        uint32_t mant = h & 0x3ff;
+
+        uint32_t x;
+
+        if (exp == 0) {
+            if (mant == 0) {
+                x = sign;
+            } else {
+                exp = 1;
+                while ((mant & 0x400) == 0) {
+                    mant <<= 1;
+                    --exp;
+                }
+                mant &= 0x3ff;
+                x = sign | uint32_t(exp - 15 + 127) << 23 | mant << 13;
+            }
+        } else if (exp == 31) {
+            x = sign | 0x7f800000 | mant << 13;
+        } else {
+            x = sign | uint32_t(exp - 15 + 127) << 23 | mant << 13;
+        }
+
+        float f;
+        std::memcpy(&f, &x, sizeof(f));
+
+        return f;
+    }
+
+    static std::vector<float> const& half_table()
+    {
+        static std::vector<float> table = []() {
+            std::vector<float> t;
+            t.resize(1 << 16);
+
+            for (int i = 0; i < (1 << 16); ++i) {
+                t[i] = decode_half(i);
+            }
+
+            return t;
+        }();
+
+        return table;
+    }
+
+    float from_half(uint16_t h)
+    {
+        return half_table()[h];
+    }
+
+    index::index()
+        : n(0), dim(0), type(storage::f64), base(nullptr), length(0), data(nullptr), scale(nullptr)
+    {}
+
+    index::~index()
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    void index::open(std::string const& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+
+        if (length < sizeof(index_header)) {
+            ::close(fd);
+            length = 0;
+            throw std::runtime_error(filename + " is not an embedding index");
+        }
+
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            throw std::runtime_error("failed to map " + filename);
+        }
+
+        index_header const& h = *static_cast<index_header const*>(base);
+
+        if (std::memcmp(h.magic, index_magic, sizeof(index_magic)) != 0) {
+            throw std::runtime_error(filename + " is not an embedding index");
+        }
+
+        if (h.n < 0 || h.dim < 0 || h.type < int(storage::f64) || h.type > int(storage::i8)) {
+            throw std::runtime_error(filename + " has a corrupt header");
+        }
+
+        n = h.n;
+        dim = h.dim;
+        type = storage(h.type);
+
+        size_t expected = sizeof(index_header) + data_bytes(n, dim, type)
+            + (type == storage::i8 ? (size_t) n * sizeof(float) : 0);
+
+        if (length != expected) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        char const *p = static_cast<char const*>(base) + sizeof(index_header);
+        data = p;
+        scale = reinterpret_cast<float const*>(p + data_bytes(n, dim, type));
+
+        if (type == storage::f16) {
+            half_table();
+        }
+
+        ids.clear();
+
+        std::ifstream ids_ifs { filename + ".ids" };
+        std::string line;
+
+        while (std::getline(ids_ifs, line)) {
+            ids.push_back(line);
+        }
+
+        if (ids.size() != n) {
+            throw std::runtime_error(filename + ".ids does not match the index");
+        }
+    }
+
+    double index::dot(int i, double const *q) const
+    {
+        double s = 0;
+
+        switch (type) {
+        case storage::f64:
+            {
+                double const *r = static_cast<double const*>(data) + (size_t) i * dim;
+                for (int d = 0; d < dim; ++d) {
+                    s += r[d] * q[d];
+                }
+            }
+            break;
+        case storage::f32:
+            {
+                float const *r = static_cast<float const*>(data) + (size_t) i * dim;
+                for (int d = 0; d < dim; ++d) {
+                    s += r[d] * q[d];
+                }
+            }
+            break;
+        case storage::f16:
+            {
+                float const *table = half_table().data();
+                uint16_t const *r = static_cast<uint16_t const*>(data) + (size_t) i * dim;
+                for (int d = 0; d < dim; ++d) {
+                    s += table[r[d]] * q[d];
+                }
+            }
+            break;
+        case storage::i8:
+            {
+                int8_t const *r = static_cast<int8_t const*>(data) + (size_t) i * dim;
+                for (int d = 0; d < dim; ++d) {
+                    s += r[d] * q[d];
+                }
+                s *= scale[i];
+            }
+            break;
+        }
+
+        return s;
+    }
+
+    void index::row(int i, la::vector<double>& v) const
+    {
+        v.resize(dim);
+
+        for (int d = 0; d < dim; ++d) {
+            switch (type) {
+            case storage::f64:
+                v(d) = static_cast<double const*>(data)[(size_t) i * dim + d];
+                break;
+            case storage::f32:
+                v(d) = static_cast<float const*>(data)[(size_t) i * dim + d];
+                break;
+            case storage::f16:
+                v(d) = from_half(static_cast<uint16_t const*>(data)[(size_t) i * dim + d]);
+                break;
+            case storage::i8:
+                v(d) = static_cast<int8_t const*>(data)[(size_t) i * dim + d] * scale[i];
+                break;
+            }
+        }
+    }
+
+    writer::writer()
+        : n(0), dim(0), type(storage::f64), written(0)
+    {}
+
+    void writer::open(std::string const& filename, int n, int dim, storage type)
+    {
+        this->filename = filename;
+        this->n = n;
+        this->dim = dim;
+        this->type = type;
+        written = 0;
+
+        buf.resize(1 << 20);
+        ofs.rdbuf()->pubsetbuf(buf.data(), buf.size());
+
+        ofs.open(filename + ".tmp", std::ios::binary);
+        ids_ofs.open(filename + ".ids.tmp");
+
+        if (!ofs || !ids_ofs) {
+            throw std::runtime_error("failed to open " + filename + ".tmp");
+        }
+
+        index_header h;
+        std::memcpy(h.magic, index_magic, sizeof(index_magic));
+        h.n = n;
+        h.dim = dim;
+        h.type = int(type);
+
+        ofs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+    }
+
+    void writer::write(la::vector<double> v, std::string const& id)
+    {
+        if (v.size() != dim) {
+            throw std::runtime_error("embedding of " + id + " has the wrong dimension");
+        }
+
+        double norm = la::norm(v);
+
+        if (norm > 0) {
+            la::imul(v, 1.0 / norm);
+        }
+
+        switch (type) {
+        case storage::f64:
+            ofs.write(reinterpret_cast<char const*>(v.data()), dim * sizeof(double));
+            break;
+        case storage::f32:
+            for (int d = 0; d < dim; ++d) {
+                float f = v(d);
+                ofs.write(reinterpret_cast<char const*>(&f), sizeof(f));
+            }
+            break;
+        case storage::f16:
+            for (int d = 0; d < dim; ++d) {
+                uint16_t h = to_half(v(d));
+                ofs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+            }
+            break;
+        case storage::i8:
+            {
+                double max = 0;
+                for (int d = 0; d < dim; ++d) {
+                    max = std::max(max, std::fabs(v(d)));
+                }
+
+                float s = (max == 0 ? 1 : max / 127);
+                scale.push_back(s);
+
+                for (int d = 0; d < dim; ++d) {
+                    int8_t c = std::lround(v(d) / s);
+                    ofs.put(c);
+                }
+            }
+            break;
+        }
+
+        ids_ofs << id << '\n';
+
+        ++written;
+    }
+
+    void writer::close()
+    {
+        if (written != n) {
+            throw std::runtime_error(filename + ": expected " + std::to_string(n)
+                + " rows, got " + std::to_string(written));
+        }
+
+        size_t pad = data_bytes(n, dim, type) - (size_t) n * dim * elem_size(type);
+
+        for (int i = 0; i < pad; ++i) {
+            ofs.put(0);
+        }
+
+        if (type == storage::i8) {
+            ofs.write(reinterpret_cast<char const*>(scale.data()), scale.size() * sizeof(float));
+        }
+
+        ofs.close();
+        ids_ofs.close();
+
+        // both files are complete before either replaces the old pair
+        if (!ofs || !ids_ofs) {
+            std::remove((filename + ".tmp").c_str());
+            std::remove((filename + ".ids.tmp").c_str());
+            throw std::runtime_error("failed to write " + filename);
+        }
+
+        if (std::rename((filename + ".ids.tmp").c_str(), (filename + ".ids").c_str()) != 0
+                || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to rename " + filename + ".tmp");
+        }
+    }
+
+    std::vector<std::pair<double, int>> search(index const& idx,
+        la::vector<double> const& q, int topn, thread_pool::pool& pool)
+    {
+        double qnorm2 = la::dot(q, q);
+
+        // rows are unit length, so the squared distance is qnorm2 + 1 - 2 dot
+        std::vector<std::pair<double, int>> hits = top_n(idx.n, topn, [&](int i) {
+            return qnorm2 + 1 - 2 * idx.dot(i, q.data());
+        }, pool);
+
+        for (auto& h: hits) {
+            h.first = std::sqrt(std::max(0.0, h.first));
+        }
+
+        return hits;
+    }
+
+}
@@ -0,0 +1,154 @@
+#ifndef EMBED_INDEX_H
+#define EMBED_INDEX_H
+
+#include "la/la.h"
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace embed_index {
+
+    enum class storage {
+        f64 = 0,
+        f32 = 1,
+        f16 = 2,
+        i8 = 3
+    };
+
+    bool parse_storage(std::string const& name, storage& s);
+
+    /*
+     * n L2-normalized embeddings of dimension dim, one row each, mapped
+     * read-only.  i8 rows are scaled by max |x| / 127; the scales follow
+     * the rows.  Segment names are in filename.ids, one per line, in row
+     * order.
+     */
+    struct index {
+
+        index();
+        ~index();
+
+        index(index const&) = delete;
+        index& operator=(index const&) = delete;
+
+        void open(std::string const& filename);
+
+        int n;
+        int dim;
+        storage type;
+
+        std::vector<std::string> ids;
+
+        // dot product of row i with q, decoded on the fly
+        double dot(int i, double const *q) const;
+
+        void row(int i, la::vector<double>& v) const;
+
+    private:
+        void *base;
+        size_t length;
+
+        void const *data;
+        float const *scale;
+
+    };
+
+    /*
+     * Rows are written as they come, so the collection never has to fit
+     * in memory.  n must be known up front.
+     */
+    struct writer {
+
+        writer();
+
+        void open(std::string const& filename, int n, int dim, storage type);
+
+        // normalizes v before storing it
+        void write(la::vector<double> v, std::string const& id);
+
+        // writes the i8 scales, then renames filename.tmp to filename
+        void close();
+
+    private:
+        std::string filename;
+        std::ofstream ofs;
+        std::ofstream ids_ofs;
+
+        int n;
+        int dim;
+        storage type;
+        int written;
+
+        std::vector<float> scale;
+        std::vector<char> buf;
+
+    };
+
+    /*
+     * The topn smallest dist(i) over i in [0, n), as (dist, i) pairs in
+     * increasing order.  Chunks of the range are scanned in parallel,
+     * each keeping a max-heap of its topn best.
+     */
+    template <class Dist>
+    std::vector<std::pair<double, int>> top_n(int n, int topn, Dist dist,
+        thread_pool::pool& pool)
+    {
+        int nchunk = std::max<int>(1, std::min<int>(n, 4 * pool.size()));
+
+        std::vector<std::vector<std::pair<double, int>>> heaps;
+        heaps.resize(nchunk);
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) n * c / nchunk;
+            int end = (long) n * (c + 1) / nchunk;
+
+            std::vector<std::pair<double, int>>& heap = heaps[c];
+
+            for (int i = begin; i < end; ++i) {
+                double d = dist(i);
+
+                if (heap.size() < topn) {
+                    heap.push_back(std::make_pair(d, i));
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (d < heap.front().first) {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = std::make_pair(d, i);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        });
+
+        std::vector<std::pair<double, int>> hits;
+
+        for (auto& heap: heaps) {
+            hits.insert(hits.end(), heap.begin(), heap.end());
+        }
+
+        std::sort(hits.begin(), hits.end());
+
+        if (hits.size() > topn) {
+            hits.resize(topn);
+        }
+
+        return hits;
+    }
+
+    /*
+     * The topn rows nearest to q, as (euclidean distance, row) pairs in
+     * increasing distance.  q should be normalized.
+     */
+    std::vector<std::pair<double, int>> search(index const& idx,
+        la::vector<double> const& q, int topn, thread_pool::pool& pool);
+
+    uint16_t to_half(float f);
+
+    float from_half(uint16_t h);
+
+}
+
+#endif
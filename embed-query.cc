@@ -0,0 +1,103 @@
+#include "ebt/ebt.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "output.h"
+
+/*
+ * Sends every segment in --target to an embed-server and prints the
+ * replies as they come.
+ */
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "embed-query",
+        "Query an embed-server",
+        {
+            {"socket", "", true},
+            {"target", "", true},
+            {"top", "", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    int topn = 10;
+    if (ebt::in(std::string("top"), args)) {
+        topn = std::stoi(args.at("top"));
+    }
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, args.at("socket").c_str(), sizeof(addr.sun_path) - 1);
+
+    if (::connect(sock, (sockaddr*) &addr, sizeof(addr)) == -1) {
+        std::cerr << "failed to connect to " << args.at("socket") << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    std::ifstream target { args.at("target") };
+    std::string line;
+    std::string block;
+
+    std::string reply;
+    char buf[1 << 16];
+
+    while (std::getline(target, line)) {
+        block += line;
+        block += '\n';
+
+        if (line != ".") {
+            continue;
+        }
+
+        std::string request = std::to_string(topn) + "\n" + block;
+        block.clear();
+
+        for (std::size_t sent = 0; sent < request.size(); ) {
+            ssize_t n = ::send(sock, request.data() + sent, request.size() - sent, 0);
+
+            if (n <= 0) {
+                std::cerr << "failed to send query" << std::endl;
+                exit(1);
+            }
+
+            sent += n;
+        }
+
+        // a reply ends with a line holding only "."
+        while (reply.size() < 2 || reply.compare(reply.size() - 2, 2, ".\n") != 0
+                || (reply.size() > 2 && reply[reply.size() - 3] != '\n')) {
+            ssize_t n = ::recv(sock, buf, sizeof(buf), 0);
+
+            if (n <= 0) {
+                std::cerr << "server closed the connection" << std::endl;
+                exit(1);
+            }
+
+            reply.append(buf, n);
+        }
+
+        std::cout << reply;
+        reply.clear();
+    }
+
+    ::close(sock);
+
+    return 0;
+}
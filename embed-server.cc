@@ -0,0 +1,548 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "nn/tensor-tree.h"
+#include "lstm-embed.h"
+#include "thread-pool.h"
+#include "text-batch.h"
+#include "par-embed.h"
+#include "kmeans.h"
+#include "embed-index.h"
+#include "profile.h"
+#include "output.h"
+
+/*
+ * Query-by-example over a Unix domain socket.  The basis (or the LSTM
+ * parameters) and the embeddings of every segment in --frame-batch are
+ * computed once at startup, or mapped from an embed-index-build --index.
+ * A client sends
+ *
+ *     <top n>
+ *     <a frame batch block: name line, one frame per line, ".">
+ *
+ * and gets back one "<rank> <segment name> <dist>" line per hit, a
+ * "cluster: <id> <dist>" line when --centers is given, and ".".  Errors,
+ * including a malformed block or frames of the wrong dimension, come
+ * back as "error: <message>" followed by ".".  A connection can send
+ * any number of queries.  Up to --max-connections connections (default
+ * 64) are served concurrently; beyond that a client gets an error and
+ * is closed.
+ */
+
+using seg_t = std::vector<std::vector<double>>;
+
+struct server_env {
+
+    std::string mode;
+
+    par_embed::basis_chunks basis_chunks;
+    la::tensor<double> basis_tensor;
+
+    // frame dimension of the basis; 0 in lstm mode
+    int frame_dim;
+
+    int layer;
+    std::shared_ptr<tensor_tree::vertex> param;
+
+    // row-major, one embedding per segment, and the squared norm of each
+    int nseg;
+    int dim;
+    std::vector<double> embeds;
+    std::vector<double> norm2;
+
+    std::vector<std::string> ids;
+
+    bool has_index;
+    embed_index::index idx;
+
+    bool has_centers;
+    kmeans::center_file centers;
+
+    thread_pool::pool& pool;
+
+    int max_connections;
+    std::atomic<int> connections;
+
+    std::unordered_map<std::string, std::string> args;
+
+    server_env(std::unordered_map<std::string, std::string> const& args);
+
+    void load_collection();
+
+    la::vector<double> embed_seg(seg_t const& seg) const;
+
+    std::vector<std::pair<double, int>> search(la::vector<double> const& q, int topn) const;
+
+    // the reply to one query; throws on a bad query
+    std::string answer(std::string const& block, int topn) const;
+
+    void serve(int fd) const;
+
+    void run();
+
+};
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "embed-server",
+        "Answer query-by-example requests on a Unix socket",
+        {
+            {"socket", "", true},
+            {"mode", "dtw, conv or lstm", true},
+            {"frame-batch", "", false},
+            {"index", "", false},
+            {"basis-batch", "", false},
+            {"param", "", false},
+            {"centers", "", false},
+            {"max-connections", "default 64", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    server_env env { args };
+
+    env.run();
+
+    return 0;
+}
+
+server_env::server_env(std::unordered_map<std::string, std::string> const& args)
+    : frame_dim(0), has_index(false), has_centers(false), pool(thread_pool::global())
+    , max_connections(64), connections(0), args(args)
+{
+    mode = args.at("mode");
+
+    if (ebt::in(std::string("max-connections"), args)) {
+        max_connections = std::stoi(args.at("max-connections"));
+    }
+
+    if (mode == "dtw" || mode == "conv") {
+        if (!ebt::in(std::string("basis-batch"), args)) {
+            std::cerr << "--mode " << mode << " requires --basis-batch" << std::endl;
+            exit(1);
+        }
+
+        std::vector<seg_t> basis;
+        std::ifstream basis_batch { args.at("basis-batch") };
+
+        while (1) {
+            seg_t frames = speech::load_frame_batch(basis_batch);
+
+            if (!basis_batch) {
+                break;
+            }
+
+            if (frames.size() == 0) {
+                std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+                exit(1);
+            }
+
+            basis.push_back(frames);
+        }
+
+        if (basis.size() == 0 || basis.front().size() == 0) {
+            std::cerr << "empty basis " << args.at("basis-batch") << std::endl;
+            exit(1);
+        }
+
+        frame_dim = basis.front().front().size();
+
+        if (mode == "dtw") {
+            basis_chunks = par_embed::make_chunks(basis, 4 * pool.size());
+        } else {
+            basis_tensor = embed::to_tensor(basis);
+        }
+    } else if (mode == "lstm") {
+        if (!ebt::in(std::string("param"), args)) {
+            std::cerr << "--mode lstm requires --param" << std::endl;
+            exit(1);
+        }
+
+        std::string line;
+        std::ifstream param_ifs { args.at("param") };
+        std::getline(param_ifs, line);
+        layer = std::stoi(line);
+        param = lstm_embed::make_tensor_tree(layer);
+        tensor_tree::load_tensor(param, param_ifs);
+    } else {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    if (ebt::in(std::string("index"), args)) {
+        if (mode == "lstm") {
+            std::cerr << "--index needs --mode dtw or conv" << std::endl;
+            exit(1);
+        }
+
+        idx.open(args.at("index"));
+        has_index = true;
+
+        nseg = idx.n;
+        dim = idx.dim;
+        ids = idx.ids;
+    } else if (ebt::in(std::string("frame-batch"), args)) {
+        load_collection();
+    } else {
+        std::cerr << "--frame-batch or --index is required" << std::endl;
+        exit(1);
+    }
+
+    if (ebt::in(std::string("centers"), args)) {
+        centers.open(args.at("centers"));
+        has_centers = true;
+
+        if (centers.dim != dim) {
+            std::cerr << "centers have dimension " << centers.dim
+                << ", embeddings have " << dim << std::endl;
+            exit(1);
+        }
+    }
+
+    if (output::enabled(output::summary)) {
+        std::cout << "segments: " << nseg << '\n';
+        std::cout << "dim: " << dim << '\n';
+    }
+}
+
+void server_env::load_collection()
+{
+    text_batch::file frame_batch;
+    std::vector<seg_t> segs;
+
+    {
+        profile::scope prof { "load_frame_batch" };
+
+        frame_batch.open(args.at("frame-batch"), pool);
+        segs = frame_batch.load_all(pool);
+    }
+
+    for (int i = 0; i < frame_batch.size(); ++i) {
+        ids.push_back(frame_batch.name(i));
+    }
+
+    std::vector<la::vector<double>> seg_embeds;
+
+    {
+        profile::scope prof { "embed_collection" };
+
+        if (mode == "dtw") {
+            seg_embeds = par_embed::dtw_embed(segs, basis_chunks, pool);
+        } else {
+            seg_embeds.resize(segs.size());
+
+            pool.parallel_for(segs.size(), [&](int i) {
+                seg_embeds[i] = embed_seg(segs[i]);
+            });
+        }
+    }
+
+    nseg = seg_embeds.size();
+    dim = (nseg == 0 ? 0 : seg_embeds.front().size());
+
+    embeds.resize((long) nseg * dim);
+    norm2.resize(nseg);
+
+    for (int i = 0; i < nseg; ++i) {
+        if (mode != "lstm") {
+            la::imul(seg_embeds[i], 1.0 / la::norm(seg_embeds[i]));
+        }
+
+        std::copy(seg_embeds[i].data(), seg_embeds[i].data() + dim, embeds.data() + (long) i * dim);
+        norm2[i] = la::dot(seg_embeds[i], seg_embeds[i]);
+    }
+}
+
+la::vector<double> server_env::embed_seg(seg_t const& seg) const
+{
+    if (mode == "dtw") {
+        return par_embed::dtw_embed(seg, basis_chunks, pool);
+    } else if (mode == "conv") {
+        la::tensor<double> seg_tensor = embed::to_tensor(seg);
+        return embed::conv_embed(seg_tensor, basis_tensor).as_vector();
+    } else {
+        // each query gets its own graph; param is only read
+        autodiff::computation_graph comp_graph;
+        std::shared_ptr<tensor_tree::vertex> var_tree = tensor_tree::make_var_tree(comp_graph, param);
+
+        auto seg_op = lstm_embed::to_op(seg, comp_graph);
+        auto e = lstm_embed::embed(seg_op, layer, var_tree);
+
+        la::tensor<double> t { autodiff::get_output<la::tensor_like<double>>(e) };
+
+        return t.as_vector();
+    }
+}
+
+std::vector<std::pair<double, int>> server_env::search(
+    la::vector<double> const& q, int topn) const
+{
+    if (has_index) {
+        return embed_index::search(idx, q, topn, pool);
+    }
+
+    double qnorm2 = la::dot(q, q);
+
+    std::vector<std::pair<double, int>> hits = embed_index::top_n(nseg, topn, [&](int i) {
+        double const *e = embeds.data() + (long) i * dim;
+
+        double s = 0;
+        for (int d = 0; d < dim; ++d) {
+            s += q(d) * e[d];
+        }
+
+        return qnorm2 + norm2[i] - 2 * s;
+    }, pool);
+
+    for (auto& h: hits) {
+        h.first = std::sqrt(std::max(0.0, h.first));
+    }
+
+    return hits;
+}
+
+namespace {
+
+    struct connection {
+        int fd;
+        std::string buf;
+        std::size_t pos;
+
+        bool read_line(std::string& line)
+        {
+            while (1) {
+                std::size_t nl = buf.find('\n', pos);
+
+                if (nl != std::string::npos) {
+                    line = buf.substr(pos, nl - pos);
+                    pos = nl + 1;
+                    return true;
+                }
+
+                buf.erase(0, pos);
+                pos = 0;
+
+                char tmp[1 << 16];
+                ssize_t n = ::recv(fd, tmp, sizeof(tmp), 0);
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                buf.append(tmp, n);
+            }
+        }
+
+        bool write(std::string const& s)
+        {
+            std::size_t sent = 0;
+
+            while (sent < s.size()) {
+                ssize_t n = ::send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                sent += n;
+            }
+
+            return true;
+        }
+    };
+
+}
+
+void server_env::serve(int fd) const
+{
+    connection conn { fd, "", 0 };
+
+    std::string line;
+
+    while (conn.read_line(line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        int topn = std::atoi(line.c_str());
+
+        std::string block;
+
+        while (conn.read_line(line)) {
+            block += line;
+            block += '\n';
+
+            if (line == ".") {
+                break;
+            }
+        }
+
+        if (line != ".") {
+            break;
+        }
+
+        std::string reply;
+
+        // a bad query gets an error reply; it must not take the server down
+        try {
+            reply = answer(block, topn);
+        } catch (std::exception const& e) {
+            reply = std::string("error: ") + e.what() + "\n.\n";
+        }
+
+        if (!conn.write(reply)) {
+            break;
+        }
+    }
+
+    ::close(fd);
+}
+
+std::string server_env::answer(std::string const& block, int topn) const
+{
+    std::istringstream block_stream { block };
+
+    std::string name;
+    seg_t seg;
+    text_batch::read(block_stream, name, seg);
+
+    if (topn <= 0 || seg.size() == 0) {
+        throw std::runtime_error("expecting a positive top n and a non-empty segment");
+    }
+
+    for (auto& f: seg) {
+        if (f.size() != seg.front().size() || (frame_dim != 0 && f.size() != frame_dim)) {
+            throw std::runtime_error("frames have dimension " + std::to_string(f.size())
+                + ", expecting " + std::to_string(frame_dim != 0 ? frame_dim : seg.front().size()));
+        }
+    }
+
+    profile::count("queries");
+
+    la::vector<double> q;
+
+    {
+        profile::scope prof { "query_embed" };
+        q = embed_seg(seg);
+    }
+
+    if (q.size() != dim) {
+        throw std::runtime_error("embedding has dimension " + std::to_string(q.size())
+            + ", expecting " + std::to_string(dim));
+    }
+
+    if (mode != "lstm") {
+        la::imul(q, 1.0 / la::norm(q));
+    }
+
+    std::vector<std::pair<double, int>> hits;
+
+    {
+        profile::scope prof { "query_search" };
+        hits = search(q, topn);
+    }
+
+    std::ostringstream reply;
+
+    for (int r = 0; r < hits.size(); ++r) {
+        reply << r << " " << ids.at(hits[r].second) << " " << hits[r].first << "\n";
+    }
+
+    if (has_centers) {
+        double dist;
+        int id = kmeans::nearest(centers, q, dist);
+        reply << "cluster: " << id << " " << dist << "\n";
+    }
+
+    reply << ".\n";
+
+    return reply.str();
+}
+
+void server_env::run()
+{
+    std::string path = args.at("socket");
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << path << std::endl;
+        exit(1);
+    }
+
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    ::unlink(path.c_str());
+
+    if (::bind(sock, (sockaddr*) &addr, sizeof(addr)) == -1 || ::listen(sock, 64) == -1) {
+        std::cerr << "failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    if (output::enabled(output::summary)) {
+        std::cout << "listening on " << path << std::endl;
+    }
+
+    while (1) {
+        int fd = ::accept(sock, nullptr, nullptr);
+
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        if (connections.fetch_add(1) >= max_connections) {
+            connections.fetch_sub(1);
+
+            connection conn { fd, "", 0 };
+            conn.write("error: too many connections\n.\n");
+            ::close(fd);
+
+            continue;
+        }
+
+        std::thread { [this, fd]() {
+            serve(fd);
+            connections.fetch_sub(1);
+        } }.detach();
+    }
+
+    ::close(sock);
+    ::unlink(path.c_str());
+}
+
@@ -0,0 +1,220 @@
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include "text-batch.h"
+#include "frame-store.h"
+#include "thread-pool.h"
+#include "profile.h"
+#include "output.h"
+
+namespace {
+
+    // round-trip error of one chunk of utterances
+    struct error_stat {
+        std::vector<double> max_err;
+        std::vector<double> sq_err;
+        double sq_value;
+        long nframes;
+        double decode_sec;
+    };
+
+}
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "frame-pack",
+        "Pack a text frame batch into a compressed frame store",
+        {
+            {"frame-batch", "", true},
+            {"output", "", true},
+            {"codec", "f32, f16, q16 (default) or q8", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    frame_store::codec type = frame_store::codec::q16;
+
+    if (ebt::in(std::string("codec"), args) && !frame_store::parse_codec(args.at("codec"), type)) {
+        std::cerr << "unknown codec " << args.at("codec") << std::endl;
+        exit(1);
+    }
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    text_batch::file frame_batch;
+
+    {
+        profile::scope prof { "scan" };
+        frame_batch.open(args.at("frame-batch"), pool);
+    }
+
+    int nutt = frame_batch.size();
+
+    int dim = 0;
+
+    for (int u = 0; u < nutt && dim == 0; ++u) {
+        std::vector<double> data;
+        int nframes;
+        frame_batch.load_flat(u, data, nframes, dim);
+    }
+
+    if (dim == 0) {
+        std::cerr << "no frames in " << args.at("frame-batch") << std::endl;
+        exit(1);
+    }
+
+    frame_store::writer writer;
+    writer.open(args.at("output"), dim, type);
+
+    int wave_size = 64 * pool.size();
+    int nchunk_max = 4 * pool.size();
+
+    std::vector<error_stat> stats;
+    stats.resize(nchunk_max);
+
+    for (auto& s: stats) {
+        s.max_err.assign(dim, 0);
+        s.sq_err.assign(dim, 0);
+        s.sq_value = 0;
+        s.nframes = 0;
+        s.decode_sec = 0;
+    }
+
+    long packed_bytes = 0;
+
+    // utterances go in waves; each wave is parsed, encoded and decoded
+    // again in parallel, then written in order
+    for (int w = 0; w < nutt; w += wave_size) {
+        int nwave = std::min(wave_size, nutt - w);
+        int nchunk = std::max(1, std::min(nwave, nchunk_max));
+
+        std::vector<std::string> blocks;
+        blocks.resize(nwave);
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) nwave * c / nchunk;
+            int end = (long) nwave * (c + 1) / nchunk;
+
+            error_stat& s = stats[c];
+
+            std::vector<double> decoded;
+
+            for (int k = begin; k < end; ++k) {
+                frame_store::seg_t frames;
+
+                {
+                    profile::scope prof { "load_frame_batch" };
+                    frames = frame_batch.load(w + k);
+                }
+
+                {
+                    profile::scope prof { "encode" };
+                    frame_store::encode(frames, dim, type, blocks[k]);
+                }
+
+                auto t0 = std::chrono::steady_clock::now();
+
+                int nframes;
+                frame_store::decode(blocks[k].data(), blocks[k].data() + blocks[k].size(), dim, type,
+                    decoded, nframes);
+
+                s.decode_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+                for (int t = 0; t < nframes; ++t) {
+                    for (int d = 0; d < dim; ++d) {
+                        double x = frames[t][d];
+                        double e = std::fabs(decoded[(size_t) t * dim + d] - x);
+
+                        s.max_err[d] = std::max(s.max_err[d], e);
+                        s.sq_err[d] += e * e;
+                        s.sq_value += x * x;
+                    }
+                }
+
+                s.nframes += nframes;
+            }
+        });
+
+        profile::scope prof { "write" };
+
+        for (int k = 0; k < nwave; ++k) {
+            writer.write(blocks[k], frame_batch.name(w + k));
+            packed_bytes += blocks[k].size();
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cerr << "utterances: " << w + nwave << "\r";
+        }
+    }
+
+    writer.close();
+
+    error_stat total = stats.front();
+
+    for (int c = 1; c < stats.size(); ++c) {
+        for (int d = 0; d < dim; ++d) {
+            total.max_err[d] = std::max(total.max_err[d], stats[c].max_err[d]);
+            total.sq_err[d] += stats[c].sq_err[d];
+        }
+
+        total.sq_value += stats[c].sq_value;
+        total.nframes += stats[c].nframes;
+        total.decode_sec += stats[c].decode_sec;
+    }
+
+    profile::count("frames", total.nframes);
+
+    double max_err = *std::max_element(total.max_err.begin(), total.max_err.end());
+    double sq_err = 0;
+    for (auto e: total.sq_err) {
+        sq_err += e;
+    }
+
+    long nvalue = total.nframes * dim;
+
+    if (output::enabled(output::summary)) {
+        std::cout << "utterances: " << nutt << '\n';
+        std::cout << "frames: " << total.nframes << '\n';
+        std::cout << "dim: " << dim << '\n';
+        std::cout << "packed bytes: " << packed_bytes << '\n';
+        std::cout << "bits per value: " << (nvalue == 0 ? 0 : 8.0 * packed_bytes / nvalue) << '\n';
+        std::cout << "ratio to f64: " << (packed_bytes == 0 ? 0 : 8.0 * nvalue / packed_bytes) << '\n';
+        std::cout << "max abs error: " << max_err << '\n';
+        std::cout << "rms error: " << (nvalue == 0 ? 0 : std::sqrt(sq_err / nvalue)) << '\n';
+
+        if (sq_err > 0) {
+            std::cout << "snr: " << 10 * std::log10(total.sq_value / sq_err) << " dB" << '\n';
+        }
+
+        if (total.decode_sec > 0) {
+            std::cout << "decode: " << total.nframes / total.decode_sec << " frames/s per thread" << '\n';
+        }
+    }
+
+    if (output::enabled(output::detail)) {
+        for (int d = 0; d < dim; ++d) {
+            std::cout << "dim " << d << " max " << total.max_err[d]
+                << " rms " << (total.nframes == 0 ? 0 : std::sqrt(total.sq_err[d] / total.nframes)) << '\n';
+        }
+    }
+
+    return 0;
+}
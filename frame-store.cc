@@ -0,0 +1,730 @@
+#include "frame-store.h"
+#include "embed-index.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace frame_store {
+
+    static char const store_magic[4] = { 'F', 'S', 'T', 'R' };
+
+    struct store_header {
+        char magic[4];
+        int dim;
+        int type;
+        int n;
+        int64_t table;
+    };
+
+    static int const group_size = 64;
+
+    bool parse_codec(std::string const& name, codec& c)
+    {
+        if (name == "f32") {
+            c = codec::f32;
+        } else if (name == "f16") {
+            c = codec::f16;
+        } else if (name == "q16") {
+            c = codec::q16;
+        } else if (name == "q8") {
+            c = codec::q8;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    // float bits reordered so that nearby values have nearby codes
+    static uint32_t float_code(float f)
+    {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return (u & 0x80000000) ? ~u : (u | 0x80000000);
+    }
+
+    static float code_float(uint32_t c)
+    {
+        uint32_t u = (c & 0x80000000) ? (c & 0x7fffffff) : ~c;
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    static uint32_t half_code(float f)
+    {
+        uint16_t h = embed_index::to_half(f);
+        return (h & 0x8000) ? uint16_t(~h) : uint16_t(h | 0x8000);
+    }
+
+    static float code_half(uint32_t c)
+    {
+        uint16_t h = (c & 0x8000) ? uint16_t(c & 0x7fff) : uint16_t(~c);
+        return embed_index::from_half(h);
+    }
+
+    static int levels(codec c)
+    {
+        return c == codec::q16 ? 65535 : 255;
+    }
+
+    template <class T>
+    static void put(std::string& block, T v)
+    {
+        block.append(reinterpret_cast<char const*>(&v), sizeof(T));
+    }
+
+    template <class T>
+    static T get(char const *& p)
+    {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    void encode(seg_t const& frames, int dim, codec c, std::string& block)
+    {
+        int nframes = frames.size();
+
+        block.clear();
+        put<int32_t>(block, nframes);
+
+        for (auto& f: frames) {
+            if (f.size() != dim) {
+                throw std::runtime_error("frame of dimension " + std::to_string(f.size())
+                    + " in a store of dimension " + std::to_string(dim));
+            }
+        }
+
+        std::vector<float> min;
+        std::vector<float> step;
+
+        if (c == codec::q16 || c == codec::q8) {
+            min.resize(dim);
+            step.resize(dim);
+
+            for (int d = 0; d < dim; ++d) {
+                double lo = std::numeric_limits<double>::infinity();
+                double hi = -std::numeric_limits<double>::infinity();
+
+                for (int t = 0; t < nframes; ++t) {
+                    lo = std::min(lo, frames[t][d]);
+                    hi = std::max(hi, frames[t][d]);
+                }
+
+                // codes are computed from the stored float min and step,
+                // so the decoder sees exactly what the encoder rounded to
+                min[d] = (nframes == 0 ? 0 : lo);
+                step[d] = (nframes == 0 || hi == lo ? 0 : (hi - min[d]) / levels(c));
+            }
+
+            block.append(reinterpret_cast<char const*>(min.data()), dim * sizeof(float));
+            block.append(reinterpret_cast<char const*>(step.data()), dim * sizeof(float));
+        }
+
+        std::vector<uint64_t> z;
+        z.resize(group_size);
+
+        for (int d = 0; d < dim; ++d) {
+            uint32_t prev = 0;
+
+            for (int g = 0; g < nframes; g += group_size) {
+                int len = std::min(group_size, nframes - g);
+                uint64_t any = 0;
+
+                for (int k = 0; k < len; ++k) {
+                    double x = frames[g + k][d];
+                    uint32_t code;
+
+                    switch (c) {
+                    case codec::f32:
+                        code = float_code(x);
+                        break;
+                    case codec::f16:
+                        code = half_code(x);
+                        break;
+                    default:
+                        code = (step[d] == 0 ? 0 : uint32_t(std::min<long>(levels(c),
+                            std::max<long>(0, std::lround((x - min[d]) / step[d])))));
+                        break;
+                    }
+
+                    int64_t diff = int64_t(code) - int64_t(prev);
+                    z[k] = (uint64_t(diff) << 1) ^ uint64_t(diff >> 63);
+                    any |= z[k];
+                    prev = code;
+                }
+
+                int width = 0;
+                while (width < 64 && (any >> width) != 0) {
+                    ++width;
+                }
+
+                block += char(width);
+
+                uint64_t acc = 0;
+                int bits = 0;
+
+                for (int k = 0; k < len; ++k) {
+                    acc |= z[k] << bits;
+                    bits += width;
+
+                    while (bits >= 8) {
+                        block += char(acc & 0xff);
+                        acc >>= 8;
+                        bits -= 8;
+                    }
+                }
+
+                if (bits > 0) {
+                    block += char(acc & 0xff);
+                }
+            }
+        }
+    }
+
+    char const* decode(char const *p, char const *end, int dim, codec c,
+        std::vector<double>& data, int& nframes)
+    {
+        if (end - p < (ptrdiff_t) sizeof(int32_t)) {
+            throw std::runtime_error("frame store block runs past the end");
+        }
+
+        nframes = get<int32_t>(p);
+
+        bool quantized = (c == codec::q16 || c == codec::q8);
+
+        // every group takes at least its width byte, so a count the block
+        // cannot hold is caught before the frames are allocated
+        int64_t least = (quantized ? 2 * (int64_t) dim * sizeof(float) : 0)
+            + (int64_t) dim * ((int64_t) nframes + group_size - 1) / group_size;
+
+        if (nframes < 0 || end - p < least) {
+            throw std::runtime_error("frame store block runs past the end");
+        }
+
+        data.resize((size_t) nframes * dim);
+
+        float const *min = nullptr;
+        float const *step = nullptr;
+
+        std::vector<float> params;
+
+        if (quantized) {
+            params.resize(2 * dim);
+            std::memcpy(params.data(), p, 2 * dim * sizeof(float));
+            p += 2 * dim * sizeof(float);
+
+            min = params.data();
+            step = params.data() + dim;
+        }
+
+        for (int d = 0; d < dim; ++d) {
+            uint32_t prev = 0;
+            double *out = data.data() + d;
+
+            for (int g = 0; g < nframes; g += group_size) {
+                int len = std::min(group_size, nframes - g);
+
+                if (p == end) {
+                    throw std::runtime_error("frame store block runs past the end");
+                }
+
+                int width = static_cast<unsigned char>(*p++);
+
+                if (width > 64) {
+                    throw std::runtime_error("frame store block has a group of width "
+                        + std::to_string(width));
+                }
+
+                if (end - p < ((int64_t) len * width + 7) / 8) {
+                    throw std::runtime_error("frame store block runs past the end");
+                }
+
+                uint64_t mask = (width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1);
+
+                uint64_t acc = 0;
+                int bits = 0;
+
+                for (int k = 0; k < len; ++k) {
+                    while (bits < width) {
+                        acc |= uint64_t(static_cast<unsigned char>(*p++)) << bits;
+                        bits += 8;
+                    }
+
+                    uint64_t zz = acc & mask;
+                    acc = (width == 64 ? 0 : acc >> width);
+                    bits -= width;
+
+                    int64_t diff = int64_t(zz >> 1) ^ -int64_t(zz & 1);
+                    uint32_t code = uint32_t(int64_t(prev) + diff);
+                    prev = code;
+
+                    double v;
+
+                    switch (c) {
+                    case codec::f32:
+                        v = code_float(code);
+                        break;
+                    case codec::f16:
+                        v = code_half(code);
+                        break;
+                    default:
+                        v = min[d] + double(code) * step[d];
+                        break;
+                    }
+
+                    out[(size_t) (g + k) * dim] = v;
+                }
+            }
+        }
+
+        return p;
+    }
+
+    store::store()
+        : dim(0), type(codec::f32), base(nullptr), length(0), table(0)
+    {}
+
+    store::~store()
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    void store::open(std::string const& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+
+        if (length < sizeof(store_header)) {
+            ::close(fd);
+            throw std::runtime_error(filename + " is not a frame store");
+        }
+
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            throw std::runtime_error("failed to map " + filename);
+        }
+
+        store_header const& h = *static_cast<store_header const*>(base);
+
+        if (std::memcmp(h.magic, store_magic, sizeof(store_magic)) != 0) {
+            throw std::runtime_error(filename + " is not a frame store");
+        }
+
+        if (h.dim <= 0 || h.type < int(codec::f32) || h.type > int(codec::q8)
+                || h.n < 0 || h.table < (int64_t) sizeof(store_header)
+                || h.table > (int64_t) length
+                || ((int64_t) length - h.table) / (int64_t) sizeof(int64_t) < h.n) {
+            throw std::runtime_error(filename + " has a bad header");
+        }
+
+        dim = h.dim;
+        type = codec(h.type);
+
+        // blocks lie between the header and the table
+        table = h.table;
+
+        char const *p = static_cast<char const*>(base) + h.table;
+
+        pos.resize(h.n);
+        for (int i = 0; i < h.n; ++i) {
+            int64_t offset = get<int64_t>(p);
+
+            if (offset < (int64_t) sizeof(store_header) || offset >= h.table) {
+                throw std::runtime_error(filename + " has a bad block offset for utterance "
+                    + std::to_string(i));
+            }
+
+            pos[i] = offset;
+        }
+
+        ids.clear();
+
+        std::ifstream ids_ifs { filename + ".ids" };
+        std::string line;
+
+        while (std::getline(ids_ifs, line)) {
+            ids.push_back(line);
+        }
+
+        if (ids.size() != h.n) {
+            throw std::runtime_error(filename + ".ids does not match the store");
+        }
+    }
+
+    void store::at_flat(int i, std::vector<double>& data, int& nframes) const
+    {
+        char const *blocks = static_cast<char const*>(base);
+
+        decode(blocks + pos[i], blocks + table, dim, type, data, nframes);
+    }
+
+    seg_t store::load_at(unsigned long offset) const
+    {
+        std::vector<double> data;
+        int nframes;
+
+        char const *blocks = static_cast<char const*>(base);
+
+        if (offset < sizeof(store_header) || offset >= table) {
+            throw std::runtime_error("frame store offset " + std::to_string(offset) + " is out of range");
+        }
+
+        decode(blocks + offset, blocks + table, dim, type, data, nframes);
+
+        seg_t result;
+        result.resize(nframes);
+
+        for (int t = 0; t < nframes; ++t) {
+            result[t].assign(data.begin() + (long) t * dim, data.begin() + (long) (t + 1) * dim);
+        }
+
+        return result;
+    }
+
+    seg_t store::at(int i) const
+    {
+        return load_at(pos[i]);
+    }
+
+    writer::writer()
+        : dim(0), type(codec::f32), offset(0)
+    {}
+
+    void writer::open(std::string const& filename, int dim, codec type)
+    {
+        this->filename = filename;
+        this->dim = dim;
+        this->type = type;
+        table.clear();
+
+        buf.resize(1 << 20);
+        ofs.rdbuf()->pubsetbuf(buf.data(), buf.size());
+
+        ofs.open(filename + ".tmp", std::ios::binary);
+        ids_ofs.open(filename + ".ids.tmp");
+
+        if (!ofs || !ids_ofs) {
+            throw std::runtime_error("failed to open " + filename + ".tmp");
+        }
+
+        // the header is rewritten with the count and table offset on close
+        store_header h {};
+        ofs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+
+        offset = sizeof(h);
+    }
+
+    void writer::write(std::string const& block, std::string const& id)
+    {
+        table.push_back(offset);
+
+        ofs.write(block.data(), block.size());
+        offset += block.size();
+
+        ids_ofs << id << '\n';
+    }
+
+    void writer::close()
+    {
+        // keep the table aligned
+        while (offset % 8 != 0) {
+            ofs.put(0);
+            ++offset;
+        }
+
+        ofs.write(reinterpret_cast<char const*>(table.data()), table.size() * sizeof(int64_t));
+
+        store_header h {};
+        std::memcpy(h.magic, store_magic, sizeof(store_magic));
+        h.dim = dim;
+        h.type = int(type);
+        h.n = table.size();
+        h.table = offset;
+
+        ofs.seekp(0);
+        ofs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+
+        ofs.close();
+        ids_ofs.close();
+
+        if (!ofs || !ids_ofs
+                || std::rename((filename + ".ids.tmp").c_str(), (filename + ".ids").c_str()) != 0
+                || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    bool is_store(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, sizeof(magic));
+
+        return ifs && std::memcmp(magic, store_magic, sizeof(store_magic)) == 0;
+    }
+
+    spool::spool()
+        : fd(-1), size(0)
+    {}
+
+    spool::~spool()
+    {
+        if (fd != -1) {
+            ::close(fd);
+        }
+    }
+
+    unsigned long spool::append(seg_t const& frames)
+    {
+        if (fd == -1) {
+            char const *dir = std::getenv("TMPDIR");
+            std::string name = std::string(dir == nullptr ? "/tmp" : dir) + "/spool.XXXXXX";
+
+            std::vector<char> path { name.begin(), name.end() };
+            path.push_back('\0');
+
+            fd = mkstemp(path.data());
+
+            if (fd == -1) {
+                throw std::runtime_error("failed to create " + name);
+            }
+
+            unlink(path.data());
+        }
+
+        int32_t nframes = frames.size();
+        int32_t dim = (nframes == 0 ? 0 : frames.front().size());
+
+        unsigned long offset = size + buf.size();
+
+        put(buf, nframes);
+        put(buf, dim);
+
+        for (auto& f: frames) {
+            if (f.size() != dim) {
+                throw std::runtime_error("ragged frames in a spooled record");
+            }
+
+            buf.append(reinterpret_cast<char const*>(f.data()), dim * sizeof(double));
+        }
+
+        pos.push_back(offset);
+
+        if (buf.size() >= (1 << 20)) {
+            flush();
+        }
+
+        return offset;
+    }
+
+    void spool::flush()
+    {
+        char const *p = buf.data();
+        size_t left = buf.size();
+
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+
+            if (n == -1) {
+                throw std::runtime_error("failed to write the spool");
+            }
+
+            p += n;
+            left -= n;
+        }
+
+        size += buf.size();
+        buf.clear();
+    }
+
+    static void read_fully(int fd, char *p, size_t len, unsigned long offset)
+    {
+        while (len > 0) {
+            ssize_t n = pread(fd, p, len, offset);
+
+            if (n <= 0) {
+                throw std::runtime_error("failed to read the spool");
+            }
+
+            p += n;
+            len -= n;
+            offset += n;
+        }
+    }
+
+    seg_t spool::load_at(unsigned long offset) const
+    {
+        int32_t h[2];
+        read_fully(fd, reinterpret_cast<char*>(h), sizeof(h), offset);
+
+        std::vector<double> data;
+        data.resize((size_t) h[0] * h[1]);
+        read_fully(fd, reinterpret_cast<char*>(data.data()), data.size() * sizeof(double),
+            offset + sizeof(h));
+
+        seg_t result;
+        result.resize(h[0]);
+
+        for (int t = 0; t < h[0]; ++t) {
+            result[t].assign(data.begin() + (long) t * h[1], data.begin() + (long) (t + 1) * h[1]);
+        }
+
+        return result;
+    }
+
+    void batch::open(std::string const& filename, thread_pool::pool& pool)
+    {
+        if (filename == "-") {
+            src = source::piped;
+
+            std::string name;
+            seg_t frames;
+
+            while (text_batch::read(std::cin, name, frames)) {
+                sp.append(frames);
+            }
+
+            sp.flush();
+            pos = sp.pos;
+        } else if (is_store(filename)) {
+            src = source::packed;
+            s.open(filename);
+            pos = s.pos;
+        } else {
+            src = source::text;
+            text.open(filename, pool);
+            pos.assign(text.pos.begin(), text.pos.end());
+        }
+    }
+
+    seg_t batch::at(int i) const
+    {
+        switch (src) {
+        case source::piped:
+            return sp.load_at(pos[i]);
+        case source::packed:
+            return s.load_at(pos[i]);
+        default:
+            return text.load_at(pos[i]);
+        }
+    }
+
+    stream::stream()
+        : packed(false), piped(false), rewindable(false), replay(false), index(0)
+    {}
+
+    void stream::open(std::string const& filename, bool rewindable)
+    {
+        this->filename = filename;
+        this->rewindable = rewindable;
+
+        piped = (filename == "-");
+        packed = !piped && is_store(filename);
+
+        if (packed) {
+            s.open(filename);
+        } else if (!piped) {
+            text.open(filename);
+
+            if (!text) {
+                throw std::runtime_error("failed to open " + filename);
+            }
+        }
+
+        index = 0;
+    }
+
+    bool stream::next(seg_t& frames)
+    {
+        std::string name;
+
+        return next(name, frames);
+    }
+
+    bool stream::next(std::string& name, seg_t& frames)
+    {
+        if (packed) {
+            if (index == s.pos.size()) {
+                return false;
+            }
+
+            name = s.ids[index];
+            frames = s.at(index++);
+            return true;
+        } else if (piped && replay) {
+            if (index == sp.pos.size()) {
+                return false;
+            }
+
+            name = names[index];
+            frames = sp.load_at(sp.pos[index++]);
+            return true;
+        } else if (piped) {
+            if (!text_batch::read(std::cin, name, frames)) {
+                return false;
+            }
+
+            if (rewindable) {
+                sp.append(frames);
+                names.push_back(name);
+            }
+
+            return true;
+        } else {
+            return text_batch::read(text, name, frames);
+        }
+    }
+
+    void stream::rewind()
+    {
+        index = 0;
+
+        if (piped && !rewindable) {
+            throw std::runtime_error("stdin was not opened to be rewound");
+        } else if (piped) {
+            // records the last pass did not get to are still in the pipe
+            if (!replay) {
+                std::string name;
+                seg_t frames;
+
+                while (text_batch::read(std::cin, name, frames)) {
+                    sp.append(frames);
+                    names.push_back(name);
+                }
+
+                sp.flush();
+                replay = true;
+            }
+        } else if (!packed) {
+            text.close();
+            text.clear();
+            text.open(filename);
+        }
+    }
+
+}
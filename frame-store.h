@@ -0,0 +1,200 @@
+#ifndef FRAME_STORE_H
+#define FRAME_STORE_H
+
+#include "text-batch.h"
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+namespace frame_store {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    /*
+     * f32 is lossless for float features; f16 keeps 11 significant bits;
+     * q16 and q8 quantize each dimension of an utterance uniformly
+     * between its min and max.
+     */
+    enum class codec {
+        f32 = 0,
+        f16 = 1,
+        q16 = 2,
+        q8 = 3
+    };
+
+    bool parse_codec(std::string const& name, codec& c);
+
+    /*
+     * One utterance as a block.  Values are mapped to integer codes,
+     * stored column by column, each column as differences between
+     * consecutive frames, zigzagged and bit-packed in groups of 64
+     * frames at the width of the group's largest difference.  Smooth
+     * features need a few bits per value.
+     */
+    void encode(seg_t const& frames, int dim, codec c, std::string& block);
+
+    /*
+     * Returns the position after the block.  Throws if the block would
+     * run past end.
+     */
+    char const* decode(char const *p, char const *end, int dim, codec c,
+        std::vector<double>& data, int& nframes);
+
+    /*
+     * A store of encoded utterances, mapped read-only.  pos holds the
+     * block offsets in utterance order and, like batch_indices::pos, may
+     * be shuffled or sliced; at(i) decodes the block at pos[i].
+     * Utterance names are in filename.ids, one per line.
+     */
+    struct store {
+
+        store();
+        ~store();
+
+        store(store const&) = delete;
+        store& operator=(store const&) = delete;
+
+        void open(std::string const& filename);
+
+        int dim;
+        codec type;
+
+        std::vector<unsigned long> pos;
+        std::vector<std::string> ids;
+
+        seg_t at(int i) const;
+
+        void at_flat(int i, std::vector<double>& data, int& nframes) const;
+
+        seg_t load_at(unsigned long offset) const;
+
+    private:
+        void *base;
+        size_t length;
+        size_t table;
+
+    };
+
+    struct writer {
+
+        writer();
+
+        void open(std::string const& filename, int dim, codec type);
+
+        // block as produced by encode with the same dim and codec
+        void write(std::string const& block, std::string const& id);
+
+        // writes the offset table, then renames filename.tmp to filename
+        void close();
+
+    private:
+        std::string filename;
+        std::ofstream ofs;
+        std::ofstream ids_ofs;
+
+        int dim;
+        codec type;
+        long offset;
+
+        std::vector<int64_t> table;
+        std::vector<char> buf;
+
+    };
+
+    bool is_store(std::string const& filename);
+
+    /*
+     * Records kept as raw doubles in an unlinked file under $TMPDIR, so
+     * that a pipe can be read more than once, or out of order.  Reads are
+     * safe from several threads once the appends are flushed.
+     */
+    struct spool {
+
+        spool();
+        ~spool();
+
+        spool(spool const&) = delete;
+        spool& operator=(spool const&) = delete;
+
+        // returns the offset of the record
+        unsigned long append(seg_t const& frames);
+
+        void flush();
+
+        seg_t load_at(unsigned long offset) const;
+
+        std::vector<unsigned long> pos;
+
+    private:
+        int fd;
+        unsigned long size;
+        std::string buf;
+
+    };
+
+    /*
+     * Stands in for batch_indices plus load_frame_batch in the training
+     * tools: opens a store, a text frame batch, or "-" for a text batch
+     * on stdin, which is spooled before open returns.  pos holds the
+     * record offsets and at(i) returns the frames of the record at
+     * pos[i].  at is safe to call from several threads.
+     */
+    struct batch {
+
+        void open(std::string const& filename, thread_pool::pool& pool);
+
+        std::vector<unsigned long> pos;
+
+        seg_t at(int i) const;
+
+    private:
+        enum class source { text, packed, piped };
+
+        source src;
+        store s;
+        text_batch::file text;
+        spool sp;
+
+    };
+
+    /*
+     * Records in order, for tools that make passes over their input.
+     * "-" reads stdin as it arrives, so upstream tools run concurrently.
+     * Only a rewindable stream spools each record from the pipe, and
+     * rewind then replays the spool; single-pass tools keep nothing.
+     */
+    struct stream {
+
+        stream();
+
+        void open(std::string const& filename, bool rewindable = false);
+
+        // false at the end of the pass
+        bool next(seg_t& frames);
+        bool next(std::string& name, seg_t& frames);
+
+        void rewind();
+
+    private:
+        std::string filename;
+        std::ifstream text;
+
+        bool packed;
+        store s;
+
+        bool piped;
+        bool rewindable;
+        bool replay;
+        spool sp;
+        std::vector<std::string> names;
+
+        int index;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include "frame-store.h"
+#include "thread-pool.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "frame-unpack",
+        "Write a frame store back out as a text frame batch",
+        {
+            {"store", "", true},
+            {"output", "default stdout", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    frame_store::store store;
+    store.open(args.at("store"));
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    std::ofstream output_file;
+
+    if (ebt::in(std::string("output"), args)) {
+        output_file.open(args.at("output"));
+
+        if (!output_file) {
+            std::cerr << "failed to open " << args.at("output") << std::endl;
+            exit(1);
+        }
+    }
+
+    std::ostream& out = ebt::in(std::string("output"), args) ? output_file : std::cout;
+
+    int nutt = store.pos.size();
+    int wave_size = 64 * pool.size();
+
+    long nframes_total = 0;
+
+    for (int w = 0; w < nutt; w += wave_size) {
+        int nwave = std::min(wave_size, nutt - w);
+        int nchunk = std::max(1, std::min<int>(nwave, 4 * pool.size()));
+
+        std::vector<std::string> buf;
+        buf.resize(nchunk);
+
+        std::vector<long> count;
+        count.assign(nchunk, 0);
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) nwave * c / nchunk;
+            int end = (long) nwave * (c + 1) / nchunk;
+
+            std::vector<double> data;
+            char num[32];
+
+            for (int k = begin; k < end; ++k) {
+                int nframes;
+
+                {
+                    profile::scope prof { "decode" };
+                    store.at_flat(w + k, data, nframes);
+                }
+
+                profile::scope prof { "format" };
+
+                // %.9g keeps every float exactly
+                buf[c] += store.ids[w + k];
+                buf[c] += '\n';
+
+                for (int t = 0; t < nframes; ++t) {
+                    for (int d = 0; d < store.dim; ++d) {
+                        int len = std::snprintf(num, sizeof(num), "%.9g", data[(size_t) t * store.dim + d]);
+                        buf[c].append(num, len);
+
+                        if (d != store.dim - 1) {
+                            buf[c] += ' ';
+                        }
+                    }
+
+                    buf[c] += '\n';
+                }
+
+                buf[c] += ".\n";
+                count[c] += nframes;
+            }
+        });
+
+        for (int c = 0; c < nchunk; ++c) {
+            out.write(buf[c].data(), buf[c].size());
+            nframes_total += count[c];
+        }
+    }
+
+    profile::count("frames", nframes_total);
+
+    out.flush();
+
+    return 0;
+}
@@ -0,0 +1,290 @@
+#include "hkmeans.h"
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+
+namespace hkmeans {
+
+    int tree::nleaf() const
+    {
+        int result = 0;
+
+        for (int id: leaf_id) {
+            if (id != -1) {
+                ++result;
+            }
+        }
+
+        return result;
+    }
+
+    static double dist2(la::vector<double> const& a, la::vector<double> const& b)
+    {
+        double sum = 0;
+        for (int d = 0; d < a.size(); ++d) {
+            double diff = a(d) - b(d);
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    static int closest(std::vector<la::vector<double>> const& centers,
+        la::vector<double> const& x, double& min)
+    {
+        min = std::numeric_limits<double>::infinity();
+        int argmin = -1;
+
+        for (int c = 0; c < centers.size(); ++c) {
+            double d = dist2(centers[c], x);
+
+            if (d < min) {
+                min = d;
+                argmin = c;
+            }
+        }
+
+        return argmin;
+    }
+
+    static la::vector<double> mean(std::vector<la::vector<double>> const& points,
+        std::vector<int> const& members, int dim)
+    {
+        la::vector<double> result;
+        result.resize(dim);
+
+        for (int i: members) {
+            la::iadd(result, points[i]);
+        }
+
+        if (members.size() > 0) {
+            la::imul(result, 1.0 / members.size());
+        }
+
+        return result;
+    }
+
+    static void split(tree& t, int node,
+        std::vector<la::vector<double>> const& points,
+        std::vector<int> const& members,
+        int budget, int iter,
+        std::default_random_engine& gen,
+        int& next_leaf)
+    {
+        t.center[node] = mean(points, members, t.dim);
+
+        int nchild = std::min<int>({ t.branch, budget, int(members.size()) });
+
+        if (nchild <= 1) {
+            t.leaf_id[node] = next_leaf++;
+            return;
+        }
+
+        std::vector<int> perm = members;
+        std::shuffle(perm.begin(), perm.end(), gen);
+
+        std::vector<la::vector<double>> centers;
+        for (int c = 0; c < nchild; ++c) {
+            centers.push_back(points[perm[c]]);
+        }
+
+        std::vector<std::vector<int>> groups;
+
+        for (int i = 0; i <= iter; ++i) {
+            groups.clear();
+            groups.resize(nchild);
+
+            for (int m: members) {
+                double min;
+                groups[closest(centers, points[m], min)].push_back(m);
+            }
+
+            for (int c = 0; c < nchild; ++c) {
+                if (groups[c].size() > 0) {
+                    centers[c] = mean(points, groups[c], t.dim);
+                }
+            }
+        }
+
+        groups.erase(std::remove_if(groups.begin(), groups.end(),
+            [](std::vector<int> const& g) { return g.size() == 0; }), groups.end());
+
+        if (groups.size() <= 1) {
+            t.leaf_id[node] = next_leaf++;
+            return;
+        }
+
+        // share the leaf budget in proportion to the group sizes,
+        // giving every group at least one leaf
+        std::vector<int> child_budget;
+        int assigned = 0;
+
+        for (auto& g: groups) {
+            int b = std::max<int>(1, (long) budget * g.size() / members.size());
+            child_budget.push_back(b);
+            assigned += b;
+        }
+
+        for (int c = 0; assigned < budget; c = (c + 1) % groups.size()) {
+            child_budget[c] += 1;
+            assigned += 1;
+        }
+
+        for (int c = groups.size() - 1; assigned > budget; c = (c + groups.size() - 1) % groups.size()) {
+            if (child_budget[c] > 1) {
+                child_budget[c] -= 1;
+                assigned -= 1;
+            }
+        }
+
+        for (int c = 0; c < groups.size(); ++c) {
+            int child = t.center.size();
+
+            t.center.push_back(la::vector<double>{});
+            t.children.push_back(std::vector<int>{});
+            t.leaf_id.push_back(-1);
+
+            t.children[node].push_back(child);
+
+            split(t, child, points, groups[c], child_budget[c], iter, gen, next_leaf);
+        }
+    }
+
+    tree build(std::vector<la::vector<double>> const& points,
+        int k, int branch, int iter, int seed)
+    {
+        tree t;
+        t.dim = (points.size() == 0 ? 0 : points.front().size());
+        t.branch = std::max(2, branch);
+
+        t.center.resize(1);
+        t.children.resize(1);
+        t.leaf_id.push_back(-1);
+
+        std::vector<int> members;
+        for (int i = 0; i < points.size(); ++i) {
+            members.push_back(i);
+        }
+
+        std::default_random_engine gen { (unsigned long) seed };
+
+        int next_leaf = 0;
+        split(t, 0, points, members, k, iter, gen, next_leaf);
+
+        return t;
+    }
+
+    int nearest(tree const& t, la::vector<double> const& x, double& dist)
+    {
+        int node = 0;
+
+        while (t.leaf_id[node] == -1) {
+            double min = std::numeric_limits<double>::infinity();
+            int argmin = -1;
+
+            for (int c: t.children[node]) {
+                double d = dist2(t.center[c], x);
+
+                if (d < min) {
+                    min = d;
+                    argmin = c;
+                }
+            }
+
+            node = argmin;
+        }
+
+        dist = std::sqrt(dist2(t.center[node], x));
+
+        return t.leaf_id[node];
+    }
+
+    std::vector<la::vector<double>> leaves(tree const& t)
+    {
+        std::vector<la::vector<double>> result;
+        result.resize(t.nleaf());
+
+        for (int n = 0; n < t.center.size(); ++n) {
+            if (t.leaf_id[n] != -1) {
+                result[t.leaf_id[n]] = t.center[n];
+            }
+        }
+
+        return result;
+    }
+
+    static char const tree_magic[4] = { 'H', 'K', 'M', 'T' };
+
+    void save(std::string const& filename, tree const& t)
+    {
+        std::ofstream ofs { filename, std::ios::binary };
+
+        int nnode = t.center.size();
+
+        ofs.write(tree_magic, 4);
+        ofs.write(reinterpret_cast<char const*>(&nnode), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&t.dim), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&t.branch), sizeof(int));
+
+        for (int n = 0; n < nnode; ++n) {
+            int nchild = t.children[n].size();
+
+            ofs.write(reinterpret_cast<char const*>(&t.leaf_id[n]), sizeof(int));
+            ofs.write(reinterpret_cast<char const*>(&nchild), sizeof(int));
+            ofs.write(reinterpret_cast<char const*>(t.children[n].data()), nchild * sizeof(int));
+            ofs.write(reinterpret_cast<char const*>(t.center[n].data()), t.dim * sizeof(double));
+        }
+
+        ofs.close();
+
+        if (!ofs) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    tree load(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, 4);
+
+        if (!ifs || std::memcmp(magic, tree_magic, 4) != 0) {
+            throw std::runtime_error(filename + " is not a k-means tree");
+        }
+
+        tree t;
+        int nnode;
+
+        ifs.read(reinterpret_cast<char*>(&nnode), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&t.dim), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&t.branch), sizeof(int));
+
+        t.center.resize(nnode);
+        t.children.resize(nnode);
+        t.leaf_id.resize(nnode);
+
+        for (int n = 0; n < nnode; ++n) {
+            int nchild;
+
+            ifs.read(reinterpret_cast<char*>(&t.leaf_id[n]), sizeof(int));
+            ifs.read(reinterpret_cast<char*>(&nchild), sizeof(int));
+
+            t.children[n].resize(nchild);
+            ifs.read(reinterpret_cast<char*>(t.children[n].data()), nchild * sizeof(int));
+
+            t.center[n].resize(t.dim);
+            ifs.read(reinterpret_cast<char*>(t.center[n].data()), t.dim * sizeof(double));
+        }
+
+        if (!ifs) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        return t;
+    }
+
+}
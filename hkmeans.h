@@ -0,0 +1,40 @@
+#ifndef HKMEANS_H
+#define HKMEANS_H
+
+#include "la/la.h"
+#include <vector>
+#include <string>
+
+namespace hkmeans {
+
+    /*
+     * A k-means tree.  Node 0 is the root; every internal node splits its
+     * points into at most branch children.  Leaves are numbered 0..nleaf-1
+     * and their centers, taken in that order, form an ordinary flat
+     * center file.
+     */
+    struct tree {
+        int dim;
+        int branch;
+
+        std::vector<la::vector<double>> center;
+        std::vector<std::vector<int>> children;
+        std::vector<int> leaf_id;
+
+        int nleaf() const;
+    };
+
+    tree build(std::vector<la::vector<double>> const& points,
+        int k, int branch, int iter, int seed);
+
+    int nearest(tree const& t, la::vector<double> const& x, double& dist);
+
+    std::vector<la::vector<double>> leaves(tree const& t);
+
+    void save(std::string const& filename, tree const& t);
+
+    tree load(std::string const& filename);
+
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "ivf.h"
+#include "thread-pool.h"
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+
+namespace ivf {
+
+    static double dist2(double const *a, double const *b, int dim)
+    {
+        double sum = 0;
+        for (int d = 0; d < dim; ++d) {
+            double diff = a[d] - b[d];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    index build(kmeans::center_file const& centers, int nlist, int iter, int seed)
+    {
+        index result;
+        result.nlist = std::max<int>(1, std::min<int>(nlist, centers.k));
+        result.dim = centers.dim;
+        result.k = centers.k;
+        result.checksum = checksum(centers);
+
+        std::default_random_engine gen { (unsigned long) seed };
+
+        std::vector<int> perm;
+        for (int i = 0; i < centers.k; ++i) {
+            perm.push_back(i);
+        }
+        std::shuffle(perm.begin(), perm.end(), gen);
+
+        result.coarse.resize(result.nlist * result.dim);
+        for (int c = 0; c < result.nlist; ++c) {
+            std::copy(centers.center(perm[c]), centers.center(perm[c]) + result.dim,
+                result.coarse.begin() + c * result.dim);
+        }
+
+        std::vector<int> assign;
+        assign.resize(centers.k);
+
+        thread_pool::pool& pool = thread_pool::global();
+
+        for (int i = 0; i <= iter; ++i) {
+            pool.parallel_for(centers.k, [&](int k) {
+                double min = std::numeric_limits<double>::infinity();
+
+                for (int c = 0; c < result.nlist; ++c) {
+                    double d = dist2(centers.center(k), result.coarse.data() + c * result.dim, result.dim);
+
+                    if (d < min) {
+                        min = d;
+                        assign[k] = c;
+                    }
+                }
+            });
+
+            // the last pass only assigns
+            if (i == iter) {
+                break;
+            }
+
+            std::vector<double> sum;
+            sum.resize(result.nlist * result.dim);
+            std::vector<int> count;
+            count.resize(result.nlist);
+
+            for (int k = 0; k < centers.k; ++k) {
+                double const *c = centers.center(k);
+                double *s = sum.data() + assign[k] * result.dim;
+
+                for (int d = 0; d < result.dim; ++d) {
+                    s[d] += c[d];
+                }
+
+                count[assign[k]] += 1;
+            }
+
+            for (int c = 0; c < result.nlist; ++c) {
+                if (count[c] == 0) {
+                    continue;
+                }
+
+                for (int d = 0; d < result.dim; ++d) {
+                    result.coarse[c * result.dim + d] = sum[c * result.dim + d] / count[c];
+                }
+            }
+        }
+
+        result.lists.resize(result.nlist);
+
+        for (int k = 0; k < centers.k; ++k) {
+            result.lists[assign[k]].push_back(k);
+        }
+
+        return result;
+    }
+
+    static char const ivf_magic[4] = { 'I', 'V', 'F', '2' };
+
+    uint64_t checksum(kmeans::center_file const& centers)
+    {
+        // FNV-1a over the rows
+        uint64_t h = 14695981039346656037ull;
+
+        unsigned char const *p = reinterpret_cast<unsigned char const*>(centers.data);
+        size_t n = (size_t) centers.k * centers.dim * sizeof(double);
+
+        for (size_t i = 0; i < n; ++i) {
+            h = (h ^ p[i]) * 1099511628211ull;
+        }
+
+        return h;
+    }
+
+    bool matches(index const& idx, kmeans::center_file const& centers)
+    {
+        return idx.k == centers.k && idx.dim == centers.dim
+            && idx.checksum == checksum(centers);
+    }
+
+    void save(std::string const& filename, index const& idx)
+    {
+        std::ofstream ofs { filename, std::ios::binary };
+
+        ofs.write(ivf_magic, 4);
+        ofs.write(reinterpret_cast<char const*>(&idx.nlist), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&idx.dim), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&idx.k), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&idx.checksum), sizeof(uint64_t));
+        ofs.write(reinterpret_cast<char const*>(idx.coarse.data()), idx.coarse.size() * sizeof(double));
+
+        for (auto& ell: idx.lists) {
+            int size = ell.size();
+            ofs.write(reinterpret_cast<char const*>(&size), sizeof(int));
+            ofs.write(reinterpret_cast<char const*>(ell.data()), size * sizeof(int));
+        }
+
+        ofs.close();
+
+        if (!ofs) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    index load(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, 4);
+
+        if (!ifs || std::memcmp(magic, ivf_magic, 4) != 0) {
+            throw std::runtime_error(filename + " is not a center index");
+        }
+
+        index result;
+
+        ifs.read(reinterpret_cast<char*>(&result.nlist), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&result.dim), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&result.k), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&result.checksum), sizeof(uint64_t));
+
+        result.coarse.resize(result.nlist * result.dim);
+        ifs.read(reinterpret_cast<char*>(result.coarse.data()), result.coarse.size() * sizeof(double));
+
+        result.lists.resize(result.nlist);
+
+        for (auto& ell: result.lists) {
+            int size;
+            ifs.read(reinterpret_cast<char*>(&size), sizeof(int));
+            ell.resize(size);
+            ifs.read(reinterpret_cast<char*>(ell.data()), size * sizeof(int));
+        }
+
+        if (!ifs) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        return result;
+    }
+
+    int nearest(index const& idx, kmeans::center_file const& centers,
+        la::vector<double> const& x, int nprobe, double& dist)
+    {
+        if (idx.k != centers.k || idx.dim != centers.dim) {
+            throw std::runtime_error("center index does not match the centers");
+        }
+
+        nprobe = std::max<int>(1, std::min<int>(nprobe, idx.nlist));
+
+        std::vector<std::pair<double, int>> probe;
+
+        for (int c = 0; c < idx.nlist; ++c) {
+            probe.push_back(std::make_pair(dist2(x.data(), idx.coarse.data() + c * idx.dim, idx.dim), c));
+        }
+
+        std::sort(probe.begin(), probe.end());
+
+        double x_norm2 = 0;
+        for (int d = 0; d < x.size(); ++d) {
+            x_norm2 += x(d) * x(d);
+        }
+
+        double min = std::numeric_limits<double>::infinity();
+        int argmin = -1;
+
+        // lists emptied by the coarse updates hold nothing; keep going
+        // until some center is seen
+        for (int p = 0; p < idx.nlist && (p < nprobe || argmin == -1); ++p) {
+            for (int k: idx.lists[probe[p].second]) {
+                double const *c = centers.center(k);
+
+                double dot = 0;
+                for (int d = 0; d < centers.dim; ++d) {
+                    dot += c[d] * x(d);
+                }
+
+                double d2 = centers.norms[k] * centers.norms[k] - 2 * dot + x_norm2;
+
+                if (d2 < min) {
+                    min = d2;
+                    argmin = k;
+                }
+            }
+        }
+
+        dist = std::sqrt(std::max(0.0, min));
+
+        return argmin;
+    }
+
+}
@@ -0,0 +1,48 @@
+#ifndef IVF_H
+#define IVF_H
+
+#include "la/la.h"
+#include "kmeans.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace ivf {
+
+    /*
+     * Inverted-file index over a center matrix.  The centers are grouped
+     * by a coarse quantizer of nlist centroids; a query scans the members
+     * of its nprobe closest lists only.  nprobe = nlist is an exact scan.
+     * checksum identifies the center matrix the index was built from.
+     */
+    struct index {
+        int nlist;
+        int dim;
+        int k;
+        uint64_t checksum;
+
+        std::vector<double> coarse;
+        std::vector<std::vector<int>> lists;
+    };
+
+    index build(kmeans::center_file const& centers, int nlist, int iter, int seed);
+
+    void save(std::string const& filename, index const& idx);
+
+    index load(std::string const& filename);
+
+    uint64_t checksum(kmeans::center_file const& centers);
+
+    // false when the index was built from other centers
+    bool matches(index const& idx, kmeans::center_file const& centers);
+
+    /*
+     * Probes lists past nprobe while all probed lists are empty, so a
+     * center is always found.
+     */
+    int nearest(index const& idx, kmeans::center_file const& centers,
+        la::vector<double> const& x, int nprobe, double& dist);
+
+}
+
+#endif
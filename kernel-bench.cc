@@ -0,0 +1,407 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include "speech/speech.h"
+#include "unsupseg/dtw.h"
+#include "unsupseg/embed.h"
+#include "nn/tensor-tree.h"
+#include "lstm-embed.h"
+#include "kmeans.h"
+#include "subseq.h"
+#include "spans.h"
+#include "patch-dist.h"
+#include "text-batch.h"
+#include "thread-pool.h"
+#include "precision.h"
+#include "synth.h"
+#include "bench.h"
+
+using seg_t = embed::seg_t;
+
+struct bench_env {
+
+    bench_env(std::unordered_map<std::string, std::string> const& args);
+
+    double min_time;
+    std::default_random_engine gen;
+
+    std::vector<bench::result> results;
+
+    std::unordered_map<std::string, std::string> args;
+
+    void add(std::string const& name, std::function<double()> f, double items);
+
+    void run();
+
+};
+
+int main(int argc, char *argv[])
+{
+    ebt::ArgumentSpec spec {
+        "kernel-bench",
+        "Microbenchmarks for the hot kernels",
+        {
+            {"filter", "", false},
+            {"min-time", "", false},
+            {"seed", "", false},
+            {"output", "", false},
+            {"baseline", "", false},
+            {"lstm-param", "", false},
+            {"lstm-dim", "", false},
+        }
+    };
+
+    for (int i = 0; i < argc; ++i) {
+        std::cout << argv[i] << " ";
+    }
+    std::cout << std::endl;
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    bench_env env { args };
+
+    env.run();
+
+    return 0;
+}
+
+bench_env::bench_env(std::unordered_map<std::string, std::string> const& args)
+    : args(args)
+{
+    min_time = 0.5;
+    if (ebt::in(std::string("min-time"), args)) {
+        min_time = std::stod(args.at("min-time"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    gen = std::default_random_engine { (unsigned long) seed };
+}
+
+void bench_env::add(std::string const& name, std::function<double()> f, double items)
+{
+    if (ebt::in(std::string("filter"), args)
+            && name.find(args.at("filter")) == std::string::npos) {
+        return;
+    }
+
+    bench::result r = bench::run(name, f, items, min_time);
+    bench::print(std::cout, r);
+    results.push_back(r);
+}
+
+void bench_env::run()
+{
+    for (int dim: { 13, 40, 80 }) {
+        for (int len: { 20, 50, 100 }) {
+            seg_t a = synth::logmel(len, dim, gen);
+            seg_t b = synth::logmel(len, dim, gen);
+
+            add("dtw/len=" + std::to_string(len) + "/dim=" + std::to_string(dim),
+                [&, a, b]() { return dtw::dtw(a, b); }, len * len);
+        }
+    }
+
+    // the same subsequence DTW over double and float frames
+    for (int dim: { 40, 80 }) {
+        seg_t query = synth::logmel(50, dim, gen);
+        seg_t utt = synth::logmel(500, dim, gen);
+
+        std::vector<std::vector<float>> query32 = precision::convert<float>(query);
+        std::vector<std::vector<float>> utt32 = precision::convert<float>(utt);
+
+        std::string suffix = "/dim=" + std::to_string(dim);
+
+        add("subseq_f64" + suffix, [query, utt]() {
+            std::vector<double> cost;
+            std::vector<int> start;
+            subseq::cost_curve(query, utt, -1, cost, start);
+            return cost.back();
+        }, query.size() * utt.size());
+
+        add("subseq_f32" + suffix, [query32, utt32]() {
+            std::vector<double> cost;
+            std::vector<int> start;
+            subseq::cost_curve(query32, utt32, -1, cost, start);
+            return cost.back();
+        }, query.size() * utt.size());
+    }
+
+    for (int nbasis: { 10, 50, 200 }) {
+        seg_t seg = synth::logmel(50, 40, gen);
+
+        std::vector<seg_t> basis;
+        for (int i = 0; i < nbasis; ++i) {
+            basis.push_back(synth::logmel(30, 40, gen));
+        }
+
+        add("dtw_embed/basis=" + std::to_string(nbasis),
+            [&, seg, basis]() { return la::norm(embed::dtw_embed(seg, basis)); }, nbasis);
+
+        la::tensor<double> seg_tensor = embed::to_tensor(seg);
+        la::tensor<double> basis_tensor = embed::to_tensor(basis);
+
+        add("conv_embed/basis=" + std::to_string(nbasis),
+            [&, seg_tensor, basis_tensor]() {
+                return la::norm(embed::conv_embed(seg_tensor, basis_tensor));
+            }, nbasis);
+    }
+
+    for (int k: { 100, 1000 }) {
+        for (int dim: { 100, 500 }) {
+            std::normal_distribution<double> normal { 0, 1 };
+
+            std::vector<la::vector<double>> centers;
+            for (int i = 0; i < k; ++i) {
+                la::vector<double> v;
+                v.resize(dim);
+                for (int d = 0; d < dim; ++d) {
+                    v(d) = normal(gen);
+                }
+                centers.push_back(v);
+            }
+
+            la::vector<double> x = centers[k / 2];
+            la::imul(x, 1.0 / la::norm(x));
+
+            std::string suffix = "/k=" + std::to_string(k) + "/dim=" + std::to_string(dim);
+
+            add("kmeans_assign_sub" + suffix, [&, centers, x]() {
+                double min = std::numeric_limits<double>::infinity();
+
+                for (int c = 0; c < centers.size(); ++c) {
+                    min = std::min(min, la::norm(la::sub(centers[c], x)));
+                }
+
+                return min;
+            }, k);
+
+            auto center_file = std::make_shared<kmeans::center_file>();
+            center_file->assign(centers);
+
+            add("kmeans_assign_norm" + suffix, [center_file, x]() {
+                double min;
+                kmeans::nearest(*center_file, x, min);
+                return min;
+            }, k);
+
+            center_file->make_f32();
+
+            add("kmeans_assign_norm_f32" + suffix, [center_file, x]() {
+                double min;
+                kmeans::nearest_f32(*center_file, x.data(), min);
+                return min;
+            }, k);
+        }
+    }
+
+    for (int nfilter: { 16, 64 }) {
+        seg_t seg = synth::logmel(100, 40, gen);
+        la::tensor<double> seg_tensor = embed::to_tensor(seg);
+
+        std::normal_distribution<double> normal { 0, 1 };
+
+        la::tensor<double> filters;
+        filters.resize({ 10, 40, (unsigned int) nfilter });
+        for (int i = 0; i < filters.vec_size(); ++i) {
+            filters.data()[i] = normal(gen);
+        }
+
+        std::vector<double> filter_energy = patch_dist::filter_energy(filters);
+
+        add("conv_kmeans_dist/filters=" + std::to_string(nfilter),
+            [&, seg_tensor, filters, filter_energy]() {
+                std::vector<double> min;
+                std::vector<std::pair<int, int>> argmin;
+                patch_dist::nearest(seg_tensor, filters, filter_energy, min, argmin);
+                return *std::min_element(min.begin(), min.end());
+            }, seg.size());
+
+        std::vector<std::vector<float>> seg32 = precision::convert<float>(seg);
+        patch_dist::filters32 filters32 = patch_dist::make_filters32(filters);
+
+        add("conv_kmeans_dist_f32/filters=" + std::to_string(nfilter),
+            [&, seg32, filters32]() {
+                std::vector<double> min;
+                std::vector<std::pair<int, int>> argmin;
+                patch_dist::nearest(seg32, filters32, min, argmin);
+                return *std::min_element(min.begin(), min.end());
+            }, seg.size());
+    }
+
+    // all spans of one utterance from a single pass per start, and the
+    // pass for one start that span-embed --check and par_embed share
+    {
+        thread_pool::pool pool { 1 };
+
+        seg_t utt = synth::logmel(200, 40, gen);
+        std::vector<std::vector<float>> utt32 = precision::convert<float>(utt);
+
+        std::vector<seg_t> basis;
+        for (int i = 0; i < 50; ++i) {
+            basis.push_back(synth::logmel(30, 40, gen));
+        }
+
+        std::vector<std::vector<std::vector<float>>> basis32;
+        for (auto& b: basis) {
+            basis32.push_back(precision::convert<float>(b));
+        }
+
+        int min_dur = 5;
+        int max_dur = 50;
+        double nspan = (utt.size() - min_dur + 1) * double(max_dur - min_dur + 1);
+
+        add("dtw_start/basis=50/dur=50", [&, utt, basis]() {
+            std::vector<double> out;
+            out.resize(basis.size());
+            spans::dtw_start(utt, basis, 0, 50, 50, out.data());
+            return out[0];
+        }, basis.size());
+
+        add("dtw_spans_f64/utt=200/basis=50", [&, utt, basis]() {
+            spans::span_table t = spans::dtw_spans(utt, basis, min_dur, max_dur, pool);
+            return t.data[0];
+        }, nspan);
+
+        add("dtw_spans_f32/utt=200/basis=50", [&, utt32, basis32]() {
+            spans::span_table t = spans::dtw_spans(utt32, basis32, min_dur, max_dur, pool);
+            return t.data[0];
+        }, nspan);
+
+        la::tensor<double> basis_tensor = embed::to_tensor(std::vector<seg_t>(basis.begin(), basis.begin() + 16));
+
+        // spans shorter than the 30-frame filters have no conv embedding
+        double nconv = (utt.size() - 30 + 1) * double(max_dur - 30 + 1);
+
+        add("conv_spans/utt=200/basis=16", [&, utt, basis_tensor]() {
+            spans::span_table t = spans::conv_spans(utt, basis_tensor, 30, max_dur,
+                spans::pooling::max, pool);
+            return t.data[0];
+        }, nconv);
+    }
+
+    {
+        std::ostringstream oss;
+
+        for (int i = 0; i < 100; ++i) {
+            synth::write_frame_batch(oss, std::to_string(i) + ".logmel", synth::logmel(100, 40, gen));
+        }
+
+        std::string text = oss.str();
+
+        add("load_frame_batch/100x100x40", [text]() {
+            std::istringstream iss { text };
+            double frames = 0;
+
+            while (1) {
+                seg_t seg = speech::load_frame_batch(iss);
+
+                if (!iss) {
+                    break;
+                }
+
+                frames += seg.size();
+            }
+
+            return frames;
+        }, text.size());
+
+        // the stream path of text_batch, on the same records
+        add("text_batch_read/100x100x40", [text]() {
+            std::istringstream iss { text };
+            double frames = 0;
+
+            std::string name;
+            seg_t seg;
+
+            while (text_batch::read(iss, name, seg)) {
+                frames += seg.size();
+            }
+
+            return frames;
+        }, text.size());
+
+        // the number parser alone, which the mmap path runs over every line
+        add("parse_double/100x100x40", [text]() {
+            char const *p = text.data();
+            char const *end = p + text.size();
+            double sum = 0;
+
+            while (p < end) {
+                double v;
+                char const *q = text_batch::parse_double(p, end, v);
+
+                if (q == p) {
+                    ++p;
+                } else {
+                    sum += v;
+                    p = q;
+                }
+            }
+
+            return sum;
+        }, text.size());
+    }
+
+    if (ebt::in(std::string("lstm-param"), args)) {
+        std::string line;
+        std::ifstream param_ifs { args.at("lstm-param") };
+        std::getline(param_ifs, line);
+        int layer = std::stoi(line);
+        std::shared_ptr<tensor_tree::vertex> param = lstm_embed::make_tensor_tree(layer);
+        tensor_tree::load_tensor(param, param_ifs);
+        param_ifs.close();
+
+        int dim = 40;
+        if (ebt::in(std::string("lstm-dim"), args)) {
+            dim = std::stoi(args.at("lstm-dim"));
+        }
+
+        for (int len: { 20, 60 }) {
+            seg_t seg = synth::logmel(len, dim, gen);
+
+            add("lstm_embed/len=" + std::to_string(len), [=]() {
+                autodiff::computation_graph comp_graph;
+                std::shared_ptr<tensor_tree::vertex> var_tree = tensor_tree::make_var_tree(comp_graph, param);
+
+                auto e = lstm_embed::embed(lstm_embed::to_op(seg, comp_graph), layer, var_tree);
+                auto n = autodiff::norm(e);
+
+                n->grad = std::make_shared<double>(1);
+
+                auto topo_order = autodiff::natural_topo_order(comp_graph);
+                autodiff::guarded_grad(topo_order, autodiff::grad_funcs);
+
+                return autodiff::get_output<double>(n);
+            }, len);
+        }
+    }
+
+    if (ebt::in(std::string("output"), args)) {
+        std::ofstream ofs { args.at("output") };
+        bench::save_tsv(ofs, results);
+    }
+
+    if (ebt::in(std::string("baseline"), args)) {
+        std::ifstream ifs { args.at("baseline") };
+        std::unordered_map<std::string, bench::result> baseline = bench::load_tsv(ifs);
+
+        std::cout << std::endl;
+
+        for (auto& r: results) {
+            if (!ebt::in(r.name, baseline)) {
+                continue;
+            }
+
+            std::cout << r.name << ": " << baseline.at(r.name).ns_per_op / r.ns_per_op
+                << "x baseline speed" << std::endl;
+        }
+    }
+}
+
@@ -0,0 +1,81 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include "kmeans.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "kmeans-merge",
+        "Merge k-means shard statistics into new centers",
+        {
+            {"stat", "", true},
+            {"centers", "", false},
+            {"output-centers", "", true},
+            {"output-format", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    kmeans::stat_t total;
+
+    for (auto& filename: ebt::split(args.at("stat"), ",")) {
+        kmeans::stat_t s;
+
+        {
+            profile::scope prof { "load_stat" };
+            s = kmeans::load_stat(filename);
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cout << filename << ": " << s.nsample << " samples" << '\n';
+        }
+
+        kmeans::merge(total, s);
+    }
+
+    std::vector<la::vector<double>> centers;
+
+    if (ebt::in(std::string("centers"), args)) {
+        centers = kmeans::load_centers(args.at("centers"));
+    }
+
+    int empty = 0;
+    for (auto& p: total.stat) {
+        if (p.second == 0) {
+            ++empty;
+        }
+    }
+
+    kmeans::update(centers, total);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "samples: " << total.nsample << '\n';
+        std::cout << "empty clusters: " << empty << '\n';
+        std::cout << "loss: " << total.loss / total.nsample << '\n';
+    }
+
+    if (ebt::in(std::string("output-format"), args) && args.at("output-format") == "bin") {
+        kmeans::save_centers_bin(args.at("output-centers"), centers, total.iteration);
+    } else {
+        kmeans::save_centers(args.at("output-centers"), centers);
+    }
+
+    return 0;
+}
@@ -0,0 +1,475 @@
+#include "kmeans.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kmeans {
+
+    static char const centers_magic[4] = { 'K', 'M', 'C', 'B' };
+
+    struct centers_header {
+        char magic[4];
+        int k;
+        int dim;
+        int iteration;
+    };
+
+    center_file::center_file()
+        : k(0), dim(0), iteration(0), norms(nullptr), data(nullptr), base(nullptr), length(0)
+    {}
+
+    center_file::~center_file()
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    void center_file::open(std::string const& filename)
+    {
+        if (!is_binary(filename)) {
+            assign(load_centers(filename));
+
+            return;
+        }
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+
+        if (length < sizeof(centers_header)) {
+            ::close(fd);
+            length = 0;
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            throw std::runtime_error("failed to map " + filename);
+        }
+
+        centers_header const& h = *static_cast<centers_header const*>(base);
+
+        if (h.k < 0 || h.dim < 0) {
+            throw std::runtime_error(filename + " has a corrupt header");
+        }
+
+        k = h.k;
+        dim = h.dim;
+        iteration = h.iteration;
+
+        if (length != sizeof(centers_header) + (k + (size_t) k * dim) * sizeof(double)) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        norms = reinterpret_cast<double const*>(static_cast<char const*>(base) + sizeof(centers_header));
+        data = norms + k;
+    }
+
+    void center_file::assign(std::vector<la::vector<double>> const& centers)
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+            base = nullptr;
+            length = 0;
+        }
+
+        k = centers.size();
+        dim = (k == 0 ? 0 : centers.front().size());
+        iteration = 0;
+
+        owned.resize(k + (size_t) k * dim);
+
+        for (int i = 0; i < k; ++i) {
+            owned[i] = la::norm(centers[i]);
+            std::copy(centers[i].data(), centers[i].data() + dim, owned.data() + k + (size_t) i * dim);
+        }
+
+        norms = owned.data();
+        data = owned.data() + k;
+
+        data32.clear();
+    }
+
+    double const* center_file::center(int i) const
+    {
+        return data + (size_t) i * dim;
+    }
+
+    void center_file::make_f32()
+    {
+        data32.assign(data, data + (size_t) k * dim);
+    }
+
+    bool is_binary(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, 4);
+
+        return ifs && std::memcmp(magic, centers_magic, 4) == 0;
+    }
+
+    std::vector<la::vector<double>> load_centers(std::string const& filename)
+    {
+        std::vector<la::vector<double>> centers;
+
+        if (is_binary(filename)) {
+            center_file f;
+            f.open(filename);
+
+            for (int i = 0; i < f.k; ++i) {
+                la::vector<double> v;
+                v.resize(f.dim);
+                std::copy(f.center(i), f.center(i) + f.dim, v.data());
+                centers.push_back(v);
+            }
+
+            return centers;
+        }
+
+        std::ifstream centers_ifs { filename };
+
+        std::string line;
+
+        while (std::getline(centers_ifs, line)) {
+            auto parts = ebt::split(line);
+
+            la::vector<double> v;
+            v.resize(parts.size());
+
+            int d = 0;
+            for (auto& p: parts) {
+                v(d) = std::stod(p);
+                ++d;
+            }
+
+            centers.push_back(v);
+        }
+
+        return centers;
+    }
+
+    void save_centers(std::string const& filename,
+        std::vector<la::vector<double>> const& centers)
+    {
+        std::ofstream centers_ofs { filename };
+        for (int k = 0; k < centers.size(); ++k) {
+            for (int d = 0; d < centers[k].size(); ++d) {
+                centers_ofs << centers[k](d);
+                if (d != centers[k].size() - 1) {
+                    centers_ofs << " ";
+                }
+            }
+            centers_ofs << '\n';
+        }
+        centers_ofs.close();
+    }
+
+    static void commit(std::string const& tmp, std::string const& filename)
+    {
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to rename " + tmp + " to " + filename);
+        }
+    }
+
+    void save_centers_bin(std::string const& filename,
+        std::vector<la::vector<double>> const& centers,
+        int iteration)
+    {
+        centers_header h;
+        std::memcpy(h.magic, centers_magic, 4);
+        h.k = centers.size();
+        h.dim = (h.k == 0 ? 0 : centers.front().size());
+        h.iteration = iteration;
+
+        std::string tmp = filename + ".tmp";
+
+        std::ofstream ofs { tmp, std::ios::binary };
+
+        ofs.write(reinterpret_cast<char const*>(&h), sizeof(centers_header));
+
+        for (auto& c: centers) {
+            double n = la::norm(c);
+            ofs.write(reinterpret_cast<char const*>(&n), sizeof(double));
+        }
+
+        for (auto& c: centers) {
+            ofs.write(reinterpret_cast<char const*>(c.data()), h.dim * sizeof(double));
+        }
+
+        ofs.close();
+
+        if (!ofs) {
+            throw std::runtime_error("failed to write " + tmp);
+        }
+
+        commit(tmp, filename);
+    }
+
+    int nearest(center_file const& centers, la::vector<double> const& x, double& dist)
+    {
+        double x_norm2 = 0;
+        for (int d = 0; d < x.size(); ++d) {
+            x_norm2 += x(d) * x(d);
+        }
+
+        double min = std::numeric_limits<double>::infinity();
+        int argmin = -1;
+
+        for (int k = 0; k < centers.k; ++k) {
+            double const *c = centers.center(k);
+
+            double dot = 0;
+            for (int d = 0; d < centers.dim; ++d) {
+                dot += c[d] * x(d);
+            }
+
+            double dist2 = centers.norms[k] * centers.norms[k] - 2 * dot + x_norm2;
+
+            if (dist2 < min) {
+                min = dist2;
+                argmin = k;
+            }
+        }
+
+        dist = std::sqrt(std::max(0.0, min));
+
+        return argmin;
+    }
+
+    int nearest_f32(center_file const& centers, double const *x, double& dist)
+    {
+        if (centers.data32.size() != (size_t) centers.k * centers.dim) {
+            throw std::logic_error("nearest_f32 needs make_f32");
+        }
+
+        double x_norm2 = 0;
+        for (int d = 0; d < centers.dim; ++d) {
+            x_norm2 += x[d] * x[d];
+        }
+
+        double min = std::numeric_limits<double>::infinity();
+        int argmin = -1;
+
+        for (int k = 0; k < centers.k; ++k) {
+            float const *c = centers.data32.data() + (size_t) k * centers.dim;
+
+            double dot = 0;
+            for (int d = 0; d < centers.dim; ++d) {
+                dot += c[d] * x[d];
+            }
+
+            double dist2 = centers.norms[k] * centers.norms[k] - 2 * dot + x_norm2;
+
+            if (dist2 < min) {
+                min = dist2;
+                argmin = k;
+            }
+        }
+
+        dist = std::sqrt(std::max(0.0, min));
+
+        return argmin;
+    }
+
+    static char const stat_magic[4] = { 'K', 'M', 'S', 'T' };
+
+    stat_t make_stat(int k, int dim)
+    {
+        stat_t result;
+
+        for (int i = 0; i < k; ++i) {
+            la::vector<double> v;
+            v.resize(dim);
+            result.stat.push_back(std::make_pair(v, 0));
+        }
+
+        result.loss = 0;
+        result.nsample = 0;
+        result.iteration = 0;
+
+        return result;
+    }
+
+    void save_stat(std::string const& filename, stat_t const& s)
+    {
+        std::string tmp = filename + ".tmp";
+
+        std::ofstream ofs { tmp, std::ios::binary };
+
+        int k = s.stat.size();
+        int dim = (k == 0 ? 0 : s.stat.front().first.size());
+
+        ofs.write(stat_magic, 4);
+        ofs.write(reinterpret_cast<char const*>(&k), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&dim), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&s.loss), sizeof(double));
+        ofs.write(reinterpret_cast<char const*>(&s.nsample), sizeof(long));
+        ofs.write(reinterpret_cast<char const*>(&s.iteration), sizeof(int));
+
+        for (auto& p: s.stat) {
+            ofs.write(reinterpret_cast<char const*>(&p.second), sizeof(int));
+            ofs.write(reinterpret_cast<char const*>(p.first.data()), dim * sizeof(double));
+        }
+
+        ofs.close();
+
+        if (!ofs) {
+            throw std::runtime_error("failed to write " + tmp);
+        }
+
+        commit(tmp, filename);
+    }
+
+    stat_t load_stat(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        int k;
+        int dim;
+
+        ifs.read(magic, 4);
+
+        if (!ifs || std::memcmp(magic, stat_magic, 4) != 0) {
+            throw std::runtime_error(filename + " is not a k-means stat file");
+        }
+
+        ifs.read(reinterpret_cast<char*>(&k), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&dim), sizeof(int));
+
+        if (!ifs || k < 0 || dim < 0) {
+            throw std::runtime_error(filename + " has a bad header");
+        }
+
+        stat_t result = make_stat(k, dim);
+
+        ifs.read(reinterpret_cast<char*>(&result.loss), sizeof(double));
+        ifs.read(reinterpret_cast<char*>(&result.nsample), sizeof(long));
+        ifs.read(reinterpret_cast<char*>(&result.iteration), sizeof(int));
+
+        for (auto& p: result.stat) {
+            ifs.read(reinterpret_cast<char*>(&p.second), sizeof(int));
+            ifs.read(reinterpret_cast<char*>(p.first.data()), dim * sizeof(double));
+        }
+
+        if (!ifs) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        return result;
+    }
+
+    stat_t load_stat(std::string const& filename,
+        std::vector<la::vector<double>> const& centers)
+    {
+        stat_t result = load_stat(filename);
+
+        int k = result.stat.size();
+        int dim = (k == 0 ? 0 : result.stat.front().first.size());
+
+        if (k != centers.size() || (k != 0 && dim != centers.front().size())) {
+            throw std::runtime_error(filename + " has " + std::to_string(k) + " clusters of dimension "
+                + std::to_string(dim) + ", but there are " + std::to_string(centers.size())
+                + " centers of dimension " + std::to_string(centers.empty() ? 0 : centers.front().size()));
+        }
+
+        return result;
+    }
+
+    void merge(stat_t& result, stat_t const& s)
+    {
+        if (result.stat.size() == 0) {
+            result = s;
+            return;
+        }
+
+        if (result.stat.size() != s.stat.size()) {
+            throw std::runtime_error("stat files disagree on the number of centers");
+        }
+
+        for (int k = 0; k < s.stat.size(); ++k) {
+            la::iadd(result.stat[k].first, s.stat[k].first);
+            result.stat[k].second += s.stat[k].second;
+        }
+
+        result.loss += s.loss;
+        result.nsample += s.nsample;
+        result.iteration = std::max(result.iteration, s.iteration);
+    }
+
+    void update(std::vector<la::vector<double>>& centers, stat_t const& s)
+    {
+        if (centers.size() > s.stat.size()) {
+            throw std::runtime_error("stat has " + std::to_string(s.stat.size())
+                + " clusters for " + std::to_string(centers.size()) + " centers");
+        }
+
+        centers.resize(s.stat.size());
+
+        std::vector<long> count;
+
+        for (int k = 0; k < s.stat.size(); ++k) {
+            count.push_back(s.stat[k].second);
+
+            // an empty cluster keeps its previous center
+            if (s.stat[k].second != 0) {
+                centers[k] = la::mul(s.stat[k].first, 1.0 / s.stat[k].second);
+            }
+        }
+
+        for (int k = 0; k < s.stat.size(); ++k) {
+            if (centers[k].size() != 0) {
+                continue;
+            }
+
+            // empty with no previous center: split the largest cluster by
+            // placing a slightly scaled copy of its center next to it
+            int donor = std::max_element(count.begin(), count.end()) - count.begin();
+
+            if (count[donor] == 0) {
+                throw std::runtime_error("no samples to seed empty clusters");
+            }
+
+            centers[k] = la::mul(centers[donor], 1.01);
+
+            count[k] = count[donor] / 2;
+            count[donor] -= count[k];
+        }
+    }
+
+    bool parse_shard(std::string const& str, int& shard, int& nshard)
+    {
+        std::vector<std::string> parts = ebt::split(str, "/");
+
+        if (parts.size() != 2) {
+            return false;
+        }
+
+        shard = std::stoi(parts[0]);
+        nshard = std::stoi(parts[1]);
+
+        return 0 <= shard && shard < nshard;
+    }
+
+}
@@ -0,0 +1,109 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include "la/la.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace kmeans {
+
+    /*
+     * Centers as one k x dim row-major matrix plus the norm of each row.
+     * Binary files (see save_centers_bin) are mapped read-only; text files
+     * are parsed into owned storage so callers see the same layout.
+     */
+    struct center_file {
+
+        center_file();
+        ~center_file();
+
+        center_file(center_file const&) = delete;
+        center_file& operator=(center_file const&) = delete;
+
+        void open(std::string const& filename);
+
+        // in-memory centers, for the learners' assignment passes
+        void assign(std::vector<la::vector<double>> const& centers);
+
+        int k;
+        int dim;
+        int iteration;
+
+        double const *norms;
+        double const *data;
+
+        double const* center(int i) const;
+
+        // float copies of the rows, for nearest_f32; empty until make_f32
+        // is called
+        std::vector<float> data32;
+
+        void make_f32();
+
+    private:
+        void *base;
+        size_t length;
+
+        std::vector<double> owned;
+
+    };
+
+    bool is_binary(std::string const& filename);
+
+    std::vector<la::vector<double>> load_centers(std::string const& filename);
+
+    void save_centers(std::string const& filename,
+        std::vector<la::vector<double>> const& centers);
+
+    // writes to filename.tmp and renames, so readers never see a partial file
+    void save_centers_bin(std::string const& filename,
+        std::vector<la::vector<double>> const& centers,
+        int iteration);
+
+    int nearest(center_file const& centers, la::vector<double> const& x, double& dist);
+
+    /*
+     * The same search over the float rows (see make_f32), which halves
+     * the memory read per query.  The query is an embedding of costs and
+     * stays double; dot products are summed in double.
+     */
+    int nearest_f32(center_file const& centers, double const *x, double& dist);
+
+    /*
+     * Per-center sums and counts of one assignment pass.  A shard writes
+     * its stat with save_stat; merge adds shards up and update turns the
+     * total into the next set of centers.
+     */
+    struct stat_t {
+        std::vector<std::pair<la::vector<double>, int>> stat;
+        double loss;
+        long nsample;
+        int iteration;
+    };
+
+    stat_t make_stat(int k, int dim);
+
+    void save_stat(std::string const& filename, stat_t const& s);
+
+    stat_t load_stat(std::string const& filename);
+
+    // as load_stat, checking that the stat has one entry per center
+    stat_t load_stat(std::string const& filename,
+        std::vector<la::vector<double>> const& centers);
+
+    void merge(stat_t& result, stat_t const& s);
+
+    /*
+     * One Lloyd step: each center becomes the mean of its cluster.  An
+     * empty cluster keeps its previous center, or, when there is none,
+     * is reseeded next to the center of the largest cluster.  The stat
+     * may have more clusters than there are centers, but not fewer.
+     */
+    void update(std::vector<la::vector<double>>& centers, stat_t const& s);
+
+    bool parse_shard(std::string const& str, int& shard, int& nshard);
+
+}
+
+#endif
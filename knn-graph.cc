@@ -0,0 +1,260 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include "speech/speech.h"
+#include "unsupseg/dtw.h"
+#include "thread-pool.h"
+#include "embed-index.h"
+#include "lsh.h"
+#include "knn.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "knn-graph",
+        "Build a sparse k-nearest-neighbor graph over an embedding index",
+        {
+            {"index", "built by embed-index-build", true},
+            {"output", "", true},
+            {"k", "neighbors per segment (default 10)", false},
+            {"tables", "lsh tables (default 8)", false},
+            {"bits", "lsh signature bits, at most 64 (default 12)", false},
+            {"seed", "", false},
+            {"rerank", "re-score this many nearest candidates with dtw", false},
+            {"frame-batch", "the segments of the index, for --rerank", false},
+            {"check", "measure recall against exact search on this many rows", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    int k = 10;
+    if (ebt::in(std::string("k"), args)) {
+        k = std::stoi(args.at("k"));
+    }
+
+    int ntable = 8;
+    if (ebt::in(std::string("tables"), args)) {
+        ntable = std::stoi(args.at("tables"));
+    }
+
+    int nbit = 12;
+    if (ebt::in(std::string("bits"), args)) {
+        nbit = std::stoi(args.at("bits"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    int rerank = 0;
+    if (ebt::in(std::string("rerank"), args)) {
+        rerank = std::max(k, std::stoi(args.at("rerank")));
+
+        if (!ebt::in(std::string("frame-batch"), args)) {
+            std::cerr << "--rerank needs --frame-batch" << std::endl;
+            exit(1);
+        }
+    }
+
+    int ncheck = 0;
+    if (ebt::in(std::string("check"), args)) {
+        ncheck = std::stoi(args.at("check"));
+    }
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    embed_index::index idx;
+    idx.open(args.at("index"));
+
+    std::vector<seg_t> segs;
+
+    if (rerank > 0) {
+        profile::scope prof { "load_frame_batch" };
+
+        frame_store::batch frame_batch;
+        frame_batch.open(args.at("frame-batch"), pool);
+
+        if (frame_batch.pos.size() != idx.n) {
+            std::cerr << args.at("frame-batch") << " has " << frame_batch.pos.size()
+                << " segments, the index has " << idx.n << std::endl;
+            exit(1);
+        }
+
+        for (int i = 0; i < idx.n; ++i) {
+            segs.push_back(frame_batch.at(i));
+        }
+    }
+
+    lsh::tables tables;
+
+    {
+        profile::scope prof { "lsh_build" };
+        tables = lsh::build(idx, ntable, nbit, seed, pool);
+    }
+
+    // rows keep the kept candidates nearest first; with --rerank the
+    // nearest rerank of them by embedding are re-scored with dtw
+    int keep = std::max(k, rerank);
+
+    std::vector<std::vector<std::pair<double, int>>> neighbors;
+    neighbors.resize(idx.n);
+
+    std::vector<long> ncand;
+    ncand.resize(idx.n);
+
+    int nchunk = std::max<int>(1, std::min<int>(idx.n, 4 * pool.size()));
+
+    {
+        profile::scope prof { "knn" };
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) idx.n * c / nchunk;
+            int end = (long) idx.n * (c + 1) / nchunk;
+
+            la::vector<double> v;
+            std::vector<int> cand;
+            std::vector<std::pair<double, int>> heap;
+
+            for (int i = begin; i < end; ++i) {
+                idx.row(i, v);
+                lsh::candidates(tables, v.data(), cand);
+
+                ncand[i] = cand.size();
+
+                heap.clear();
+
+                for (int j: cand) {
+                    if (j == i) {
+                        continue;
+                    }
+
+                    // rows are normalized, so |x - y|^2 = 2 - 2 x . y
+                    double dist = std::sqrt(std::max(0.0, 2 - 2 * idx.dot(j, v.data())));
+
+                    if (heap.size() < keep) {
+                        heap.push_back(std::make_pair(dist, j));
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (dist < heap.front().first) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = std::make_pair(dist, j);
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+
+                std::sort(heap.begin(), heap.end());
+
+                if (rerank > 0) {
+                    for (auto& p: heap) {
+                        p.first = dtw::dtw(segs[i], segs[p.second]);
+                    }
+
+                    std::sort(heap.begin(), heap.end());
+                }
+
+                if (heap.size() > k) {
+                    heap.resize(k);
+                }
+
+                neighbors[i] = heap;
+            }
+        });
+    }
+
+    knn::graph g;
+    g.n = idx.n;
+    g.k = k;
+
+    g.offset.push_back(0);
+
+    long total_cand = 0;
+
+    for (int i = 0; i < idx.n; ++i) {
+        for (auto& p: neighbors[i]) {
+            g.nbr.push_back(p.second);
+            g.dist.push_back(p.first);
+        }
+
+        g.offset.push_back(g.nbr.size());
+        total_cand += ncand[i];
+    }
+
+    {
+        profile::scope prof { "write" };
+        knn::save(args.at("output"), g, idx.ids);
+    }
+
+    profile::count("segments", idx.n);
+    profile::count("candidates", total_cand);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "segments: " << idx.n << '\n';
+        std::cout << "edges: " << g.nbr.size() << '\n';
+        std::cout << "candidates per segment: " << double(total_cand) / std::max(1, idx.n) << '\n';
+    }
+
+    // recall of the lsh neighbors against brute force on the embeddings,
+    // so only meaningful without --rerank
+    if (ncheck > 0 && rerank == 0) {
+        profile::scope prof { "check" };
+
+        std::default_random_engine gen { (unsigned long) seed };
+        std::uniform_int_distribution<int> dist { 0, idx.n - 1 };
+
+        long hit = 0;
+        long total = 0;
+
+        la::vector<double> v;
+
+        for (int c = 0; c < ncheck; ++c) {
+            int i = dist(gen);
+            idx.row(i, v);
+
+            std::vector<std::pair<double, int>> exact = embed_index::search(idx, v, k + 1, pool);
+
+            for (auto& e: exact) {
+                if (e.second == i) {
+                    continue;
+                }
+
+                ++total;
+
+                for (long o = g.offset[i]; o < g.offset[i + 1]; ++o) {
+                    if (g.nbr[o] == e.second) {
+                        ++hit;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (output::enabled(output::summary)) {
+            std::cout << "recall: " << double(hit) / std::max<long>(1, total) << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "knn.h"
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+namespace knn {
+
+    static char const graph_magic[4] = { 'K', 'N', 'N', 'G' };
+
+    void save(std::string const& filename, graph const& g,
+        std::vector<std::string> const& ids)
+    {
+        std::ofstream ofs { filename + ".tmp", std::ios::binary };
+
+        ofs.write(graph_magic, sizeof(graph_magic));
+        ofs.write(reinterpret_cast<char const*>(&g.n), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&g.k), sizeof(int));
+
+        for (long o: g.offset) {
+            int64_t v = o;
+            ofs.write(reinterpret_cast<char const*>(&v), sizeof(v));
+        }
+
+        ofs.write(reinterpret_cast<char const*>(g.nbr.data()), g.nbr.size() * sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(g.dist.data()), g.dist.size() * sizeof(float));
+
+        ofs.close();
+
+        std::ofstream ids_ofs;
+
+        if (ids.size() > 0) {
+            ids_ofs.open(filename + ".ids.tmp");
+
+            for (auto& id: ids) {
+                ids_ofs << id << '\n';
+            }
+
+            ids_ofs.close();
+        }
+
+        // both files are complete before either replaces the old pair
+        if (!ofs || !ids_ofs) {
+            std::remove((filename + ".tmp").c_str());
+            std::remove((filename + ".ids.tmp").c_str());
+            throw std::runtime_error("failed to write " + filename);
+        }
+
+        if (ids.size() > 0 && std::rename((filename + ".ids.tmp").c_str(), (filename + ".ids").c_str()) != 0) {
+            throw std::runtime_error("failed to write " + filename + ".ids");
+        }
+
+        if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    graph load(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, sizeof(magic));
+
+        if (!ifs || std::memcmp(magic, graph_magic, sizeof(magic)) != 0) {
+            throw std::runtime_error(filename + " is not a knn graph");
+        }
+
+        graph g;
+
+        ifs.read(reinterpret_cast<char*>(&g.n), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&g.k), sizeof(int));
+
+        g.offset.resize(g.n + 1);
+
+        for (int i = 0; i <= g.n; ++i) {
+            int64_t v;
+            ifs.read(reinterpret_cast<char*>(&v), sizeof(v));
+            g.offset[i] = v;
+        }
+
+        g.nbr.resize(g.offset.back());
+        g.dist.resize(g.offset.back());
+
+        ifs.read(reinterpret_cast<char*>(g.nbr.data()), g.nbr.size() * sizeof(int));
+        ifs.read(reinterpret_cast<char*>(g.dist.data()), g.dist.size() * sizeof(float));
+
+        if (!ifs) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        return g;
+    }
+
+}
@@ -0,0 +1,36 @@
+#ifndef KNN_H
+#define KNN_H
+
+#include <vector>
+#include <string>
+
+namespace knn {
+
+    /*
+     * A sparse directed graph in adjacency-list form: the neighbors of
+     * row i are nbr[offset[i]] to nbr[offset[i + 1] - 1], nearest first,
+     * with their distances in dist.  Rows with fewer candidates than k
+     * have fewer neighbors.
+     */
+    struct graph {
+        int n;
+        int k;
+
+        std::vector<long> offset;
+        std::vector<int> nbr;
+        std::vector<float> dist;
+    };
+
+    /*
+     * Magic "KNNG", n, k, the n + 1 offsets as int64, then the neighbors
+     * as int32 and the distances as float32.  ids are written to
+     * filename.ids when given.
+     */
+    void save(std::string const& filename, graph const& g,
+        std::vector<std::string> const& ids);
+
+    graph load(std::string const& filename);
+
+}
+
+#endif
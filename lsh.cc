@@ -0,0 +1,102 @@
+#include "lsh.h"
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+
+namespace lsh {
+
+    uint64_t tables::signature(int t, double const *x) const
+    {
+        uint64_t sig = 0;
+
+        for (int b = 0; b < nbit; ++b) {
+            double const *p = planes.data() + (long) (t * nbit + b) * dim;
+
+            double sum = 0;
+            for (int d = 0; d < dim; ++d) {
+                sum += p[d] * x[d];
+            }
+
+            if (sum >= 0) {
+                sig |= uint64_t(1) << b;
+            }
+        }
+
+        return sig;
+    }
+
+    void tables::bucket(int t, uint64_t sig, std::vector<int>& rows) const
+    {
+        auto const& table = buckets[t];
+
+        auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(sig, 0));
+
+        for (; it != table.end() && it->first == sig; ++it) {
+            rows.push_back(it->second);
+        }
+    }
+
+    tables build(embed_index::index const& idx, int ntable, int nbit,
+        int seed, thread_pool::pool& pool)
+    {
+        if (nbit < 1 || nbit > 64) {
+            throw std::runtime_error("lsh signatures have 1 to 64 bits");
+        }
+
+        tables result;
+        result.ntable = ntable;
+        result.nbit = nbit;
+        result.dim = idx.dim;
+
+        std::default_random_engine gen { (unsigned long) seed };
+        std::normal_distribution<double> normal;
+
+        result.planes.resize((long) ntable * nbit * idx.dim);
+
+        for (auto& v: result.planes) {
+            v = normal(gen);
+        }
+
+        result.buckets.resize(ntable);
+
+        for (auto& table: result.buckets) {
+            table.resize(idx.n);
+        }
+
+        int nchunk = std::max<int>(1, std::min<int>(idx.n, 4 * pool.size()));
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) idx.n * c / nchunk;
+            int end = (long) idx.n * (c + 1) / nchunk;
+
+            la::vector<double> v;
+
+            for (int i = begin; i < end; ++i) {
+                idx.row(i, v);
+
+                for (int t = 0; t < ntable; ++t) {
+                    result.buckets[t][i] = std::make_pair(result.signature(t, v.data()), i);
+                }
+            }
+        });
+
+        pool.parallel_for(ntable, [&](int t) {
+            std::sort(result.buckets[t].begin(), result.buckets[t].end());
+        });
+
+        return result;
+    }
+
+    void candidates(tables const& t, double const *x, std::vector<int>& result)
+    {
+        result.clear();
+
+        for (int k = 0; k < t.ntable; ++k) {
+            t.bucket(k, t.signature(k, x), result);
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+}
@@ -0,0 +1,48 @@
+#ifndef LSH_H
+#define LSH_H
+
+#include "embed-index.h"
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace lsh {
+
+    /*
+     * Random-hyperplane LSH for normalized embeddings.  Each of ntable
+     * tables hashes a row to the signs of its dot products with nbit
+     * random directions, so rows at a small angle tend to share a bucket
+     * in at least one table.  A table is the rows sorted by signature,
+     * and a bucket is a run of equal signatures.
+     */
+    struct tables {
+
+        int ntable;
+        int nbit;
+        int dim;
+
+        // direction b of table t starts at planes[(t * nbit + b) * dim]
+        std::vector<double> planes;
+
+        // sorted (signature, row) pairs, one vector per table
+        std::vector<std::vector<std::pair<uint64_t, int>>> buckets;
+
+        uint64_t signature(int t, double const *x) const;
+
+        // appends the rows sharing x's bucket in table t
+        void bucket(int t, uint64_t sig, std::vector<int>& rows) const;
+    };
+
+    tables build(embed_index::index const& idx, int ntable, int nbit,
+        int seed, thread_pool::pool& pool);
+
+    /*
+     * The union of the rows sharing a bucket with x in any table, each
+     * row once, in increasing order.
+     */
+    void candidates(tables const& t, double const *x, std::vector<int>& result);
+
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "lstm-embed.h"
+#include "nn/lstm-frame.h"
+#include "nn/lstm-tensor-tree.h"
+
+namespace lstm_embed {
+
+    std::vector<std::shared_ptr<autodiff::op_t>>
+    to_op(std::vector<std::vector<double>> const& frames,
+        autodiff::computation_graph& comp_graph)
+    {
+        std::vector<std::shared_ptr<autodiff::op_t>> result;
+
+        for (auto& f: frames) {
+            result.push_back(comp_graph.var(la::tensor<double>{la::vector<double>{f}}));
+        }
+
+        return result;
+    }
+
+    std::shared_ptr<tensor_tree::vertex> make_tensor_tree(int layer)
+    {
+        lstm::multilayer_lstm_tensor_tree_factory factory {
+            std::make_shared<lstm::bi_lstm_tensor_tree_factory>(
+            lstm::bi_lstm_tensor_tree_factory {
+                std::make_shared<lstm::dyer_lstm_tensor_tree_factory>(
+                    lstm::dyer_lstm_tensor_tree_factory{})
+            }),
+            layer
+        };
+
+        return std::shared_ptr<tensor_tree::vertex>(factory());
+    }
+
+    std::shared_ptr<autodiff::op_t>
+    embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
+        int layer,
+        std::shared_ptr<tensor_tree::vertex> var_tree,
+        arena::region *mem)
+    {
+        std::shared_ptr<lstm::step_transcriber> step;
+
+        step = arena::make_shared<lstm::dyer_lstm_step_transcriber>(mem,
+            lstm::dyer_lstm_step_transcriber{});
+
+        lstm::layered_transcriber result;
+
+        for (int i = 0; i < layer; ++i) {
+            std::shared_ptr<lstm::transcriber> trans;
+
+            trans = arena::make_shared<lstm::lstm_transcriber>(mem,
+                lstm::lstm_transcriber { step });
+
+            trans = arena::make_shared<lstm::bi_transcriber>(mem,
+                lstm::bi_transcriber { trans });
+
+            result.layer.push_back(trans);
+        }
+
+        std::shared_ptr<lstm::transcriber> trans = arena::make_shared<lstm::layered_transcriber>(mem, result);
+
+        std::vector<std::shared_ptr<autodiff::op_t>> feat = (*trans)(var_tree, seg_frames);
+
+        return autodiff::add(feat);
+    }
+
+}
@@ -0,0 +1,32 @@
+#ifndef LSTM_EMBED_H
+#define LSTM_EMBED_H
+
+#include "autodiff/autodiff.h"
+#include "nn/tensor-tree.h"
+#include "arena.h"
+#include <vector>
+#include <memory>
+
+namespace lstm_embed {
+
+    // one graph variable per frame
+    std::vector<std::shared_ptr<autodiff::op_t>>
+    to_op(std::vector<std::vector<double>> const& frames,
+        autodiff::computation_graph& comp_graph);
+
+    // parameters of layer stacked bidirectional Dyer LSTMs
+    std::shared_ptr<tensor_tree::vertex> make_tensor_tree(int layer);
+
+    /*
+     * The sum over frames of the top layer's outputs.  The transcribers
+     * are built for every call; with a region they are allocated in it.
+     */
+    std::shared_ptr<autodiff::op_t>
+    embed(std::vector<std::shared_ptr<autodiff::op_t>> const& seg_frames,
+        int layer,
+        std::shared_ptr<tensor_tree::vertex> var_tree,
+        arena::region *mem = nullptr);
+
+}
+
+#endif
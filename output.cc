@@ -0,0 +1,135 @@
+#include "output.h"
+#include "profile.h"
+#include "thread-pool.h"
+#include "ebt/ebt.h"
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+
+namespace output {
+
+    int verbosity = detail;
+
+    static char const result_magic[4] = { 'K', 'M', 'R', 'S' };
+
+    void init(std::size_t buffer_size)
+    {
+        std::ios::sync_with_stdio(false);
+
+        // never freed: std::cout is flushed after static destructors run
+        char *buf = new char[buffer_size];
+        std::cout.rdbuf()->pubsetbuf(buf, buffer_size);
+    }
+
+    void echo(int argc, char *argv[])
+    {
+        for (int i = 0; i < argc; ++i) {
+            std::cout << argv[i] << " ";
+        }
+        std::cout << '\n';
+    }
+
+    void setup(std::unordered_map<std::string, std::string> const& args)
+    {
+        if (ebt::in(std::string("profile"), args)) {
+            profile::enable(args.at("profile"));
+        }
+
+        if (ebt::in(std::string("verbosity"), args)) {
+            std::string v = args.at("verbosity");
+
+            if (v == "quiet" || v == "0") {
+                verbosity = quiet;
+            } else if (v == "results" || v == "1") {
+                verbosity = results;
+            } else if (v == "summary" || v == "2") {
+                verbosity = summary;
+            } else if (v == "detail" || v == "3") {
+                verbosity = detail;
+            } else {
+                std::cerr << "unknown verbosity " << v << std::endl;
+                exit(1);
+            }
+        }
+
+        if (ebt::in(std::string("nthread"), args)) {
+            thread_pool::set_threads(std::stoi(args.at("nthread")));
+        }
+    }
+
+    result_writer::result_writer()
+        : binary(false)
+    {}
+
+    result_writer::~result_writer()
+    {
+        close();
+    }
+
+    void result_writer::open(std::string const& filename, std::string const& format)
+    {
+        if (format == "bin") {
+            binary = true;
+        } else if (format == "tsv") {
+            binary = false;
+        } else {
+            throw std::runtime_error("unknown result format " + format);
+        }
+
+        buf.resize(1 << 20);
+        ofs.rdbuf()->pubsetbuf(buf.data(), buf.size());
+
+        ofs.open(filename, binary ? std::ios::binary : std::ios::out);
+
+        if (!ofs) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        if (binary) {
+            ofs.write(result_magic, sizeof(result_magic));
+        }
+    }
+
+    void result_writer::open(std::unordered_map<std::string, std::string> const& args)
+    {
+        if (!ebt::in(std::string("result"), args)) {
+            return;
+        }
+
+        std::string format = "tsv";
+        if (ebt::in(std::string("result-format"), args)) {
+            format = args.at("result-format");
+        }
+
+        open(args.at("result"), format);
+    }
+
+    bool result_writer::is_open() const
+    {
+        return ofs.is_open();
+    }
+
+    void result_writer::write(long sample, int cluster, double dist)
+    {
+        if (!binary) {
+            ofs << sample << '\t' << cluster << '\t' << dist << '\n';
+            return;
+        }
+
+        int64_t s = sample;
+        int32_t c = cluster;
+
+        ofs.write(reinterpret_cast<char const*>(&s), sizeof(s));
+        ofs.write(reinterpret_cast<char const*>(&c), sizeof(c));
+        ofs.write(reinterpret_cast<char const*>(&dist), sizeof(dist));
+    }
+
+    void result_writer::close()
+    {
+        if (ofs.is_open()) {
+            ofs.close();
+        }
+    }
+
+}
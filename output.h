@@ -0,0 +1,83 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+namespace output {
+
+    /*
+     * quiet: nothing per sample on stdout, for use with --result
+     * results: what the tool computes (ids, distances, segments)
+     * summary: plus per-iteration and end-of-run figures
+     * detail: plus per-sample diagnostics (the default, as before)
+     */
+    enum level {
+        quiet = 0,
+        results = 1,
+        summary = 2,
+        detail = 3
+    };
+
+    extern int verbosity;
+
+    inline bool enabled(int l)
+    {
+        return verbosity >= l;
+    }
+
+    /*
+     * Unties std::cout from stdio and gives it a buffer of buffer_size
+     * bytes.  Call before anything is written; tools then end lines with
+     * '\n' and let the buffer flush at exit.
+     */
+    void init(std::size_t buffer_size = 1 << 20);
+
+    // writes the command line to stdout, as tools do before their output
+    void echo(int argc, char *argv[]);
+
+    /*
+     * Applies the options the tools share: --profile, --verbosity (a
+     * level name or its number) and --nthread.  Call right after
+     * parse_args, before the global thread pool is first used.
+     */
+    void setup(std::unordered_map<std::string, std::string> const& args);
+
+    /*
+     * One record per sample: sample id, cluster (or label) id and the
+     * distance or loss behind the decision.  Tools without clusters write
+     * cluster 0.
+     *
+     * tsv: "sample\tcluster\tdist\n", no header
+     * bin: magic "KMRS", then packed int64 sample, int32 cluster, float64 dist
+     */
+    struct result_writer {
+
+        result_writer();
+        ~result_writer();
+
+        // format is "tsv" or "bin"
+        void open(std::string const& filename, std::string const& format);
+
+        // opens --result in --result-format (tsv by default) when given
+        void open(std::unordered_map<std::string, std::string> const& args);
+
+        bool is_open() const;
+
+        void write(long sample, int cluster, double dist);
+
+        void close();
+
+    private:
+        std::ofstream ofs;
+        bool binary;
+        std::vector<char> buf;
+
+    };
+
+}
+
+#endif
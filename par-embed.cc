@@ -0,0 +1,124 @@
+#include "par-embed.h"
+#include "spans.h"
+#include "precision.h"
+#include "profile.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace par_embed {
+
+    basis_chunks make_chunks(std::vector<seg_t> const& basis, int nchunk)
+    {
+        basis_chunks result;
+        result.size = basis.size();
+
+        nchunk = std::max<int>(1, std::min<int>(nchunk, basis.size()));
+
+        for (int c = 0; c < nchunk; ++c) {
+            int begin = (long) basis.size() * c / nchunk;
+            int end = (long) basis.size() * (c + 1) / nchunk;
+
+            result.offset.push_back(begin);
+            result.chunk.push_back(std::vector<seg_t> { basis.begin() + begin, basis.begin() + end });
+        }
+
+        return result;
+    }
+
+    void basis_chunks::make_f32()
+    {
+        chunk32.clear();
+
+        for (auto& c: chunk) {
+            chunk32.push_back(precision::convert<float>(c));
+        }
+    }
+
+    la::vector<double> dtw_embed(seg_t const& seg,
+        basis_chunks const& basis,
+        thread_pool::pool& pool)
+    {
+        return dtw_embed(std::vector<seg_t> { seg }, basis, pool).front();
+    }
+
+    std::vector<la::vector<double>> dtw_embed(std::vector<seg_t> const& segs,
+        basis_chunks const& basis,
+        thread_pool::pool& pool)
+    {
+        std::vector<la::vector<double>> result;
+        result.resize(segs.size());
+
+        for (auto& v: result) {
+            v.resize(basis.size);
+        }
+
+        int nchunk = basis.chunk.size();
+
+        // every task writes a disjoint range of one result vector,
+        // so no synchronization is needed beyond the pool's barrier
+        pool.parallel_for(segs.size() * nchunk, [&](int t) {
+            profile::scope prof { "dtw_embed_task" };
+
+            int s = t / nchunk;
+            int c = t % nchunk;
+
+            // the whole segment is the one span of its own length; the
+            // DTW rows are the worker's, so a task allocates nothing
+            int n = segs[s].size();
+
+            spans::dtw_start(segs[s], basis.chunk[c], 0, n, n, result[s].data() + basis.offset[c]);
+        });
+
+        return result;
+    }
+
+    std::vector<la::vector<double>> dtw_embed(std::vector<std::vector<std::vector<float>>> const& segs,
+        basis_chunks const& basis,
+        thread_pool::pool& pool)
+    {
+        if (basis.chunk32.size() != basis.chunk.size()) {
+            throw std::logic_error("float dtw_embed needs make_f32");
+        }
+
+        std::vector<la::vector<double>> result;
+        result.resize(segs.size());
+
+        for (auto& v: result) {
+            v.resize(basis.size);
+        }
+
+        int nchunk = basis.chunk.size();
+
+        pool.parallel_for(segs.size() * nchunk, [&](int t) {
+            profile::scope prof { "dtw_embed_task" };
+
+            int s = t / nchunk;
+            int c = t % nchunk;
+
+            // the whole segment is the one span of its own length
+            int n = segs[s].size();
+
+            spans::dtw_start(segs[s], basis.chunk32[c], 0, n, n, result[s].data() + basis.offset[c]);
+        });
+
+        return result;
+    }
+
+    std::vector<la::vector<double>> conv_embed(std::vector<seg_t> const& segs,
+        la::tensor<double> const& basis_tensor,
+        thread_pool::pool& pool)
+    {
+        std::vector<la::vector<double>> result;
+        result.resize(segs.size());
+
+        pool.parallel_for(segs.size(), [&](int s) {
+            profile::scope prof { "conv_embed_task" };
+
+            la::tensor<double> seg_tensor = embed::to_tensor(segs[s]);
+            result[s] = embed::conv_embed(seg_tensor, basis_tensor).as_vector();
+        });
+
+        return result;
+    }
+
+}
@@ -0,0 +1,55 @@
+#ifndef PAR_EMBED_H
+#define PAR_EMBED_H
+
+#include "la/la.h"
+#include "unsupseg/embed.h"
+#include "thread-pool.h"
+
+namespace par_embed {
+
+    using seg_t = embed::seg_t;
+
+    /*
+     * The basis split into contiguous chunks.  Embedding entries do not
+     * depend on each other, so each (segment, chunk) pair is one task.
+     * Tasks run spans::dtw_start, whose frame distance and recurrence are
+     * those of embed::dtw_embed, into the result in place.
+     */
+    struct basis_chunks {
+        std::vector<std::vector<seg_t>> chunk;
+        std::vector<int> offset;
+        int size;
+
+        // float copies of the chunks, for the float dtw_embed; empty
+        // until make_f32 is called
+        std::vector<std::vector<std::vector<std::vector<float>>>> chunk32;
+
+        void make_f32();
+    };
+
+    basis_chunks make_chunks(std::vector<seg_t> const& basis, int nchunk);
+
+    la::vector<double> dtw_embed(seg_t const& seg,
+        basis_chunks const& basis,
+        thread_pool::pool& pool);
+
+    std::vector<la::vector<double>> dtw_embed(std::vector<seg_t> const& segs,
+        basis_chunks const& basis,
+        thread_pool::pool& pool);
+
+    /*
+     * The same embeddings from float frames.  The costs are summed in
+     * double, so only the frames read narrow.
+     */
+    std::vector<la::vector<double>> dtw_embed(std::vector<std::vector<std::vector<float>>> const& segs,
+        basis_chunks const& basis,
+        thread_pool::pool& pool);
+
+    // conv embeddings are cheap per basis, so segments are the tasks
+    std::vector<la::vector<double>> conv_embed(std::vector<seg_t> const& segs,
+        la::tensor<double> const& basis_tensor,
+        thread_pool::pool& pool);
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "patch-dist.h"
+#include <limits>
+#include <cblas.h>
+
+namespace patch_dist {
+
+    std::vector<double> filter_energy(la::tensor<double> const& filters)
+    {
+        std::vector<double> result;
+        result.resize(filters.size(2));
+
+        for (int i = 0; i < filters.size(0); ++i) {
+            for (int j = 0; j < filters.size(1); ++j) {
+                for (int c = 0; c < filters.size(2); ++c) {
+                    result[c] += filters({i, j, c}) * filters({i, j, c});
+                }
+            }
+        }
+
+        return result;
+    }
+
+    void nearest(la::tensor<double> const& seg_tensor, la::tensor<double> const& filters,
+        std::vector<double> const& energy,
+        std::vector<double>& min, std::vector<std::pair<int, int>>& argmin)
+    {
+        la::tensor<double> seg_lin;
+        seg_lin.resize({seg_tensor.size(0) - filters.size(0) + 1,
+            seg_tensor.size(1) - filters.size(1) + 1,
+            filters.size(0) * filters.size(1)});
+
+        la::corr_linearize_valid(seg_lin, seg_tensor, filters.size(0), filters.size(1));
+
+        la::tensor<double> res = la::mul(seg_lin, filters);
+
+        min.assign(filters.size(2), std::numeric_limits<double>::infinity());
+        argmin.assign(filters.size(2), std::make_pair(0, 0));
+
+        for (int i = 0; i < res.size(0); ++i) {
+            for (int j = 0; j < res.size(1); ++j) {
+                double patch_energy = 0;
+                for (int d = 0; d < seg_lin.size(2); ++d) {
+                    patch_energy += seg_lin({i, j, d}) * seg_lin({i, j, d});
+                }
+
+                for (int c = 0; c < res.size(2); ++c) {
+                    double dist = patch_energy - 2 * res({i, j, c}) + energy[c];
+
+                    if (dist < min[c]) {
+                        min[c] = dist;
+                        argmin[c] = std::make_pair(i, j);
+                    }
+                }
+            }
+        }
+    }
+
+    filters32 make_filters32(la::tensor<double> const& filters)
+    {
+        filters32 result;
+        result.width = filters.size(0);
+        result.height = filters.size(1);
+        result.n = filters.size(2);
+
+        int size = result.width * result.height;
+
+        result.rows.resize((size_t) result.n * size);
+        result.energy.assign(result.n, 0);
+
+        for (int i = 0; i < result.width; ++i) {
+            for (int j = 0; j < result.height; ++j) {
+                for (int c = 0; c < result.n; ++c) {
+                    double v = filters({i, j, c});
+
+                    result.rows[(size_t) c * size + i * result.height + j] = v;
+                    result.energy[c] += v * v;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    void nearest(std::vector<std::vector<float>> const& seg, filters32 const& f,
+        std::vector<double>& min, std::vector<std::pair<int, int>>& argmin)
+    {
+        int nt = int(seg.size()) - f.width + 1;
+        int nq = int(seg.front().size()) - f.height + 1;
+        int npos = nt * nq;
+        int size = f.width * f.height;
+
+        min.assign(f.n, std::numeric_limits<double>::infinity());
+        argmin.assign(f.n, std::make_pair(0, 0));
+
+        // the patches linearized, one row per position, as
+        // corr_linearize_valid lays them out for the double path
+        std::vector<float> patches;
+        patches.resize((size_t) npos * size);
+
+        std::vector<double> energy;
+        energy.resize(npos);
+
+        for (int t = 0; t < nt; ++t) {
+            for (int q = 0; q < nq; ++q) {
+                float *p = patches.data() + (size_t) (t * nq + q) * size;
+                double e = 0;
+
+                for (int i = 0; i < f.width; ++i) {
+                    for (int j = 0; j < f.height; ++j) {
+                        float v = seg[t + i][q + j];
+                        p[i * f.height + j] = v;
+                        e += double(v) * v;
+                    }
+                }
+
+                energy[t * nq + q] = e;
+            }
+        }
+
+        // all dot products in one sgemm, as la::mul does with dgemm
+        std::vector<float> dot;
+        dot.resize((size_t) npos * f.n);
+
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, npos, f.n, size,
+            1.0f, patches.data(), size, f.rows.data(), size, 0.0f, dot.data(), f.n);
+
+        // positions in the order of the double path, so ties resolve the same
+        for (int k = 0; k < npos; ++k) {
+            float const *row = dot.data() + (size_t) k * f.n;
+
+            for (int c = 0; c < f.n; ++c) {
+                double dist = energy[k] - 2 * double(row[c]) + f.energy[c];
+
+                if (dist < min[c]) {
+                    min[c] = dist;
+                    argmin[c] = std::make_pair(k / nq, k % nq);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,51 @@
+#ifndef PATCH_DIST_H
+#define PATCH_DIST_H
+
+#include "la/la.h"
+#include <vector>
+
+namespace patch_dist {
+
+    // |f|^2 of every filter of a width x height x n tensor
+    std::vector<double> filter_energy(la::tensor<double> const& filters);
+
+    /*
+     * For every filter, the squared distance |p|^2 - 2 p.f + |f|^2 to its
+     * nearest patch of the segment, and the (frame, dimension) where that
+     * patch starts.  The patches are linearized by corr_linearize_valid
+     * and the dot products come from la::mul.  Ties go to the first
+     * position in frame-major order.  The segment must be at least as
+     * large as a filter.
+     */
+    void nearest(la::tensor<double> const& seg_tensor, la::tensor<double> const& filters,
+        std::vector<double> const& energy,
+        std::vector<double>& min, std::vector<std::pair<int, int>>& argmin);
+
+    /*
+     * Float copies of conv-kmeans filters (width x height x n, as in the
+     * param), one row of width * height per filter with entry (i, j) at
+     * i * height + j, and their energies in double.
+     */
+    struct filters32 {
+        int width;
+        int height;
+        int n;
+
+        std::vector<float> rows;
+        std::vector<double> energy;
+    };
+
+    filters32 make_filters32(la::tensor<double> const& filters);
+
+    /*
+     * The double nearest over float frames.  Patch entry (i, j) is frame
+     * t + i, dimension q + j, matching filter entry (i, j).  The dot
+     * products come from one sgemm over the linearized patches, in place
+     * of the dgemm of the double path; energies are summed in double.
+     */
+    void nearest(std::vector<std::vector<float>> const& seg, filters32 const& f,
+        std::vector<double>& min, std::vector<std::pair<int, int>>& argmin);
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "thread-pool.h"
+#include "kmeans.h"
+#include "pq.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "pq-assign",
+        "Assign product-quantized codes to k-means centers",
+        {
+            {"codes", "", true},
+            {"codebook", "", true},
+            {"centers", "", true},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    output::result_writer result;
+    result.open(args);
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    pq::codebook cb = pq::load(args.at("codebook"));
+
+    pq::code_file codes;
+    codes.open(args.at("codes"));
+
+    if (codes.m != cb.m || codes.ksub != cb.ksub) {
+        std::cerr << "codes have " << codes.m << " subspaces of " << codes.ksub
+            << " centroids, the codebook has " << cb.m << " of " << cb.ksub << std::endl;
+        exit(1);
+    }
+
+    kmeans::center_file centers;
+    centers.open(args.at("centers"));
+
+    if (centers.dim != cb.dim) {
+        std::cerr << "centers have dimension " << centers.dim << ", the codebook has " << cb.dim << std::endl;
+        exit(1);
+    }
+
+    // one table per center; the centers play the role of exact queries
+    int table_size = cb.m * cb.ksub;
+    std::vector<double> tables;
+    tables.resize((long) centers.k * table_size);
+
+    {
+        profile::scope prof { "adc_table" };
+
+        pool.parallel_for(centers.k, [&](int k) {
+            std::vector<double> table;
+            pq::adc_table(cb, centers.center(k), table);
+            std::copy(table.begin(), table.end(), tables.begin() + (long) k * table_size);
+        });
+    }
+
+    std::vector<int> cluster;
+    std::vector<double> dist;
+    cluster.resize(codes.n);
+    dist.resize(codes.n);
+
+    int nchunk = std::max<int>(1, std::min<int>(codes.n, 4 * pool.size()));
+
+    {
+        profile::scope prof { "adc_assign" };
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) codes.n * c / nchunk;
+            int end = (long) codes.n * (c + 1) / nchunk;
+
+            for (int i = begin; i < end; ++i) {
+                uint8_t const *code = codes.code(i);
+
+                double min = std::numeric_limits<double>::infinity();
+                int argmin = 0;
+
+                for (int k = 0; k < centers.k; ++k) {
+                    double d = pq::adc_distance(tables.data() + (long) k * table_size,
+                        cb.ksub, code, cb.m);
+
+                    if (d < min) {
+                        min = d;
+                        argmin = k;
+                    }
+                }
+
+                cluster[i] = argmin;
+                dist[i] = std::sqrt(std::max(0.0, min));
+            }
+        });
+    }
+
+    profile::count("segments", codes.n);
+
+    std::vector<std::pair<double, int>> stat;
+    stat.resize(centers.k);
+
+    for (int i = 0; i < codes.n; ++i) {
+        stat[cluster[i]].first += dist[i];
+        stat[cluster[i]].second += 1;
+
+        if (output::enabled(output::results)) {
+            std::cout << "sample: " << i << '\n';
+            std::cout << "id: " << cluster[i] << '\n';
+            std::cout << '\n';
+        }
+
+        if (result.is_open()) {
+            result.write(i, cluster[i], dist[i]);
+        }
+    }
+
+    if (output::enabled(output::summary)) {
+        for (int k = 0; k < stat.size(); ++k) {
+            std::cout << "cluster " << k << ": " << stat[k].first / stat[k].second << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <algorithm>
+#include "thread-pool.h"
+#include "embed-index.h"
+#include "pq.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "pq-encode",
+        "Code every row of an embedding index with a product quantizer",
+        {
+            {"index", "", true},
+            {"codebook", "", true},
+            {"output", "", true},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    embed_index::index idx;
+    idx.open(args.at("index"));
+
+    pq::codebook cb = pq::load(args.at("codebook"));
+
+    if (cb.dim != idx.dim) {
+        std::cerr << "codebook has dimension " << cb.dim << ", the index has " << idx.dim << std::endl;
+        exit(1);
+    }
+
+    pq::code_writer writer;
+    writer.open(args.at("output"), idx.n, cb.m, cb.ksub);
+
+    int batch_size = 4096;
+    std::vector<uint8_t> codes;
+
+    for (int n = 0; n < idx.n; n += batch_size) {
+        int size = std::min(batch_size, idx.n - n);
+        codes.resize((long) size * cb.m);
+
+        {
+            profile::scope prof { "pq_encode" };
+
+            pool.parallel_for(size, [&](int i) {
+                la::vector<double> v;
+                idx.row(n + i, v);
+                pq::encode(cb, v.data(), codes.data() + (long) i * cb.m);
+            });
+        }
+
+        for (int i = 0; i < size; ++i) {
+            writer.write(codes.data() + (long) i * cb.m, idx.ids[n + i]);
+        }
+    }
+
+    writer.close();
+
+    if (output::enabled(output::summary)) {
+        std::cout << "codes: " << idx.n << " x " << cb.m << " bytes" << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <random>
+#include <algorithm>
+#include "thread-pool.h"
+#include "embed-index.h"
+#include "pq.h"
+#include "profile.h"
+#include "output.h"
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "pq-train",
+        "Train a product quantizer on a sample of an embedding index",
+        {
+            {"index", "", true},
+            {"m", "number of subspaces", true},
+            {"ksub", "centroids per subspace, at most 256", false},
+            {"iter", "", false},
+            {"sample", "", false},
+            {"seed", "", false},
+            {"output", "", true},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    int m = std::stoi(args.at("m"));
+
+    int ksub = 256;
+    if (ebt::in(std::string("ksub"), args)) {
+        ksub = std::stoi(args.at("ksub"));
+    }
+
+    int iter = 10;
+    if (ebt::in(std::string("iter"), args)) {
+        iter = std::stoi(args.at("iter"));
+    }
+
+    int nsample = 100000;
+    if (ebt::in(std::string("sample"), args)) {
+        nsample = std::stoi(args.at("sample"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    embed_index::index idx;
+    idx.open(args.at("index"));
+
+    std::vector<int> rows;
+    for (int i = 0; i < idx.n; ++i) {
+        rows.push_back(i);
+    }
+
+    std::default_random_engine gen { (unsigned long) seed };
+    std::shuffle(rows.begin(), rows.end(), gen);
+
+    if (rows.size() > nsample) {
+        rows.resize(nsample);
+    }
+
+    std::vector<la::vector<double>> sample;
+    sample.resize(rows.size());
+
+    for (int i = 0; i < rows.size(); ++i) {
+        idx.row(rows[i], sample[i]);
+    }
+
+    pq::codebook cb;
+
+    {
+        profile::scope prof { "pq_train" };
+        cb = pq::train(sample, m, ksub, iter, seed, pool);
+    }
+
+    // quantization error on the training sample
+    double err = 0;
+    std::vector<uint8_t> code;
+    code.resize(cb.m);
+    la::vector<double> x;
+
+    for (auto& v: sample) {
+        pq::encode(cb, v.data(), code.data());
+        pq::decode(cb, code.data(), x);
+        err += la::dot(la::sub(v, x), la::sub(v, x));
+    }
+
+    if (output::enabled(output::summary)) {
+        std::cout << "sample: " << sample.size() << '\n';
+        std::cout << "subspaces: " << cb.m << " centroids: " << cb.ksub << '\n';
+        std::cout << "mse: " << err / sample.size() << '\n';
+    }
+
+    pq::save(args.at("output"), cb);
+
+    return 0;
+}
@@ -0,0 +1,404 @@
+#include "pq.h"
+#include "embed-index.h"
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace pq {
+
+    static char const codebook_magic[4] = { 'P', 'Q', 'C', 'B' };
+    static char const codes_magic[4] = { 'P', 'Q', 'C', 'D' };
+
+    struct codes_header {
+        char magic[4];
+        int n;
+        int m;
+        int ksub;
+    };
+
+    int codebook::sub_dim(int j) const
+    {
+        return begin[j + 1] - begin[j];
+    }
+
+    static double sq_dist(double const *a, double const *b, int d)
+    {
+        double sum = 0;
+
+        for (int i = 0; i < d; ++i) {
+            double diff = a[i] - b[i];
+            sum += diff * diff;
+        }
+
+        return sum;
+    }
+
+    codebook train(std::vector<la::vector<double>> const& sample,
+        int m, int ksub, int iter, int seed, thread_pool::pool& pool)
+    {
+        if (sample.size() == 0) {
+            throw std::runtime_error("no vectors to train the quantizer on");
+        }
+
+        codebook cb;
+        cb.dim = sample.front().size();
+        cb.m = std::max(1, std::min(m, cb.dim));
+        cb.ksub = std::max(1, std::min<int>({ ksub, 256, int(sample.size()) }));
+
+        for (int j = 0; j <= cb.m; ++j) {
+            cb.begin.push_back((long) cb.dim * j / cb.m);
+        }
+
+        cb.centroids.resize(cb.m);
+
+        // subspaces are independent k-means problems
+        pool.parallel_for(cb.m, [&](int j) {
+            int d = cb.sub_dim(j);
+            int off = cb.begin[j];
+            int n = sample.size();
+
+            std::vector<double> points;
+            points.resize((long) n * d);
+
+            for (int i = 0; i < n; ++i) {
+                std::copy(sample[i].data() + off, sample[i].data() + off + d, points.data() + (long) i * d);
+            }
+
+            std::vector<int> perm;
+            for (int i = 0; i < n; ++i) {
+                perm.push_back(i);
+            }
+
+            std::default_random_engine gen { (unsigned long) (seed + j) };
+            std::shuffle(perm.begin(), perm.end(), gen);
+
+            std::vector<double>& c = cb.centroids[j];
+            c.resize((long) cb.ksub * d);
+
+            for (int k = 0; k < cb.ksub; ++k) {
+                std::copy(points.data() + (long) perm[k] * d, points.data() + (long) (perm[k] + 1) * d,
+                    c.data() + (long) k * d);
+            }
+
+            std::vector<double> sum;
+            std::vector<int> count;
+
+            for (int it = 0; it < iter; ++it) {
+                sum.assign((long) cb.ksub * d, 0);
+                count.assign(cb.ksub, 0);
+
+                for (int i = 0; i < n; ++i) {
+                    double const *x = points.data() + (long) i * d;
+
+                    double min = std::numeric_limits<double>::infinity();
+                    int argmin = 0;
+
+                    for (int k = 0; k < cb.ksub; ++k) {
+                        double dist = sq_dist(x, c.data() + (long) k * d, d);
+
+                        if (dist < min) {
+                            min = dist;
+                            argmin = k;
+                        }
+                    }
+
+                    for (int t = 0; t < d; ++t) {
+                        sum[(long) argmin * d + t] += x[t];
+                    }
+
+                    count[argmin] += 1;
+                }
+
+                // an empty centroid keeps its previous value
+                for (int k = 0; k < cb.ksub; ++k) {
+                    if (count[k] == 0) {
+                        continue;
+                    }
+
+                    for (int t = 0; t < d; ++t) {
+                        c[(long) k * d + t] = sum[(long) k * d + t] / count[k];
+                    }
+                }
+            }
+        });
+
+        return cb;
+    }
+
+    void encode(codebook const& cb, double const *x, uint8_t *code)
+    {
+        for (int j = 0; j < cb.m; ++j) {
+            int d = cb.sub_dim(j);
+            double const *xj = x + cb.begin[j];
+
+            double min = std::numeric_limits<double>::infinity();
+            int argmin = 0;
+
+            for (int k = 0; k < cb.ksub; ++k) {
+                double dist = sq_dist(xj, cb.centroids[j].data() + (long) k * d, d);
+
+                if (dist < min) {
+                    min = dist;
+                    argmin = k;
+                }
+            }
+
+            code[j] = argmin;
+        }
+    }
+
+    void decode(codebook const& cb, uint8_t const *code, la::vector<double>& x)
+    {
+        x.resize(cb.dim);
+
+        for (int j = 0; j < cb.m; ++j) {
+            int d = cb.sub_dim(j);
+            double const *c = cb.centroids[j].data() + (long) code[j] * d;
+
+            for (int t = 0; t < d; ++t) {
+                x(cb.begin[j] + t) = c[t];
+            }
+        }
+    }
+
+    void save(std::string const& filename, codebook const& cb)
+    {
+        std::ofstream ofs { filename + ".tmp", std::ios::binary };
+
+        ofs.write(codebook_magic, sizeof(codebook_magic));
+        ofs.write(reinterpret_cast<char const*>(&cb.dim), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&cb.m), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&cb.ksub), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(cb.begin.data()), cb.begin.size() * sizeof(int));
+
+        for (auto& c: cb.centroids) {
+            ofs.write(reinterpret_cast<char const*>(c.data()), c.size() * sizeof(double));
+        }
+
+        ofs.close();
+
+        if (!ofs || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    codebook load(std::string const& filename)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        char magic[4];
+        ifs.read(magic, sizeof(magic));
+
+        if (!ifs || std::memcmp(magic, codebook_magic, sizeof(magic)) != 0) {
+            throw std::runtime_error(filename + " is not a pq codebook");
+        }
+
+        codebook cb;
+
+        ifs.read(reinterpret_cast<char*>(&cb.dim), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&cb.m), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&cb.ksub), sizeof(int));
+
+        if (!ifs || cb.dim <= 0 || cb.m <= 0 || cb.m > cb.dim || cb.ksub <= 0 || cb.ksub > 256) {
+            throw std::runtime_error(filename + " is not a pq codebook");
+        }
+
+        // checked before anything is sized from the header
+        ifs.seekg(0, std::ios::end);
+        size_t length = ifs.tellg();
+        ifs.seekg(sizeof(codebook_magic) + 3 * sizeof(int));
+
+        if (length != sizeof(codebook_magic) + (4 + (size_t) cb.m) * sizeof(int)
+                + (size_t) cb.ksub * cb.dim * sizeof(double)) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        cb.begin.resize(cb.m + 1);
+        ifs.read(reinterpret_cast<char*>(cb.begin.data()), cb.begin.size() * sizeof(int));
+
+        // subspaces must tile [0, dim) in order
+        if (cb.begin.front() != 0 || cb.begin.back() != cb.dim) {
+            throw std::runtime_error(filename + " has inconsistent subspaces");
+        }
+
+        for (int j = 0; j < cb.m; ++j) {
+            if (cb.sub_dim(j) <= 0) {
+                throw std::runtime_error(filename + " has inconsistent subspaces");
+            }
+        }
+
+        cb.centroids.resize(cb.m);
+
+        for (int j = 0; j < cb.m; ++j) {
+            cb.centroids[j].resize((long) cb.ksub * cb.sub_dim(j));
+            ifs.read(reinterpret_cast<char*>(cb.centroids[j].data()),
+                cb.centroids[j].size() * sizeof(double));
+        }
+
+        if (!ifs) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        return cb;
+    }
+
+    void adc_table(codebook const& cb, double const *q, std::vector<double>& table)
+    {
+        table.resize(cb.m * cb.ksub);
+
+        for (int j = 0; j < cb.m; ++j) {
+            int d = cb.sub_dim(j);
+            double const *qj = q + cb.begin[j];
+
+            for (int k = 0; k < cb.ksub; ++k) {
+                table[j * cb.ksub + k] = sq_dist(qj, cb.centroids[j].data() + (long) k * d, d);
+            }
+        }
+    }
+
+    code_file::code_file()
+        : n(0), m(0), ksub(0), base(nullptr), length(0), data(nullptr)
+    {}
+
+    code_file::~code_file()
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    void code_file::open(std::string const& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            throw std::runtime_error("failed to map " + filename);
+        }
+
+        if (length < sizeof(codes_header)) {
+            throw std::runtime_error(filename + " is not a pq code file");
+        }
+
+        codes_header const& h = *static_cast<codes_header const*>(base);
+
+        if (std::memcmp(h.magic, codes_magic, sizeof(codes_magic)) != 0
+                || h.n < 0 || h.m <= 0 || h.ksub <= 0 || h.ksub > 256) {
+            throw std::runtime_error(filename + " is not a pq code file");
+        }
+
+        if (length != sizeof(codes_header) + (size_t) h.n * h.m) {
+            throw std::runtime_error(filename + " is truncated");
+        }
+
+        n = h.n;
+        m = h.m;
+        ksub = h.ksub;
+        data = static_cast<uint8_t const*>(base) + sizeof(codes_header);
+
+        ids.clear();
+
+        std::ifstream ids_ifs { filename + ".ids" };
+        std::string line;
+
+        while (std::getline(ids_ifs, line)) {
+            ids.push_back(line);
+        }
+
+        if (ids.size() != n) {
+            throw std::runtime_error(filename + ".ids does not match the codes");
+        }
+    }
+
+    uint8_t const* code_file::code(int i) const
+    {
+        return data + (size_t) i * m;
+    }
+
+    void code_writer::open(std::string const& filename, int n, int m, int ksub)
+    {
+        this->filename = filename;
+        this->n = n;
+        this->m = m;
+        written = 0;
+
+        buf.resize(1 << 20);
+        ofs.rdbuf()->pubsetbuf(buf.data(), buf.size());
+
+        ofs.open(filename + ".tmp", std::ios::binary);
+        ids_ofs.open(filename + ".ids.tmp");
+
+        if (!ofs || !ids_ofs) {
+            throw std::runtime_error("failed to open " + filename + ".tmp");
+        }
+
+        codes_header h;
+        std::memcpy(h.magic, codes_magic, sizeof(codes_magic));
+        h.n = n;
+        h.m = m;
+        h.ksub = ksub;
+
+        ofs.write(reinterpret_cast<char const*>(&h), sizeof(h));
+    }
+
+    void code_writer::write(uint8_t const *code, std::string const& id)
+    {
+        ofs.write(reinterpret_cast<char const*>(code), m);
+        ids_ofs << id << '\n';
+        ++written;
+    }
+
+    void code_writer::close()
+    {
+        if (written != n) {
+            throw std::runtime_error(filename + ": expected " + std::to_string(n)
+                + " codes, got " + std::to_string(written));
+        }
+
+        ofs.close();
+        ids_ofs.close();
+
+        // both files are complete before either replaces the old pair
+        if (!ofs || !ids_ofs) {
+            std::remove((filename + ".tmp").c_str());
+            std::remove((filename + ".ids.tmp").c_str());
+            throw std::runtime_error("failed to write " + filename);
+        }
+
+        if (std::rename((filename + ".ids.tmp").c_str(), (filename + ".ids").c_str()) != 0
+                || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to rename " + filename + ".tmp");
+        }
+    }
+
+    std::vector<std::pair<double, int>> search(code_file const& codes,
+        codebook const& cb, la::vector<double> const& q, int topn,
+        thread_pool::pool& pool)
+    {
+        std::vector<double> table;
+        adc_table(cb, q.data(), table);
+
+        return embed_index::top_n(codes.n, topn, [&](int i) {
+            return adc_distance(table.data(), cb.ksub, codes.code(i), cb.m);
+        }, pool);
+    }
+
+}
@@ -0,0 +1,126 @@
+#ifndef PQ_H
+#define PQ_H
+
+#include "la/la.h"
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+namespace pq {
+
+    /*
+     * Product quantizer: the dim coordinates are split into m contiguous
+     * subspaces, each with its own ksub <= 256 centroids, so a vector is
+     * coded in m bytes.
+     */
+    struct codebook {
+        int dim;
+        int m;
+        int ksub;
+
+        // subspace j covers [begin[j], begin[j + 1])
+        std::vector<int> begin;
+
+        // centroid c of subspace j starts at centroids[j][c * sub_dim(j)]
+        std::vector<std::vector<double>> centroids;
+
+        int sub_dim(int j) const;
+    };
+
+    codebook train(std::vector<la::vector<double>> const& sample,
+        int m, int ksub, int iter, int seed, thread_pool::pool& pool);
+
+    void encode(codebook const& cb, double const *x, uint8_t *code);
+
+    void decode(codebook const& cb, uint8_t const *code, la::vector<double>& x);
+
+    void save(std::string const& filename, codebook const& cb);
+
+    codebook load(std::string const& filename);
+
+    /*
+     * Squared distances from q to every centroid, m x ksub.  With it the
+     * distance from q to a coded vector is m table lookups (asymmetric
+     * distance computation: q stays exact, only the database is coded).
+     */
+    void adc_table(codebook const& cb, double const *q, std::vector<double>& table);
+
+    inline double adc_distance(double const *table, int ksub,
+        uint8_t const *code, int m)
+    {
+        double sum = 0;
+
+        for (int j = 0; j < m; ++j) {
+            sum += table[j * ksub + code[j]];
+        }
+
+        return sum;
+    }
+
+    /*
+     * n codes of m bytes, mapped read-only, made with a codebook of ksub
+     * centroids per subspace.  Segment names are in filename.ids, in row
+     * order.
+     */
+    struct code_file {
+
+        code_file();
+        ~code_file();
+
+        code_file(code_file const&) = delete;
+        code_file& operator=(code_file const&) = delete;
+
+        void open(std::string const& filename);
+
+        int n;
+        int m;
+        int ksub;
+
+        std::vector<std::string> ids;
+
+        uint8_t const* code(int i) const;
+
+    private:
+        void *base;
+        size_t length;
+
+        uint8_t const *data;
+
+    };
+
+    struct code_writer {
+
+        void open(std::string const& filename, int n, int m, int ksub);
+
+        void write(uint8_t const *code, std::string const& id);
+
+        // renames filename.tmp to filename
+        void close();
+
+    private:
+        std::string filename;
+        std::ofstream ofs;
+        std::ofstream ids_ofs;
+
+        int n;
+        int m;
+        int written;
+
+        std::vector<char> buf;
+
+    };
+
+    /*
+     * The topn codes nearest to q by ADC, as (squared distance, row)
+     * pairs in increasing distance.
+     */
+    std::vector<std::pair<double, int>> search(code_file const& codes,
+        codebook const& cb, la::vector<double> const& q, int topn,
+        thread_pool::pool& pool);
+
+}
+
+#endif
@@ -0,0 +1,18 @@
+#include "precision.h"
+
+namespace precision {
+
+    bool parse(std::string const& name, scalar& s)
+    {
+        if (name == "double") {
+            s = scalar::f64;
+        } else if (name == "float") {
+            s = scalar::f32;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,52 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <vector>
+#include <string>
+
+namespace precision {
+
+    /*
+     * The scalar type of the frames, filters and center rows read by the
+     * distance kernels (DTW, conv-kmeans patch distances, nearest
+     * center).  f32 halves their memory traffic; frame distances, dot
+     * products, accumulated costs, sums and losses stay double either way.
+     */
+    enum class scalar {
+        f64,
+        f32
+    };
+
+    // "double" or "float"
+    bool parse(std::string const& name, scalar& s);
+
+    template <class T>
+    std::vector<std::vector<T>> convert(std::vector<std::vector<double>> const& frames)
+    {
+        std::vector<std::vector<T>> result;
+        result.resize(frames.size());
+
+        for (int t = 0; t < frames.size(); ++t) {
+            result[t].assign(frames[t].begin(), frames[t].end());
+        }
+
+        return result;
+    }
+
+    template <class T>
+    std::vector<std::vector<std::vector<T>>> convert(
+        std::vector<std::vector<std::vector<double>>> const& segs)
+    {
+        std::vector<std::vector<std::vector<T>>> result;
+        result.reserve(segs.size());
+
+        for (auto& s: segs) {
+            result.push_back(convert<T>(s));
+        }
+
+        return result;
+    }
+
+}
+
+#endif
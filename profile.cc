@@ -0,0 +1,174 @@
+#include "profile.h"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <thread>
+
+namespace profile {
+
+    bool active = false;
+
+    struct event {
+        char const *name;
+        long begin_us;
+        long dur_us;
+    };
+
+    struct stage {
+        long calls = 0;
+        double total_us = 0;
+        double max_us = 0;
+    };
+
+    // each thread appends to its own buffer; the mutex only guards
+    // registration and the final dump
+    struct thread_buffer {
+        int tid;
+        std::vector<event> events;
+        std::unordered_map<char const*, stage> stages;
+        std::unordered_map<char const*, long> counts;
+    };
+
+    static std::mutex registry_mutex;
+    static std::vector<std::unique_ptr<thread_buffer>> registry;
+    static std::string output;
+    static std::chrono::steady_clock::time_point epoch;
+
+    // beyond this many events per thread only the summary is kept
+    static size_t const max_events = 1 << 20;
+
+    static thread_buffer& local()
+    {
+        thread_local thread_buffer *buf = nullptr;
+
+        if (buf == nullptr) {
+            std::lock_guard<std::mutex> lock { registry_mutex };
+            registry.push_back(std::unique_ptr<thread_buffer>(new thread_buffer));
+            buf = registry.back().get();
+            buf->tid = registry.size() - 1;
+        }
+
+        return *buf;
+    }
+
+    void record(char const *name,
+        std::chrono::steady_clock::time_point begin,
+        std::chrono::steady_clock::time_point end)
+    {
+        thread_buffer& buf = local();
+
+        long begin_us = std::chrono::duration_cast<std::chrono::microseconds>(begin - epoch).count();
+        long dur_us = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+        if (buf.events.size() < max_events) {
+            buf.events.push_back(event { name, begin_us, dur_us });
+        }
+
+        stage& s = buf.stages[name];
+        s.calls += 1;
+        s.total_us += std::chrono::duration<double, std::micro>(end - begin).count();
+        s.max_us = std::max(s.max_us, std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+
+    void add_count(char const *name, long n)
+    {
+        local().counts[name] += n;
+    }
+
+    static void finish()
+    {
+        active = false;
+
+        std::lock_guard<std::mutex> lock { registry_mutex };
+
+        std::ofstream ofs { output };
+
+        ofs << "{\"traceEvents\":[";
+
+        bool first = true;
+
+        for (auto& buf: registry) {
+            for (auto& e: buf->events) {
+                ofs << (first ? "\n" : ",\n");
+                ofs << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buf->tid
+                    << ",\"ts\":" << e.begin_us << ",\"dur\":" << e.dur_us << "}";
+                first = false;
+            }
+        }
+
+        std::map<std::string, stage> stages;
+        std::map<std::string, long> counts;
+
+        for (auto& buf: registry) {
+            for (auto& p: buf->stages) {
+                stage& s = stages[p.first];
+                s.calls += p.second.calls;
+                s.total_us += p.second.total_us;
+                s.max_us = std::max(s.max_us, p.second.max_us);
+            }
+
+            for (auto& p: buf->counts) {
+                counts[p.first] += p.second;
+            }
+        }
+
+        long now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+
+        for (auto& p: counts) {
+            ofs << (first ? "\n" : ",\n");
+            ofs << "{\"name\":\"" << p.first << "\",\"ph\":\"C\",\"pid\":0,\"tid\":0,\"ts\":" << now_us
+                << ",\"args\":{\"" << p.first << "\":" << p.second << "}}";
+            first = false;
+        }
+
+        ofs << "\n]}\n";
+        ofs.close();
+
+        double wall_us = now_us;
+
+        std::cerr << std::endl;
+        std::cerr << std::left << std::setw(28) << "stage" << std::right
+            << std::setw(12) << "calls" << std::setw(14) << "total s"
+            << std::setw(14) << "mean ms" << std::setw(14) << "max ms"
+            << std::setw(10) << "% wall" << std::endl;
+
+        std::cerr << std::fixed;
+
+        for (auto& p: stages) {
+            stage const& s = p.second;
+
+            std::cerr << std::left << std::setw(28) << p.first << std::right
+                << std::setw(12) << s.calls
+                << std::setw(14) << std::setprecision(3) << s.total_us / 1e6
+                << std::setw(14) << std::setprecision(3) << s.total_us / s.calls / 1e3
+                << std::setw(14) << std::setprecision(3) << s.max_us / 1e3
+                << std::setw(10) << std::setprecision(1) << 100 * s.total_us / wall_us
+                << std::endl;
+        }
+
+        for (auto& p: counts) {
+            std::cerr << std::left << std::setw(28) << p.first << std::right
+                << std::setw(12) << p.second << std::endl;
+        }
+
+        std::cerr << "wall: " << std::setprecision(3) << wall_us / 1e6 << " s" << std::endl;
+        std::cerr.unsetf(std::ios::floatfield);
+    }
+
+    void enable(std::string const& filename)
+    {
+        output = filename;
+        epoch = std::chrono::steady_clock::now();
+        active = true;
+
+        std::atexit(finish);
+    }
+
+}
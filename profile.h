@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+#include <chrono>
+
+namespace profile {
+
+    extern bool active;
+
+    /*
+     * Turns on recording.  At exit the events are written to filename as
+     * Chrome trace-event JSON (load it in chrome://tracing or Perfetto)
+     * and a per-stage summary goes to stderr.
+     */
+    void enable(std::string const& filename);
+
+    void record(char const *name,
+        std::chrono::steady_clock::time_point begin,
+        std::chrono::steady_clock::time_point end);
+
+    void add_count(char const *name, long n);
+
+    /*
+     * Times the enclosing block.  When profiling is off this is a single
+     * branch on construction and one on destruction.
+     */
+    struct scope {
+
+        scope(char const *name)
+            : name(name)
+        {
+            if (active) {
+                begin = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~scope()
+        {
+            if (active) {
+                record(name, begin, std::chrono::steady_clock::now());
+            }
+        }
+
+        char const *name;
+        std::chrono::steady_clock::time_point begin;
+
+    };
+
+    inline void count(char const *name, long n = 1)
+    {
+        if (active) {
+            add_count(name, n);
+        }
+    }
+
+}
+
+#endif
@@ -2,20 +2,85 @@
 #include "ebt/ebt.h"
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include "speech/speech.h"
-#include "seg/dtw.h"
+#include "text-batch.h"
+#include "thread-pool.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 
+namespace {
+
+    // segments [begin, end) of an utterance
+    struct slice {
+        long utt;
+        long begin;
+        long end;
+    };
+
+    void append_text(std::string& out, long n,
+        std::vector<std::vector<double>> const& frames, int start_time, int end_time)
+    {
+        char buf[32];
+
+        out += std::to_string(n);
+        out += ".logmel\n";
+
+        for (int i = start_time; i < end_time; ++i) {
+            for (int j = 0; j < frames[i].size(); ++j) {
+                int len = std::snprintf(buf, sizeof(buf), "%g", frames[i][j]);
+                out.append(buf, len);
+
+                if (j != frames[i].size() - 1) {
+                    out += ' ';
+                }
+            }
+
+            out += '\n';
+        }
+
+        out += ".\n";
+    }
+
+    void append_bin(std::string& out, long n,
+        std::vector<std::vector<double>> const& frames, int start_time, int end_time)
+    {
+        int nframes = end_time - start_time;
+        int dim = frames.size() == 0 ? 0 : frames.front().size();
+
+        long n64 = n;
+        out.append(reinterpret_cast<char const*>(&n64), sizeof(n64));
+        out.append(reinterpret_cast<char const*>(&nframes), sizeof(int));
+        out.append(reinterpret_cast<char const*>(&dim), sizeof(int));
+
+        for (int i = start_time; i < end_time; ++i) {
+            for (int j = 0; j < dim; ++j) {
+                float v = frames[i][j];
+                out.append(reinterpret_cast<char const*>(&v), sizeof(float));
+            }
+        }
+    }
+
+}
+
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
-        "dtw",
-        "Calculate DTW distance",
+        "random-seg",
+        "Sample random segments from utterances",
         {
             {"frame-batch", "", true},
             {"nsegs", "", true},
-            {"duration", "", true},
+            {"duration", "comma-separated durations to draw from", true},
             {"seed", "", false},
+            {"output", "default stdout", false},
+            {"output-format", "text (default) or bin", false},
+            {"nthread", "", false},
+            {"profile", "", false},
         }
     };
 
@@ -26,18 +91,24 @@ int main(int argc, char *argv[])
 
     std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
 
-    speech::batch_indices frame_batch;
+    output::setup(args);
 
-    frame_batch.open(args.at("frame-batch"));
-
-    int nsegs = std::stoi(args.at("nsegs"));
+    long nsegs = std::stol(args.at("nsegs"));
 
     int seed = 1;
     if (ebt::in(std::string("seed"), args)) {
         seed = std::stoi(args.at("seed"));
     }
 
-    std::default_random_engine gen {seed};
+    std::string format = "text";
+    if (ebt::in(std::string("output-format"), args)) {
+        format = args.at("output-format");
+    }
+
+    if (format != "text" && format != "bin") {
+        std::cerr << "unknown output format " << format << std::endl;
+        exit(1);
+    }
 
     std::vector<std::string> parts = ebt::split(args.at("duration"), ",");
     std::vector<int> durs;
@@ -47,38 +118,129 @@ int main(int argc, char *argv[])
 
     int max_dur = *std::max_element(durs.begin(), durs.end());
 
-    std::uniform_int_distribution<int> dur_dist{0, int(durs.size() - 1)};
+    thread_pool::pool& pool = thread_pool::global();
+
+    text_batch::file frame_batch;
+    frame_batch.open(args.at("frame-batch"), pool);
+
+    std::ofstream output_file;
+
+    if (ebt::in(std::string("output"), args)) {
+        output_file.open(args.at("output"), std::ios::binary);
 
-    int nsample = 0;
+        if (!output_file) {
+            std::cerr << "failed to open " << args.at("output") << std::endl;
+            exit(1);
+        }
+    }
 
-    while (nsample < nsegs) {
-        int idx = nsample % frame_batch.pos.size();
+    std::ostream& out = ebt::in(std::string("output"), args) ? output_file : std::cout;
 
-        std::vector<std::vector<double>> frames = speech::load_frame_batch(frame_batch.at(idx));
+    if (format == "bin") {
+        out.write("RSEG", 4);
+    }
 
-        std::uniform_int_distribution<int> start_dist{0, int(frames.size() - max_dur - 1)};
+    long nutt = frame_batch.size();
 
-        int start_time = start_dist(gen);
-        int di = dur_dist(gen);
+    // stratified by utterance: segment n comes from utterance n % nutt, as
+    // when utterances were visited round robin, but the segments of an
+    // utterance are drawn together from one generator
+    auto count = [&](long u) {
+        return nsegs / nutt + (u < nsegs % nutt ? 1 : 0);
+    };
 
-        int end_time = std::min<int>(start_time + durs[di], frames.size());
+    long nused = std::min(nutt, nsegs);
 
-        std::cout << nsample << ".logmel" << std::endl;
+    // segments go in waves of at most wave_size; within a wave, chunks of
+    // utterances are parsed and formatted in parallel, each utterance with
+    // its own generator so the output does not depend on the thread count.
+    // an utterance with more segments than fit in a wave is split, and its
+    // generator carries over to the next wave
+    long wave_size = 256 * pool.size();
 
-        for (int i = start_time; i < end_time; ++i) {
-            for (int j = 0; j < frames[i].size(); ++j) {
-                std::cout << frames[i][j];
-                if (j != frames[i].size() - 1) {
-                    std::cout << " ";
-                }
+    long next_utt = 0;
+    long next_seg = 0;
+    std::default_random_engine carry;
+
+    while (next_utt < nused) {
+        std::vector<slice> wave;
+        long nwave = 0;
+
+        while (next_utt < nused && nwave < wave_size) {
+            long end = std::min(count(next_utt), next_seg + wave_size - nwave);
+
+            wave.push_back(slice { next_utt, next_seg, end });
+            nwave += end - next_seg;
+
+            if (end == count(next_utt)) {
+                ++next_utt;
+                next_seg = 0;
+            } else {
+                next_seg = end;
             }
-            std::cout << std::endl;
         }
 
-        std::cout << "." << std::endl;
+        int nchunk = std::max<int>(1, std::min<int>(wave.size(), 4 * pool.size()));
+
+        std::vector<std::string> buf;
+        buf.resize(nchunk);
+
+        // only the first slice resumes and only the last one is cut short
+        std::default_random_engine resume = carry;
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) wave.size() * c / nchunk;
+            int end = (long) wave.size() * (c + 1) / nchunk;
+
+            for (int k = begin; k < end; ++k) {
+                long u = wave[k].utt;
+
+                std::vector<std::vector<double>> frames;
 
-        ++nsample;
+                {
+                    profile::scope prof { "load_frame_batch" };
+                    frames = frame_batch.load(u);
+                }
+
+                std::default_random_engine gen = resume;
+
+                if (wave[k].begin == 0) {
+                    std::seed_seq seq { seed, int(u >> 31), int(u & 0x7fffffff) };
+                    gen.seed(seq);
+                }
+
+                std::uniform_int_distribution<int> dur_dist { 0, int(durs.size() - 1) };
+                std::uniform_int_distribution<int> start_dist { 0, std::max(0, int(frames.size()) - max_dur - 1) };
+
+                profile::scope prof { "write" };
+
+                for (long i = wave[k].begin; i < wave[k].end; ++i) {
+                    int start_time = start_dist(gen);
+                    int di = dur_dist(gen);
+
+                    int end_time = std::min<int>(start_time + durs[di], frames.size());
+
+                    if (format == "text") {
+                        append_text(buf[c], i * nutt + u, frames, start_time, end_time);
+                    } else {
+                        append_bin(buf[c], i * nutt + u, frames, start_time, end_time);
+                    }
+                }
+
+                if (wave[k].end < count(u)) {
+                    carry = gen;
+                }
+            }
+        });
+
+        for (auto& b: buf) {
+            out.write(b.data(), b.size());
+        }
     }
 
+    profile::count("segments", nsegs);
+
+    out.flush();
+
     return 0;
 }
@@ -3,6 +3,10 @@
 #include "nn/tensor-tree.h"
 #include "nn/rsg.h"
 #include "nn/nn.h"
+#include "arena.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 #include <algorithm>
 
@@ -12,13 +16,14 @@ std::vector<std::shared_ptr<autodiff::op_t>> reconstruct(
     std::shared_ptr<tensor_tree::vertex> var_tree,
     std::string const& label,
     std::unordered_map<std::string, int> const& label_id,
-    int layer);
+    int layer,
+    arena::region *mem);
 
 std::string load_label_batch(std::ifstream& ifs);
 
 struct learning_env {
 
-    speech::batch_indices frame_batch;
+    frame_store::batch frame_batch;
     speech::batch_indices label_batch;
 
     std::shared_ptr<tensor_tree::vertex> param;
@@ -27,6 +32,8 @@ struct learning_env {
 
     std::shared_ptr<tensor_tree::optimizer> opt;
 
+    std::unique_ptr<arena::region> graph_arena;
+
     std::string output_param;
     std::string output_opt_data;
 
@@ -55,9 +62,15 @@ struct learning_env {
 learning_env::learning_env(std::unordered_map<std::string, std::string> const& args)
     : args(args)
 {
-    frame_batch.open(args.at("frame-batch"));
+    frame_batch.open(args.at("frame-batch"), thread_pool::global());
     label_batch.open(args.at("label-batch"));
 
+    if (label_batch.pos.size() != frame_batch.pos.size()) {
+        std::cerr << args.at("label-batch") << " has " << label_batch.pos.size()
+            << " labels for " << frame_batch.pos.size() << " segments" << std::endl;
+        exit(1);
+    }
+
     std::string line;
     std::ifstream param_ifs { args.at("param") };
     std::getline(param_ifs, line);
@@ -145,15 +158,21 @@ learning_env::learning_env(std::unordered_map<std::string, std::string> const& a
             label_batch.pos[i] = pos[sample_indices[i]];
         }
     }
+    if (ebt::in(std::string("arena"), args)) {
+        // address space only; pages are backed as samples need them
+        graph_arena.reset(new arena::region(1L << 30));
+    }
 }
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "rsg-unsup-learn",
         "Train a Recurrent Sequence Generator",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"label-batch", "", true},
             {"param", "", true},
             {"opt-data", "", false},
@@ -167,6 +186,9 @@ int main(int argc, char *argv[])
             {"seed", "", false},
             {"shuffle", "", false},
             {"const-step-update", "", false},
+            {"arena", "allocate each sample's transcribers and loss gradients in an arena", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
         }
     };
 
@@ -177,10 +199,9 @@ int main(int argc, char *argv[])
 
     auto args = ebt::parse_args(argc, argv, spec);
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::setup(args);
+
+    output::echo(argc, argv);
 
     learning_env env { args };
 
@@ -194,12 +215,24 @@ void learning_env::run()
     int nsample = 0;
 
     while (nsample < frame_batch.pos.size()) {
-        std::vector<std::vector<double>> frames = speech::load_frame_batch(frame_batch.at(nsample));
-        std::string label = load_label_batch(label_batch.at(nsample));
+        std::vector<std::vector<double>> frames;
+        std::string label;
 
-        std::cout << "sample: " << sample_indices.at(nsample) << std::endl;
-        std::cout << "frames: " << frames.size() << std::endl;
-        std::cout << "label: " << label << std::endl;
+        {
+            profile::scope prof { "load_frame_batch" };
+            frames = frame_batch.at(nsample);
+            label = load_label_batch(label_batch.at(nsample));
+        }
+
+        profile::count("segments");
+
+        if (output::enabled(output::detail)) {
+            std::cout << "sample: " << sample_indices.at(nsample) << '\n';
+            std::cout << "frames: " << frames.size() << '\n';
+            std::cout << "label: " << label << '\n';
+        }
+
+        arena::scope mem { graph_arena.get() };
 
         autodiff::computation_graph comp_graph;
 
@@ -214,7 +247,10 @@ void learning_env::run()
 
         if (seg_frames.size() <= 1) {
             ++nsample;
-            std::cout << std::endl;
+
+            if (output::enabled(output::detail)) {
+                std::cout << '\n';
+            }
 
             continue;
         }
@@ -226,8 +262,13 @@ void learning_env::run()
 
         double seg_loss = 0;
 
-        std::vector<std::shared_ptr<autodiff::op_t>> outputs
-            = reconstruct(comp_graph, seg_frames, var_tree, label, label_id, layer);
+        std::vector<std::shared_ptr<autodiff::op_t>> outputs;
+
+        {
+            profile::scope prof { "rsg_reconstruct" };
+            outputs = reconstruct(comp_graph, seg_frames, var_tree, label, label_id, layer,
+                graph_arena.get());
+        }
 
         for (int t = 0; t < outputs.size(); ++t) {
             la::tensor<double> gold { la::vector<double>(frames.at(t + 1)) };
@@ -239,15 +280,20 @@ void learning_env::run()
 
             seg_loss += frame_loss.loss();
 
-            outputs.at(t)->grad = std::make_shared<la::tensor<double>>(
+            outputs.at(t)->grad = arena::make_shared<la::tensor<double>>(graph_arena.get(),
                 frame_loss.grad());
 
         }
 
-        std::cout << "loss: " << seg_loss << std::endl;
+        if (output::enabled(output::summary)) {
+            std::cout << "loss: " << seg_loss << '\n';
+        }
 
-        auto topo_order = autodiff::natural_topo_order(comp_graph);
-        autodiff::guarded_grad(topo_order, autodiff::grad_funcs);
+        {
+            profile::scope prof { "guarded_grad" };
+            auto topo_order = autodiff::natural_topo_order(comp_graph);
+            autodiff::guarded_grad(topo_order, autodiff::grad_funcs);
+        }
 
         auto grad = rsg::make_tensor_tree(layer);
 
@@ -255,12 +301,17 @@ void learning_env::run()
 
         double n = tensor_tree::norm(grad);
 
-        std::cout << "grad norm: " << n << std::endl;
+        if (output::enabled(output::detail)) {
+            std::cout << "grad norm: " << n << '\n';
+        }
 
         if (ebt::in(std::string("clip"), args)) {
             if (n > clip) {
                 tensor_tree::imul(grad, clip / n);
-                std::cout << "gradient clipped" << std::endl;
+
+                if (output::enabled(output::detail)) {
+                    std::cout << "gradient clipped" << '\n';
+                }
             }
         }
 
@@ -269,16 +320,27 @@ void learning_env::run()
 
         double v1 = v.data()[0];
 
-        opt->update(grad);
+        {
+            profile::scope prof { "opt_update" };
+            opt->update(grad);
+        }
 
         double v2 = v.data()[0];
 
-        std::cout << "weight: " << v1 << " update: " << v2 - v1
-            << " rate: " << (v2 - v1) / v1 << std::endl;
+        if (output::enabled(output::detail)) {
+            std::cout << "weight: " << v1 << " update: " << v2 - v1
+                << " rate: " << (v2 - v1) / v1 << '\n';
+        }
 
-        std::cout << "norm: " << tensor_tree::norm(param) << std::endl;
+        if (output::enabled(output::detail)) {
+            std::cout << "norm: " << tensor_tree::norm(param) << '\n';
 
-        std::cout << std::endl;
+            if (graph_arena != nullptr) {
+                std::cout << "arena allocations: " << mem.allocations() << '\n';
+            }
+
+            std::cout << '\n';
+        }
 
         ++nsample;
     }
@@ -301,12 +363,13 @@ std::vector<std::shared_ptr<autodiff::op_t>> reconstruct(
     std::shared_ptr<tensor_tree::vertex> var_tree,
     std::string const& label,
     std::unordered_map<std::string, int> const& label_id,
-    int layer)
+    int layer,
+    arena::region *mem)
 {
     lstm::lstm_multistep_transcriber multistep;
 
     for (int i = 0; i < layer; ++i) {
-        multistep.steps.push_back(std::make_shared<lstm::dyer_lstm_step_transcriber>(
+        multistep.steps.push_back(arena::make_shared<lstm::dyer_lstm_step_transcriber>(mem,
             lstm::dyer_lstm_step_transcriber{}));
     }
 
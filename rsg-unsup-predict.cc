@@ -3,6 +3,10 @@
 #include "nn/tensor-tree.h"
 #include "nn/rsg.h"
 #include "nn/nn.h"
+#include "frame-store.h"
+#include "arena.h"
+#include "profile.h"
+#include "output.h"
 #include <random>
 #include <algorithm>
 
@@ -12,11 +16,12 @@ std::vector<std::shared_ptr<autodiff::op_t>> reconstruct(
     std::shared_ptr<tensor_tree::vertex> var_tree,
     std::string const& label,
     std::unordered_map<std::string, int> const& label_id,
-    int layer);
+    int layer,
+    arena::region *mem);
 
 struct learning_env {
 
-    std::ifstream frame_batch;
+    frame_store::stream frame_batch;
 
     std::shared_ptr<tensor_tree::vertex> param;
 
@@ -25,6 +30,10 @@ struct learning_env {
     std::vector<std::string> id_label;
     std::unordered_map<std::string, int> label_id;
 
+    output::result_writer result;
+
+    std::unique_ptr<arena::region> graph_arena;
+
     std::unordered_map<std::string, std::string> args;
 
     learning_env(std::unordered_map<std::string, std::string> const& args);
@@ -51,17 +60,31 @@ learning_env::learning_env(std::unordered_map<std::string, std::string> const& a
         label_id[id_label[i]] = i;
     }
 
+    result.open(args);
+
+    if (ebt::in(std::string("arena"), args)) {
+        // address space only; pages are backed as samples need them
+        graph_arena.reset(new arena::region(1L << 30));
+    }
+
 }
 
 int main(int argc, char *argv[])
 {
+    output::init();
+
     ebt::ArgumentSpec spec {
         "rsg-unsup-learn",
         "Train a Recurrent Sequence Generator",
         {
-            {"frame-batch", "", true},
+            {"frame-batch", "text batch, frame store, or - for stdin", true},
             {"param", "", true},
             {"label", "", true},
+            {"arena", "allocate each sample's transcribers in an arena", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+            {"result", "", false},
+            {"result-format", "", false},
         }
     };
 
@@ -72,10 +95,9 @@ int main(int argc, char *argv[])
 
     auto args = ebt::parse_args(argc, argv, spec);
 
-    for (int i = 0; i < argc; ++i) {
-        std::cout << argv[i] << " ";
-    }
-    std::cout << std::endl;
+    output::setup(args);
+
+    output::echo(argc, argv);
 
     learning_env env { args };
 
@@ -91,12 +113,18 @@ void learning_env::run()
     int nsample = 0;
 
     while (1) {
-        std::vector<std::vector<double>> frames = speech::load_frame_batch(frame_batch);
+        std::vector<std::vector<double>> frames;
+
+        {
+            profile::scope prof { "load_frame_batch" };
 
-        if (!frame_batch) {
-            break;
+            if (!frame_batch.next(frames)) {
+                break;
+            }
         }
 
+        arena::scope mem { graph_arena.get() };
+
         autodiff::computation_graph comp_graph;
 
         auto var_tree = tensor_tree::make_var_tree(comp_graph, param);
@@ -110,7 +138,10 @@ void learning_env::run()
 
         if (seg_frames.size() <= 1) {
             ++nsample;
-            std::cout << std::endl;
+
+            if (output::enabled(output::results)) {
+                std::cout << '\n';
+            }
 
             continue;
         }
@@ -120,9 +151,14 @@ void learning_env::run()
         double min = inf;
         std::string argmin;
 
+        profile::count("segments");
+
         for (auto& label: id_label) {
+            profile::scope prof { "rsg_reconstruct" };
+
             std::vector<std::shared_ptr<autodiff::op_t>> outputs
-                = reconstruct(comp_graph, seg_frames, var_tree, label, label_id, layer);
+                = reconstruct(comp_graph, seg_frames, var_tree, label, label_id, layer,
+                    graph_arena.get());
 
             double loss_sum = 0;
 
@@ -143,11 +179,17 @@ void learning_env::run()
             }
         }
 
-        std::cout << nsample << ".label" << std::endl;
+        if (output::enabled(output::results)) {
+            std::cout << nsample << ".label" << '\n';
+
+            std::cout << argmin << '\n';
 
-        std::cout << argmin << std::endl;
+            std::cout << "." << '\n';
+        }
 
-        std::cout << "." << std::endl;
+        if (result.is_open()) {
+            result.write(nsample, label_id.at(argmin), min);
+        }
 
         ++nsample;
     }
@@ -159,12 +201,13 @@ std::vector<std::shared_ptr<autodiff::op_t>> reconstruct(
     std::shared_ptr<tensor_tree::vertex> var_tree,
     std::string const& label,
     std::unordered_map<std::string, int> const& label_id,
-    int layer)
+    int layer,
+    arena::region *mem)
 {
     lstm::lstm_multistep_transcriber multistep;
 
     for (int i = 0; i < layer; ++i) {
-        multistep.steps.push_back(std::make_shared<lstm::dyer_lstm_step_transcriber>(
+        multistep.steps.push_back(arena::make_shared<lstm::dyer_lstm_step_transcriber>(mem,
             lstm::dyer_lstm_step_transcriber{}));
     }
 
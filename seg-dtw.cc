@@ -0,0 +1,260 @@
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include "speech/speech.h"
+#include "text-batch.h"
+#include "thread-pool.h"
+#include "segdtw.h"
+#include "precision.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "seg-dtw",
+        "Find repeated fragments across utterance pairs with segmental DTW",
+        {
+            {"frame-batch", "utterances", true},
+            {"threshold", "keep fragments with average frame distance below this", true},
+            {"band", "half width of the diagonal bands (default 10)", false},
+            {"min-len", "minimum fragment length in path steps (default 50)", false},
+            {"downsample", "prefilter pairs on frames averaged by this factor", false},
+            {"prefilter-threshold", "threshold of the prefilter (default --threshold)", false},
+            {"precision", "double (default) or float", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    double threshold = std::stod(args.at("threshold"));
+
+    int band = 10;
+    if (ebt::in(std::string("band"), args)) {
+        band = std::stoi(args.at("band"));
+    }
+
+    int min_len = 50;
+    if (ebt::in(std::string("min-len"), args)) {
+        min_len = std::stoi(args.at("min-len"));
+    }
+
+    int factor = 1;
+    if (ebt::in(std::string("downsample"), args)) {
+        factor = std::stoi(args.at("downsample"));
+    }
+
+    double prefilter_threshold = threshold;
+    if (ebt::in(std::string("prefilter-threshold"), args)) {
+        prefilter_threshold = std::stod(args.at("prefilter-threshold"));
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    std::vector<seg_t> utts;
+    std::vector<std::string> names;
+
+    {
+        profile::scope prof { "load_frame_batch" };
+
+        text_batch::file frame_batch;
+        frame_batch.open(args.at("frame-batch"), pool);
+
+        for (int m = 0; m < frame_batch.size(); ++m) {
+            names.push_back(frame_batch.name(m));
+        }
+
+        utts = frame_batch.load_all(pool);
+    }
+
+    int nutt = utts.size();
+
+    std::vector<seg_t> coarse;
+
+    if (factor > 1) {
+        profile::scope prof { "downsample" };
+
+        coarse.resize(nutt);
+
+        pool.parallel_for(nutt, [&](int i) {
+            coarse[i] = segdtw::downsample(utts[i], factor);
+        });
+    }
+
+    std::vector<int> lens;
+    for (auto& u: utts) {
+        lens.push_back(u.size());
+    }
+
+    // in float, the kernels read converted copies and the double frames
+    // are dropped
+    std::vector<std::vector<std::vector<float>>> utts32;
+    std::vector<std::vector<std::vector<float>>> coarse32;
+
+    if (prec == precision::scalar::f32) {
+        utts32 = precision::convert<float>(utts);
+        coarse32 = precision::convert<float>(coarse);
+
+        std::vector<seg_t>().swap(utts);
+        std::vector<seg_t>().swap(coarse);
+    }
+
+    int coarse_band = std::max(1, band / factor);
+    int coarse_min_len = std::max(1, min_len / factor);
+
+    // the pair space is walked in blocks so memory stays bounded; within
+    // a block, pairs are prefiltered in parallel, and the bands of the
+    // surviving pairs are aligned as independent tasks
+    int block_size = 256 * pool.size();
+
+    int a = 0;
+    int b = 1;
+
+    long npair = 0;
+    long nkept = 0;
+    long nband = 0;
+    long nfragment = 0;
+
+    while (a < nutt - 1) {
+        std::vector<std::pair<int, int>> pairs;
+
+        while (pairs.size() < block_size && a < nutt - 1) {
+            pairs.push_back(std::make_pair(a, b));
+
+            ++b;
+            if (b == nutt) {
+                ++a;
+                b = a + 1;
+            }
+        }
+
+        npair += pairs.size();
+
+        std::vector<char> keep;
+        keep.assign(pairs.size(), 1);
+
+        if (factor > 1) {
+            profile::scope prof { "prefilter" };
+
+            int nchunk = std::max<int>(1, std::min<int>(pairs.size(), 4 * pool.size()));
+
+            pool.parallel_for(nchunk, [&](int c) {
+                int begin = (long) pairs.size() * c / nchunk;
+                int end = (long) pairs.size() * (c + 1) / nchunk;
+
+                for (int p = begin; p < end; ++p) {
+                    int u = pairs[p].first;
+                    int v = pairs[p].second;
+
+                    int u_len = (prec == precision::scalar::f32 ? coarse32[u].size() : coarse[u].size());
+                    int v_len = (prec == precision::scalar::f32 ? coarse32[v].size() : coarse[v].size());
+
+                    bool found = false;
+
+                    for (int k: segdtw::band_offsets(u_len, v_len, coarse_band, coarse_min_len)) {
+                        double score = (prec == precision::scalar::f32
+                            ? segdtw::align_band(coarse32[u], coarse32[v], k, coarse_band, coarse_min_len).score
+                            : segdtw::align_band(coarse[u], coarse[v], k, coarse_band, coarse_min_len).score);
+
+                        if (score < prefilter_threshold) {
+                            found = true;
+                            break;
+                        }
+                    }
+
+                    keep[p] = found;
+                }
+            });
+        }
+
+        std::vector<std::pair<int, int>> tasks;
+
+        for (int p = 0; p < pairs.size(); ++p) {
+            if (!keep[p]) {
+                continue;
+            }
+
+            ++nkept;
+
+            for (int k: segdtw::band_offsets(lens[pairs[p].first],
+                    lens[pairs[p].second], band, min_len)) {
+                tasks.push_back(std::make_pair(p, k));
+            }
+        }
+
+        nband += tasks.size();
+
+        std::vector<segdtw::fragment> fragments;
+        fragments.resize(tasks.size());
+
+        {
+            profile::scope prof { "align_band" };
+
+            pool.parallel_for(tasks.size(), [&](int t) {
+                std::pair<int, int> const& pair = pairs[tasks[t].first];
+
+                if (prec == precision::scalar::f32) {
+                    fragments[t] = segdtw::align_band(utts32[pair.first], utts32[pair.second],
+                        tasks[t].second, band, min_len);
+                } else {
+                    fragments[t] = segdtw::align_band(utts[pair.first], utts[pair.second],
+                        tasks[t].second, band, min_len);
+                }
+            });
+        }
+
+        for (int t = 0; t < tasks.size(); ++t) {
+            segdtw::fragment const& f = fragments[t];
+
+            if (!(f.score < threshold)) {
+                continue;
+            }
+
+            ++nfragment;
+
+            if (output::enabled(output::results)) {
+                std::pair<int, int> const& pair = pairs[tasks[t].first];
+
+                std::cout << names[pair.first] << " " << f.a_start << " " << f.a_end
+                    << " " << names[pair.second] << " " << f.b_start << " " << f.b_end
+                    << " " << f.score << '\n';
+            }
+        }
+    }
+
+    profile::count("pairs", npair);
+    profile::count("bands", nband);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "utterances: " << nutt << '\n';
+        std::cout << "pairs: " << npair << '\n';
+        std::cout << "pairs after prefilter: " << nkept << '\n';
+        std::cout << "fragments: " << nfragment << '\n';
+    }
+
+    return 0;
+}
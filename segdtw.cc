@@ -0,0 +1,257 @@
+#include "segdtw.h"
+#include "subseq.h"
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+namespace segdtw {
+
+    std::vector<int> band_offsets(int a_len, int b_len, int band, int min_len)
+    {
+        int step = 2 * band + 1;
+
+        std::vector<int> result;
+
+        // a diagonal shorter than min_len cannot hold a fragment
+        for (int k = -((a_len - 1) / step) * step; k < b_len; k += step) {
+            int i0 = std::max(0, -k);
+            int j0 = std::max(0, k);
+
+            if (std::min(a_len - i0, b_len - j0) >= min_len) {
+                result.push_back(k);
+            }
+        }
+
+        return result;
+    }
+
+    template <class T>
+    fragment align_band(std::vector<std::vector<T>> const& a,
+        std::vector<std::vector<T>> const& b, int offset, int band, int min_len)
+    {
+        double inf = std::numeric_limits<double>::infinity();
+
+        fragment result { 0, 0, 0, 0, inf };
+
+        int i0 = std::max(0, -offset);
+        int j0 = std::max(0, offset);
+
+        int rows = a.size() - i0;
+        int width = 2 * band + 1;
+
+        if (rows <= 0 || j0 >= b.size()) {
+            return result;
+        }
+
+        // cell (i, j) lives at acc[(i - i0) * width + (j - i - offset + band)]
+        std::vector<double> acc;
+        std::vector<double> dist;
+        acc.assign((long) rows * width, inf);
+        dist.assign((long) rows * width, inf);
+
+        auto at = [&](int i, int j) -> long {
+            return (long) (i - i0) * width + (j - i - offset + band);
+        };
+
+        auto inside = [&](int i, int j) {
+            return i >= i0 && j >= j0 && i < a.size() && j < b.size()
+                && std::abs(j - i - offset) <= band;
+        };
+
+        for (int i = i0; i < a.size(); ++i) {
+            int j_begin = std::max(j0, i + offset - band);
+            int j_end = std::min<int>(b.size(), i + offset + band + 1);
+
+            for (int j = j_begin; j < j_end; ++j) {
+                double d = subseq::frame_dist(a[i], b[j]);
+                long c = at(i, j);
+                dist[c] = d;
+
+                if (i == i0 && j == j0) {
+                    acc[c] = d;
+                    continue;
+                }
+
+                double best = inf;
+
+                if (inside(i - 1, j - 1)) {
+                    best = std::min(best, acc[at(i - 1, j - 1)]);
+                }
+                if (inside(i - 1, j)) {
+                    best = std::min(best, acc[at(i - 1, j)]);
+                }
+                if (inside(i, j - 1)) {
+                    best = std::min(best, acc[at(i, j - 1)]);
+                }
+
+                acc[c] = best + d;
+            }
+        }
+
+        // the path ends where it leaves a or b, at the cell with the least
+        // cost per step
+        int end_i = -1;
+        int end_j = -1;
+        double end_cost = inf;
+
+        auto consider_end = [&](int i, int j) {
+            if (!inside(i, j)) {
+                return;
+            }
+
+            double c = acc[at(i, j)] / ((i - i0) + (j - j0) + 1);
+
+            if (c < end_cost) {
+                end_cost = c;
+                end_i = i;
+                end_j = j;
+            }
+        };
+
+        for (int j = j0; j < b.size(); ++j) {
+            consider_end(a.size() - 1, j);
+        }
+        for (int i = i0; i < a.size(); ++i) {
+            consider_end(i, b.size() - 1);
+        }
+
+        if (end_i == -1) {
+            return result;
+        }
+
+        std::vector<std::pair<int, int>> path;
+
+        int i = end_i;
+        int j = end_j;
+
+        while (1) {
+            path.push_back(std::make_pair(i, j));
+
+            if (i == i0 && j == j0) {
+                break;
+            }
+
+            double best = inf;
+            int bi = i;
+            int bj = j;
+
+            if (inside(i - 1, j - 1) && acc[at(i - 1, j - 1)] < best) {
+                best = acc[at(i - 1, j - 1)];
+                bi = i - 1;
+                bj = j - 1;
+            }
+            if (inside(i - 1, j) && acc[at(i - 1, j)] < best) {
+                best = acc[at(i - 1, j)];
+                bi = i - 1;
+                bj = j;
+            }
+            if (inside(i, j - 1) && acc[at(i, j - 1)] < best) {
+                best = acc[at(i, j - 1)];
+                bi = i;
+                bj = j - 1;
+            }
+
+            if (bi == i && bj == j) {
+                break;
+            }
+
+            i = bi;
+            j = bj;
+        }
+
+        std::reverse(path.begin(), path.end());
+
+        if (path.size() < min_len) {
+            return result;
+        }
+
+        // least average distortion over stretches of at least min_len
+        // steps; a longer stretch always splits into two of at least
+        // min_len, one no worse than the whole, so lengths below
+        // 2 min_len suffice
+        std::vector<double> prefix;
+        prefix.push_back(0);
+
+        for (auto& p: path) {
+            prefix.push_back(prefix.back() + dist[at(p.first, p.second)]);
+        }
+
+        int best_s = 0;
+        int best_e = 0;
+        double best_avg = inf;
+
+        for (int e = min_len; e <= path.size(); ++e) {
+            for (int len = min_len; len < 2 * min_len && len <= e; ++len) {
+                double avg = (prefix[e] - prefix[e - len]) / len;
+
+                if (avg < best_avg) {
+                    best_avg = avg;
+                    best_s = e - len;
+                    best_e = e;
+                }
+            }
+        }
+
+        result.a_start = path[best_s].first;
+        result.b_start = path[best_s].second;
+        result.a_end = path[best_e - 1].first + 1;
+        result.b_end = path[best_e - 1].second + 1;
+        result.score = best_avg;
+
+        return result;
+    }
+
+    template <class T>
+    std::vector<fragment> align(std::vector<std::vector<T>> const& a,
+        std::vector<std::vector<T>> const& b, int band, int min_len, double threshold)
+    {
+        std::vector<fragment> result;
+
+        for (int k: band_offsets(a.size(), b.size(), band, min_len)) {
+            fragment f = align_band(a, b, k, band, min_len);
+
+            if (f.score < threshold) {
+                result.push_back(f);
+            }
+        }
+
+        return result;
+    }
+
+    seg_t downsample(seg_t const& frames, int factor)
+    {
+        seg_t result;
+
+        for (int t = 0; t < frames.size(); t += factor) {
+            int end = std::min<int>(frames.size(), t + factor);
+
+            std::vector<double> avg = frames[t];
+
+            for (int s = t + 1; s < end; ++s) {
+                for (int d = 0; d < avg.size(); ++d) {
+                    avg[d] += frames[s][d];
+                }
+            }
+
+            for (int d = 0; d < avg.size(); ++d) {
+                avg[d] /= (end - t);
+            }
+
+            result.push_back(avg);
+        }
+
+        return result;
+    }
+
+
+    template fragment align_band(std::vector<std::vector<double>> const& a,
+        std::vector<std::vector<double>> const& b, int offset, int band, int min_len);
+    template fragment align_band(std::vector<std::vector<float>> const& a,
+        std::vector<std::vector<float>> const& b, int offset, int band, int min_len);
+
+    template std::vector<fragment> align(std::vector<std::vector<double>> const& a,
+        std::vector<std::vector<double>> const& b, int band, int min_len, double threshold);
+    template std::vector<fragment> align(std::vector<std::vector<float>> const& a,
+        std::vector<std::vector<float>> const& b, int band, int min_len, double threshold);
+
+}
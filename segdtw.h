@@ -0,0 +1,42 @@
+#ifndef SEGDTW_H
+#define SEGDTW_H
+
+#include <vector>
+
+namespace segdtw {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    struct fragment {
+        int a_start;
+        int a_end;
+        int b_start;
+        int b_end;
+        double score;
+    };
+
+    /*
+     * Segmental DTW (Park and Glass) of a against b.  The (i, j) plane
+     * is cut into diagonal bands of width 2 band + 1 centered on
+     * j - i = k, for k a multiple of 2 band + 1.  Each band is aligned
+     * once, and the path is then searched for the stretch of at least
+     * min_len steps with the least average frame distance.  Ends are
+     * exclusive.  Frames are double or float; costs are double.
+     */
+    std::vector<int> band_offsets(int a_len, int b_len, int band, int min_len);
+
+    // the best fragment of one band; score is infinity if there is none
+    template <class T>
+    fragment align_band(std::vector<std::vector<T>> const& a,
+        std::vector<std::vector<T>> const& b, int offset, int band, int min_len);
+
+    template <class T>
+    std::vector<fragment> align(std::vector<std::vector<T>> const& a,
+        std::vector<std::vector<T>> const& b, int band, int min_len, double threshold);
+
+    // averages every factor frames, for the prefilter
+    seg_t downsample(seg_t const& frames, int factor);
+
+}
+
+#endif
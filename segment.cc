@@ -0,0 +1,322 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "kmeans.h"
+#include "spans.h"
+#include "precision.h"
+#include "semimarkov.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "segment",
+        "Segment utterances by semi-Markov search over distances to k-means centers",
+        {
+            {"frame-batch", "utterances: text batch, frame store, or - for stdin", true},
+            {"basis-batch", "", true},
+            {"centers", "trained on normalized embeddings of the same mode", true},
+            {"mode", "dtw (default) or conv", false},
+            {"pooling", "max (default) or mean, for conv", false},
+            {"max-dur", "", true},
+            {"min-dur", "(default 1)", false},
+            {"seg-penalty", "cost added per segment (default 0)", false},
+            {"beam", "approximate: feasible start states tried per end frame, 0 for exact (default 0)", false},
+            {"precision", "double (default) or float", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    std::string mode = "dtw";
+    if (ebt::in(std::string("mode"), args)) {
+        mode = args.at("mode");
+    }
+
+    if (mode != "dtw" && mode != "conv") {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    spans::pooling pooling = spans::pooling::max;
+
+    if (ebt::in(std::string("pooling"), args)) {
+        if (args.at("pooling") == "mean") {
+            pooling = spans::pooling::mean;
+        } else if (args.at("pooling") != "max") {
+            std::cerr << "unknown pooling " << args.at("pooling") << std::endl;
+            exit(1);
+        }
+    }
+
+    int max_dur = std::stoi(args.at("max-dur"));
+
+    int min_dur = 1;
+    if (ebt::in(std::string("min-dur"), args)) {
+        min_dur = std::stoi(args.at("min-dur"));
+    }
+
+    if (min_dur < 1 || max_dur < min_dur) {
+        std::cerr << "need 1 <= --min-dur <= --max-dur" << std::endl;
+        exit(1);
+    }
+
+    double seg_penalty = 0;
+    if (ebt::in(std::string("seg-penalty"), args)) {
+        seg_penalty = std::stod(args.at("seg-penalty"));
+    }
+
+    int beam = 0;
+    if (ebt::in(std::string("beam"), args)) {
+        beam = std::stoi(args.at("beam"));
+    }
+
+    std::vector<seg_t> basis;
+    std::ifstream basis_batch { args.at("basis-batch") };
+
+    while (1) {
+        seg_t frames = speech::load_frame_batch(basis_batch);
+
+        if (!basis_batch) {
+            break;
+        }
+
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
+        basis.push_back(frames);
+    }
+
+    basis_batch.close();
+
+    la::tensor<double> basis_tensor;
+    int dim = basis.size();
+
+    if (mode == "conv") {
+        basis_tensor = embed::to_tensor(basis);
+        dim = basis_tensor.size(2);
+    }
+
+    kmeans::center_file centers;
+    centers.open(args.at("centers"));
+
+    if (centers.dim != dim) {
+        std::cerr << "centers have dimension " << centers.dim << ", the embeddings have " << dim << std::endl;
+        exit(1);
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<std::vector<float>>> basis32;
+
+    if (prec == precision::scalar::f32) {
+        basis32 = precision::convert<float>(basis);
+        centers.make_f32();
+    }
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
+
+    int nutt = 0;
+    int ndur = max_dur - min_dur + 1;
+
+    // utterances are searched in parallel, one per task; within an
+    // utterance the dtw pass of a start serves all its durations, and
+    // the conv correlation serves all spans
+    int batch_size = 4 * pool.size();
+
+    long nframes = 0;
+    long nsegments = 0;
+    long nfetched = 0;
+    double total_cost = 0;
+
+    bool more = true;
+
+    while (more) {
+        std::vector<seg_t> utts;
+        std::vector<std::string> names;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            while (utts.size() < batch_size) {
+                std::string name;
+                seg_t utt;
+
+                if (!frame_batch.next(name, utt)) {
+                    more = false;
+                    break;
+                }
+
+                names.push_back(name);
+                utts.push_back(utt);
+            }
+        }
+
+        nutt += utts.size();
+
+        std::vector<std::vector<semimarkov::segment>> result;
+        result.resize(utts.size());
+
+        std::vector<long> fetched;
+        fetched.resize(utts.size());
+
+        {
+            profile::scope prof { "viterbi" };
+
+            pool.parallel_for(utts.size(), [&](int u) {
+                seg_t const& utt = utts[u];
+
+                spans::conv_response response;
+
+                if (mode == "conv") {
+                    response = spans::conv_correlate(utt, basis_tensor);
+                }
+
+                std::vector<std::vector<float>> utt32;
+
+                if (mode == "dtw" && prec == precision::scalar::f32) {
+                    utt32 = precision::convert<float>(utt);
+                }
+
+                std::vector<double> buf;
+                la::vector<double> x;
+                x.resize(dim);
+
+                auto costs = [&](int s, std::vector<double>& cost, std::vector<int>& label) {
+                    ++fetched[u];
+
+                    if (mode == "dtw") {
+                        buf.resize((long) ndur * dim);
+                        if (prec == precision::scalar::f32) {
+                            spans::dtw_start(utt32, basis32, s, min_dur, max_dur, buf.data());
+                        } else {
+                            spans::dtw_start(utt, basis, s, min_dur, max_dur, buf.data());
+                        }
+                    }
+
+                    for (int dur = min_dur; dur <= max_dur && s + dur <= utt.size(); ++dur) {
+                        if (mode == "dtw") {
+                            std::copy(buf.begin() + (long) (dur - min_dur) * dim,
+                                buf.begin() + (long) (dur - min_dur + 1) * dim, x.data());
+                        } else if (pooling == spans::pooling::max) {
+                            if (!response.span_max(s, dur, x.data())) {
+                                continue;
+                            }
+                        } else {
+                            if (!response.span_mean(s, dur, x.data())) {
+                                continue;
+                            }
+                        }
+
+                        double norm = 0;
+                        for (int d = 0; d < dim; ++d) {
+                            norm += x(d) * x(d);
+                        }
+                        norm = std::sqrt(norm);
+
+                        if (norm == 0) {
+                            continue;
+                        }
+
+                        for (int d = 0; d < dim; ++d) {
+                            x(d) /= norm;
+                        }
+
+                        double dist;
+                        int k;
+
+                        if (prec == precision::scalar::f32) {
+                            k = kmeans::nearest_f32(centers, x.data(), dist);
+                        } else {
+                            k = kmeans::nearest(centers, x, dist);
+                        }
+
+                        cost[dur - min_dur] = dur * dist + seg_penalty;
+                        label[dur - min_dur] = k;
+                    }
+                };
+
+                // distances are nonnegative, so no span costs less than the penalty
+                result[u] = semimarkov::viterbi(utt.size(), min_dur, max_dur, beam, seg_penalty, costs);
+            });
+        }
+
+        for (int u = 0; u < utts.size(); ++u) {
+            nframes += utts[u].size();
+            nfetched += fetched[u];
+            nsegments += result[u].size();
+
+            if (result[u].size() == 0 && utts[u].size() > 0) {
+                std::cerr << names[u] << ": no segmentation with durations "
+                    << min_dur << " to " << max_dur << std::endl;
+            }
+
+            for (auto& seg: result[u]) {
+                total_cost += seg.cost;
+            }
+
+            if (output::enabled(output::results)) {
+                std::cout << names[u] << '\n';
+
+                for (auto& seg: result[u]) {
+                    std::cout << seg.start << " " << seg.end << " " << seg.label;
+
+                    if (output::enabled(output::detail)) {
+                        std::cout << " " << seg.cost;
+                    }
+
+                    std::cout << '\n';
+                }
+
+                std::cout << "." << '\n';
+            }
+        }
+    }
+
+    profile::count("utterances", nutt);
+    profile::count("frames", nframes);
+    profile::count("starts", nfetched);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "utterances: " << nutt << '\n';
+        std::cout << "segments: " << nsegments << '\n';
+        std::cout << "starts embedded: " << nfetched << " of " << nframes << '\n';
+        std::cout << "cost per frame: " << total_cost / std::max<long>(1, nframes) << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "semimarkov.h"
+#include <algorithm>
+#include <limits>
+
+namespace semimarkov {
+
+    std::vector<segment> viterbi(int frames, int min_dur, int max_dur,
+        int beam, double min_cost, span_costs const& costs)
+    {
+        double inf = std::numeric_limits<double>::infinity();
+
+        int ndur = max_dur - min_dur + 1;
+
+        // best[t] is the least cost of segmenting frames [0, t)
+        std::vector<double> best;
+        std::vector<int> back;
+        std::vector<int> back_label;
+        best.assign(frames + 1, inf);
+        back.assign(frames + 1, -1);
+        back_label.assign(frames + 1, -1);
+        best[0] = 0;
+
+        // span costs of a start, fetched the first time an end needs them
+        std::vector<std::vector<double>> cost;
+        std::vector<std::vector<int>> label;
+        std::vector<char> fetched;
+        cost.resize(frames);
+        label.resize(frames);
+        fetched.assign(frames, 0);
+
+        std::vector<int> starts;
+
+        for (int t = min_dur; t <= frames; ++t) {
+            starts.clear();
+
+            for (int s = std::max(0, t - max_dur); s <= t - min_dur; ++s) {
+                if (best[s] < inf) {
+                    starts.push_back(s);
+                }
+            }
+
+            std::sort(starts.begin(), starts.end(),
+                [&](int a, int b) { return best[a] < best[b]; });
+
+            int feasible = 0;
+
+            for (int s: starts) {
+                // every later start is at least as expensive as s
+                if (best[s] + min_cost >= best[t]) {
+                    break;
+                }
+
+                if (beam > 0 && feasible == beam) {
+                    break;
+                }
+
+                if (!fetched[s]) {
+                    cost[s].assign(ndur, inf);
+                    label[s].assign(ndur, -1);
+                    costs(s, cost[s], label[s]);
+                    fetched[s] = 1;
+                }
+
+                if (!(cost[s][t - s - min_dur] < inf)) {
+                    continue;
+                }
+
+                ++feasible;
+
+                double c = best[s] + cost[s][t - s - min_dur];
+
+                if (c < best[t]) {
+                    best[t] = c;
+                    back[t] = s;
+                    back_label[t] = label[s][t - s - min_dur];
+                }
+            }
+
+            // a start's costs are dead once no later end can use them
+            int dead = t - max_dur;
+            if (dead >= 0 && fetched[dead]) {
+                std::vector<double>().swap(cost[dead]);
+                std::vector<int>().swap(label[dead]);
+            }
+        }
+
+        std::vector<segment> result;
+
+        if (!(best[frames] < inf)) {
+            return result;
+        }
+
+        for (int t = frames; t > 0; t = back[t]) {
+            int s = back[t];
+            result.push_back(segment { s, t, back_label[t], best[t] - best[s] });
+        }
+
+        std::reverse(result.begin(), result.end());
+
+        return result;
+    }
+
+}
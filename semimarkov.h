@@ -0,0 +1,44 @@
+#ifndef SEMIMARKOV_H
+#define SEMIMARKOV_H
+
+#include <vector>
+#include <functional>
+
+namespace semimarkov {
+
+    struct segment {
+        int start;
+        int end;
+        int label;
+        double cost;
+    };
+
+    /*
+     * Costs and labels of the spans [start, start + dur) for
+     * min_dur <= dur <= max_dur, indexed by dur - min_dur.  Spans past
+     * the end of the utterance or without a cost are infinity.
+     */
+    using span_costs = std::function<void(int start,
+        std::vector<double>& cost, std::vector<int>& label)>;
+
+    /*
+     * Semi-Markov Viterbi over a frames-long utterance: the segmentation
+     * into spans of min_dur to max_dur frames with the least total cost.
+     * Span costs are asked for one start at a time, and only for starts
+     * that are needed, so a caller can share work across the spans of a
+     * start.
+     *
+     * min_cost is a lower bound on every span cost.  Each end frame tries
+     * its start states cheapest first and stops at the first one whose
+     * cost plus min_cost cannot beat the best path found so far; those
+     * starts are dominated, and the result is exact.  With beam > 0, an
+     * end frame also stops after beam starts with a feasible span to it.
+     * That is an approximation: a start can be cut whose span is cheap
+     * enough to win.  Returns no segments if no segmentation exists.
+     */
+    std::vector<segment> viterbi(int frames, int min_dur, int max_dur,
+        int beam, double min_cost, span_costs const& costs);
+
+}
+
+#endif
@@ -0,0 +1,250 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "thread-pool.h"
+#include "spans.h"
+#include "precision.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "span-embed",
+        "Embed every span of every utterance up to a maximum duration",
+        {
+            {"frame-batch", "utterances: text batch, frame store, or - for stdin", true},
+            {"basis-batch", "", true},
+            {"output", "", true},
+            {"max-dur", "", true},
+            {"mode", "dtw (default) or conv", false},
+            {"pooling", "max (default) or mean, for conv", false},
+            {"min-dur", "(default 1)", false},
+            {"check", "compare this many random spans per utterance with embed::dtw_embed or embed::conv_embed", false},
+            {"seed", "", false},
+            {"precision", "double (default) or float", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    int max_dur = std::stoi(args.at("max-dur"));
+
+    int min_dur = 1;
+    if (ebt::in(std::string("min-dur"), args)) {
+        min_dur = std::stoi(args.at("min-dur"));
+    }
+
+    if (min_dur < 1 || max_dur < min_dur) {
+        std::cerr << "need 1 <= --min-dur <= --max-dur" << std::endl;
+        exit(1);
+    }
+
+    std::string mode = "dtw";
+    if (ebt::in(std::string("mode"), args)) {
+        mode = args.at("mode");
+    }
+
+    if (mode != "dtw" && mode != "conv") {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    spans::pooling pooling = spans::pooling::max;
+
+    if (ebt::in(std::string("pooling"), args)) {
+        if (args.at("pooling") == "mean") {
+            pooling = spans::pooling::mean;
+        } else if (args.at("pooling") != "max") {
+            std::cerr << "unknown pooling " << args.at("pooling") << std::endl;
+            exit(1);
+        }
+    }
+
+    int ncheck = 0;
+    if (ebt::in(std::string("check"), args)) {
+        ncheck = std::stoi(args.at("check"));
+    }
+
+    int seed = 1;
+    if (ebt::in(std::string("seed"), args)) {
+        seed = std::stoi(args.at("seed"));
+    }
+
+    std::vector<seg_t> basis;
+    std::ifstream basis_batch { args.at("basis-batch") };
+
+    while (1) {
+        seg_t frames = speech::load_frame_batch(basis_batch);
+
+        if (!basis_batch) {
+            break;
+        }
+
+        if (frames.size() == 0) {
+            std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+            exit(1);
+        }
+
+        basis.push_back(frames);
+    }
+
+    basis_batch.close();
+
+    la::tensor<double> basis_tensor;
+
+    if (mode == "conv") {
+        basis_tensor = embed::to_tensor(basis);
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<std::vector<float>>> basis32;
+
+    if (mode == "dtw" && prec == precision::scalar::f32) {
+        basis32 = precision::convert<float>(basis);
+    }
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
+
+    int nutt = 0;
+
+    spans::writer writer;
+    writer.open(args.at("output"));
+
+    std::default_random_engine gen { (unsigned long) seed };
+
+    long nspan = 0;
+    long nchecked = 0;
+    double max_diff = 0;
+
+    while (1) {
+        std::string name;
+        seg_t utt;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            if (!frame_batch.next(name, utt)) {
+                break;
+            }
+        }
+
+        ++nutt;
+
+        spans::span_table table;
+
+        if (mode == "dtw") {
+            profile::scope prof { "dtw_spans" };
+            if (prec == precision::scalar::f32) {
+                table = spans::dtw_spans(precision::convert<float>(utt), basis32, min_dur, max_dur, pool);
+            } else {
+                table = spans::dtw_spans(utt, basis, min_dur, max_dur, pool);
+            }
+        } else {
+            profile::scope prof { "conv_spans" };
+            table = spans::conv_spans(utt, basis_tensor, min_dur, max_dur, pooling, pool);
+        }
+
+        for (int dur = min_dur; dur <= std::min<int>(max_dur, utt.size()); ++dur) {
+            nspan += utt.size() - dur + 1;
+        }
+
+        if (ncheck > 0 && utt.size() >= min_dur) {
+            profile::scope prof { "check" };
+
+            int longest = std::min<int>(max_dur, utt.size());
+            std::uniform_int_distribution<int> dur_dist { min_dur, longest };
+
+            for (int c = 0; c < ncheck; ++c) {
+                int dur = dur_dist(gen);
+                std::uniform_int_distribution<int> start_dist { 0, int(utt.size()) - dur };
+                int start = start_dist(gen);
+
+                seg_t span { utt.begin() + start, utt.begin() + start + dur };
+                double const *v = table.at(start, dur);
+
+                if (std::isnan(v[0])) {
+                    continue;
+                }
+
+                la::vector<double> e;
+
+                if (mode == "dtw") {
+                    e = embed::dtw_embed(span, basis);
+                } else {
+                    e = embed::conv_embed(embed::to_tensor(span), basis_tensor).as_vector();
+                }
+
+                if (e.size() != table.dim) {
+                    std::cerr << "embedding has dimension " << e.size() << ", the span table has "
+                        << table.dim << std::endl;
+                    exit(1);
+                }
+
+                // relative, so that one tolerance fits both precisions
+                for (int b = 0; b < table.dim; ++b) {
+                    max_diff = std::max(max_diff, std::fabs(e(b) - v[b]) / std::max(1.0, std::fabs(e(b))));
+                }
+
+                ++nchecked;
+            }
+        }
+
+        {
+            profile::scope prof { "write" };
+            writer.write(name, table);
+        }
+
+        if (output::enabled(output::detail)) {
+            std::cout << name << " " << utt.size() << '\n';
+        }
+    }
+
+    writer.close();
+
+    profile::count("utterances", nutt);
+    profile::count("spans", nspan);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "utterances: " << nutt << '\n';
+        std::cout << "spans: " << nspan << '\n';
+
+        if (nchecked > 0) {
+            std::cout << "checked spans: " << nchecked << '\n';
+            std::cout << "max relative difference: " << max_diff << '\n';
+        }
+    }
+
+    return 0;
+}
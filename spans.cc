@@ -0,0 +1,363 @@
+#include "spans.h"
+#include "subseq.h"
+#include "unsupseg/embed.h"
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+
+namespace spans {
+
+    static char const span_magic[4] = { 'S', 'P', 'A', 'N' };
+
+    void span_table::resize(int frames, int min_dur, int max_dur, int dim)
+    {
+        this->frames = frames;
+        this->min_dur = min_dur;
+        this->max_dur = max_dur;
+        this->dim = dim;
+
+        data.assign((long) frames * ndur() * dim, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    int span_table::ndur() const
+    {
+        return max_dur - min_dur + 1;
+    }
+
+    bool span_table::valid(int start, int dur) const
+    {
+        return start >= 0 && dur >= min_dur && dur <= max_dur && start + dur <= frames;
+    }
+
+    double* span_table::at(int start, int dur)
+    {
+        return data.data() + ((long) start * ndur() + dur - min_dur) * dim;
+    }
+
+    double const* span_table::at(int start, int dur) const
+    {
+        return data.data() + ((long) start * ndur() + dur - min_dur) * dim;
+    }
+
+    template <class T>
+    span_table dtw_spans(std::vector<std::vector<T>> const& utt,
+        std::vector<std::vector<std::vector<T>>> const& basis,
+        int min_dur, int max_dur, thread_pool::pool& pool)
+    {
+        span_table result;
+        result.resize(utt.size(), min_dur, max_dur, basis.size());
+
+        pool.parallel_for(utt.size(), [&](int s) {
+            dtw_start(utt, basis, s, min_dur, max_dur, result.at(s, min_dur));
+        });
+
+        return result;
+    }
+
+    template <class T>
+    void dtw_start(std::vector<std::vector<T>> const& utt,
+        std::vector<std::vector<std::vector<T>>> const& basis,
+        int start, int min_dur, int max_dur, double *out)
+    {
+        int end = std::min<int>(utt.size(), start + max_dur);
+        int dim = basis.size();
+
+        // one pair of rows per thread, grown to the longest basis entry
+        // seen, so that repeated calls from a pool worker do not allocate
+        thread_local std::vector<double> prev;
+        thread_local std::vector<double> cur;
+
+        for (int b = 0; b < basis.size(); ++b) {
+            std::vector<std::vector<T>> const& ref = basis[b];
+            int m = ref.size();
+
+            if (prev.size() < m) {
+                prev.resize(m);
+                cur.resize(m);
+            }
+
+            for (int t = start; t < end; ++t) {
+                for (int j = 0; j < m; ++j) {
+                    double d = subseq::frame_dist(utt[t], ref[j]);
+
+                    if (t == start && j == 0) {
+                        cur[j] = d;
+                    } else if (t == start) {
+                        cur[j] = d + cur[j - 1];
+                    } else if (j == 0) {
+                        cur[j] = d + prev[j];
+                    } else {
+                        cur[j] = d + std::min(std::min(prev[j], cur[j - 1]), prev[j - 1]);
+                    }
+                }
+
+                int dur = t - start + 1;
+
+                if (dur >= min_dur) {
+                    out[(long) (dur - min_dur) * dim + b] = cur[m - 1];
+                }
+
+                std::swap(prev, cur);
+            }
+        }
+    }
+
+    void range_max::build(std::vector<double> const& x, int n, int dim)
+    {
+        this->n = n;
+        this->dim = dim;
+
+        level.clear();
+        level.push_back(std::vector<double> { x.begin(), x.begin() + (long) n * dim });
+
+        for (int k = 1; (1 << k) <= n; ++k) {
+            std::vector<double> const& prev = level.back();
+            int half = 1 << (k - 1);
+            int rows = n - (1 << k) + 1;
+
+            std::vector<double> cur;
+            cur.resize((long) rows * dim);
+
+            for (int i = 0; i < rows; ++i) {
+                for (int c = 0; c < dim; ++c) {
+                    cur[(long) i * dim + c] = std::max(prev[(long) i * dim + c],
+                        prev[(long) (i + half) * dim + c]);
+                }
+            }
+
+            level.push_back(std::move(cur));
+        }
+    }
+
+    void range_max::query(int begin, int end, double *out) const
+    {
+        int k = 0;
+        while ((2 << k) <= end - begin) {
+            ++k;
+        }
+
+        double const *a = level[k].data() + (long) begin * dim;
+        double const *b = level[k].data() + (long) (end - (1 << k)) * dim;
+
+        for (int c = 0; c < dim; ++c) {
+            out[c] = std::max(a[c], b[c]);
+        }
+    }
+
+    bool conv_response::span_max(int start, int dur, double *out) const
+    {
+        int end = start + dur - width + 1;
+
+        if (end <= start || end > positions) {
+            return false;
+        }
+
+        max.query(start, end, out);
+
+        return true;
+    }
+
+    bool conv_response::span_mean(int start, int dur, double *out) const
+    {
+        int end = start + dur - width + 1;
+
+        if (end <= start || end > positions) {
+            return false;
+        }
+
+        for (int c = 0; c < dim; ++c) {
+            out[c] = (prefix[(long) end * dim + c] - prefix[(long) start * dim + c]) / (end - start);
+        }
+
+        return true;
+    }
+
+    conv_response conv_correlate(seg_t const& utt, la::tensor<double> const& basis_tensor)
+    {
+        conv_response result;
+        result.width = basis_tensor.size(0);
+        result.dim = basis_tensor.size(2);
+        result.positions = std::max<int>(0, int(utt.size()) - result.width + 1);
+
+        std::vector<double> response;
+        response.resize((long) result.positions * result.dim);
+
+        if (result.positions > 0) {
+            la::tensor<double> utt_tensor = embed::to_tensor(utt);
+
+            // all filter positions of the utterance as one matrix, so the
+            // whole correlation is a single multiply
+            la::tensor<double> utt_lin;
+            utt_lin.resize({utt_tensor.size(0) - basis_tensor.size(0) + 1,
+                utt_tensor.size(1) - basis_tensor.size(1) + 1,
+                basis_tensor.size(0) * basis_tensor.size(1)});
+
+            la::corr_linearize_valid(utt_lin, utt_tensor, basis_tensor.size(0), basis_tensor.size(1));
+
+            la::tensor<double> res = la::mul(utt_lin, basis_tensor);
+
+            for (int i = 0; i < res.size(0); ++i) {
+                for (int c = 0; c < res.size(2); ++c) {
+                    double m = -std::numeric_limits<double>::infinity();
+
+                    for (int j = 0; j < res.size(1); ++j) {
+                        m = std::max(m, res({i, j, c}));
+                    }
+
+                    response[(long) i * result.dim + c] = m;
+                }
+            }
+        }
+
+        result.prefix.assign((long) (result.positions + 1) * result.dim, 0);
+
+        for (int i = 0; i < result.positions; ++i) {
+            for (int c = 0; c < result.dim; ++c) {
+                result.prefix[(long) (i + 1) * result.dim + c] = result.prefix[(long) i * result.dim + c]
+                    + response[(long) i * result.dim + c];
+            }
+        }
+
+        if (result.positions > 0) {
+            result.max.build(response, result.positions, result.dim);
+        }
+
+        return result;
+    }
+
+    span_table conv_spans(seg_t const& utt, la::tensor<double> const& basis_tensor,
+        int min_dur, int max_dur, pooling pool_type, thread_pool::pool& pool)
+    {
+        conv_response response = conv_correlate(utt, basis_tensor);
+
+        span_table result;
+        result.resize(utt.size(), min_dur, max_dur, response.dim);
+
+        pool.parallel_for(utt.size(), [&](int s) {
+            for (int dur = min_dur; dur <= max_dur && s + dur <= utt.size(); ++dur) {
+                if (pool_type == pooling::max) {
+                    response.span_max(s, dur, result.at(s, dur));
+                } else {
+                    response.span_mean(s, dur, result.at(s, dur));
+                }
+            }
+        });
+
+        return result;
+    }
+
+    void writer::open(std::string const& filename)
+    {
+        this->filename = filename;
+
+        buf.resize(1 << 20);
+        ofs.rdbuf()->pubsetbuf(buf.data(), buf.size());
+
+        ofs.open(filename + ".tmp", std::ios::binary);
+
+        if (!ofs) {
+            throw std::runtime_error("failed to open " + filename + ".tmp");
+        }
+
+        ofs.write(span_magic, sizeof(span_magic));
+    }
+
+    void writer::write(std::string const& name, span_table const& t)
+    {
+        int len = name.size();
+        ofs.write(reinterpret_cast<char const*>(&len), sizeof(int));
+        ofs.write(name.data(), len);
+
+        ofs.write(reinterpret_cast<char const*>(&t.frames), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&t.min_dur), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&t.max_dur), sizeof(int));
+        ofs.write(reinterpret_cast<char const*>(&t.dim), sizeof(int));
+
+        // one start at a time, so the float copy stays small
+        long stride = (long) t.ndur() * t.dim;
+        row.resize(stride);
+
+        for (int s = 0; s < t.frames; ++s) {
+            std::copy(t.data.begin() + s * stride, t.data.begin() + (s + 1) * stride, row.begin());
+            ofs.write(reinterpret_cast<char const*>(row.data()), stride * sizeof(float));
+        }
+    }
+
+    void writer::close()
+    {
+        ofs.close();
+
+        if (!ofs || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    void reader::open(std::string const& filename)
+    {
+        ifs.open(filename, std::ios::binary);
+
+        char magic[4];
+        ifs.read(magic, sizeof(magic));
+
+        if (!ifs || std::memcmp(magic, span_magic, sizeof(magic)) != 0) {
+            throw std::runtime_error(filename + " is not a span embedding file");
+        }
+    }
+
+    bool reader::read(std::string& name, span_table& t)
+    {
+        int len;
+        ifs.read(reinterpret_cast<char*>(&len), sizeof(int));
+
+        if (!ifs) {
+            return false;
+        }
+
+        name.resize(len);
+        ifs.read(&name[0], len);
+
+        int frames;
+        int min_dur;
+        int max_dur;
+        int dim;
+
+        ifs.read(reinterpret_cast<char*>(&frames), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&min_dur), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&max_dur), sizeof(int));
+        ifs.read(reinterpret_cast<char*>(&dim), sizeof(int));
+
+        t.resize(frames, min_dur, max_dur, dim);
+
+        long stride = (long) t.ndur() * t.dim;
+        row.resize(stride);
+
+        for (int s = 0; s < frames; ++s) {
+            ifs.read(reinterpret_cast<char*>(row.data()), stride * sizeof(float));
+            std::copy(row.begin(), row.end(), t.data.begin() + s * stride);
+        }
+
+        if (!ifs) {
+            throw std::runtime_error("truncated span embedding record " + name);
+        }
+
+        return true;
+    }
+
+
+    template span_table dtw_spans(std::vector<std::vector<double>> const& utt,
+        std::vector<std::vector<std::vector<double>>> const& basis,
+        int min_dur, int max_dur, thread_pool::pool& pool);
+    template span_table dtw_spans(std::vector<std::vector<float>> const& utt,
+        std::vector<std::vector<std::vector<float>>> const& basis,
+        int min_dur, int max_dur, thread_pool::pool& pool);
+
+    template void dtw_start(std::vector<std::vector<double>> const& utt,
+        std::vector<std::vector<std::vector<double>>> const& basis,
+        int start, int min_dur, int max_dur, double *out);
+    template void dtw_start(std::vector<std::vector<float>> const& utt,
+        std::vector<std::vector<std::vector<float>>> const& basis,
+        int start, int min_dur, int max_dur, double *out);
+
+}
@@ -0,0 +1,163 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+#include "la/la.h"
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+
+namespace spans {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    /*
+     * Embeddings of every span [start, start + dur) of an utterance with
+     * min_dur <= dur <= max_dur, indexed by (start, dur).  Spans running
+     * past the end of the utterance have no entry; their slots are NaN
+     * so that every lookup is one multiply-add.
+     */
+    struct span_table {
+        int frames;
+        int min_dur;
+        int max_dur;
+        int dim;
+
+        // span (start, dur) starts at data[(start * ndur() + dur - min_dur) * dim]
+        std::vector<double> data;
+
+        void resize(int frames, int min_dur, int max_dur, int dim);
+
+        int ndur() const;
+
+        bool valid(int start, int dur) const;
+
+        double* at(int start, int dur);
+        double const* at(int start, int dur) const;
+    };
+
+    /*
+     * DTW embeddings of all spans.  For a fixed start and basis entry,
+     * one pass over the frames that follow fills the DTW matrix a row at
+     * a time, and the last cell of row t is the cost of the span ending
+     * at t, so all durations come from the same pass.  The frame
+     * distance and recurrence are those of dtw::dtw, which e2e-bench.sh
+     * checks through span-embed --check.  Starts are the tasks on the
+     * pool.  Frames are double or float; costs are double.  No basis
+     * entry may be empty.
+     */
+    template <class T>
+    span_table dtw_spans(std::vector<std::vector<T>> const& utt,
+        std::vector<std::vector<std::vector<T>>> const& basis,
+        int min_dur, int max_dur, thread_pool::pool& pool);
+
+    /*
+     * The pass for one start, for callers that only need some starts.
+     * out has room for max_dur - min_dur + 1 embeddings of basis.size()
+     * entries, in the order of a span_table row; spans past the end of
+     * the utterance are left untouched.  The DTW rows are kept per
+     * thread, so a call allocates only for a longer basis entry than the
+     * thread has seen.
+     */
+    template <class T>
+    void dtw_start(std::vector<std::vector<T>> const& utt,
+        std::vector<std::vector<std::vector<T>>> const& basis,
+        int start, int min_dur, int max_dur, double *out);
+
+    /*
+     * Sparse table for range maxima over the rows of an n x dim matrix:
+     * level k holds the maxima of the rows [i, i + 2^k).  Building takes
+     * O(n log n dim), and any range is covered by two overlapping blocks
+     * of one level, so a query is O(dim).
+     */
+    struct range_max {
+        int n;
+        int dim;
+
+        std::vector<std::vector<double>> level;
+
+        void build(std::vector<double> const& x, int n, int dim);
+
+        // maxima of the rows [begin, end), end > begin
+        void query(int begin, int end, double *out) const;
+    };
+
+    /*
+     * The response of a whole utterance to every conv basis filter,
+     * reduced to one value per (frame, filter) by taking the maximum over
+     * frequency offsets.  Filter position i covers frames [i, i + width).
+     * A span's embedding pools the positions that fit inside it, with
+     * the range maximum or, from the prefix sums, the mean.
+     */
+    struct conv_response {
+        int positions;
+        int width;
+        int dim;
+
+        range_max max;
+
+        // prefix[i * dim + c] is the sum of positions [0, i) of filter c
+        std::vector<double> prefix;
+
+        // false if the span is shorter than the filters
+        bool span_max(int start, int dur, double *out) const;
+        bool span_mean(int start, int dur, double *out) const;
+    };
+
+    /*
+     * One correlation of the whole utterance with basis_tensor, laid out
+     * as the filters of conv-kmeans-learn (time x frequency x filter).
+     */
+    conv_response conv_correlate(seg_t const& utt, la::tensor<double> const& basis_tensor);
+
+    enum class pooling {
+        max,
+        mean
+    };
+
+    /*
+     * conv embeddings of all spans from a single correlation.  Spans
+     * shorter than the filters stay NaN.
+     */
+    span_table conv_spans(seg_t const& utt, la::tensor<double> const& basis_tensor,
+        int min_dur, int max_dur, pooling pool_type, thread_pool::pool& pool);
+
+    /*
+     * A sequence of (name, span_table) records after the magic "SPAN".
+     * Each record is the name length and name, frames, min_dur,
+     * max_dur and dim as int32, then the table as float32.
+     */
+    struct writer {
+
+        void open(std::string const& filename);
+
+        void write(std::string const& name, span_table const& t);
+
+        // renames filename.tmp to filename
+        void close();
+
+    private:
+        std::string filename;
+        std::ofstream ofs;
+
+        std::vector<char> buf;
+        std::vector<float> row;
+
+    };
+
+    struct reader {
+
+        void open(std::string const& filename);
+
+        // false at the end of the file
+        bool read(std::string& name, span_table& t);
+
+    private:
+        std::ifstream ifs;
+        std::vector<float> row;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,329 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include "speech/speech.h"
+#include "unsupseg/embed.h"
+#include "subseq.h"
+#include "precision.h"
+#include "stream.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "stream-detect",
+        "Detect keywords in a stream of frames as they arrive",
+        {
+            {"target", "keyword templates: text batch, frame store, or - for stdin", true},
+            {"threshold", "", true},
+            {"mode", "dtw (default) or conv", false},
+            {"basis-batch", "for conv", false},
+            {"band", "for dtw, maximum distance from the diagonal", false},
+            {"precision", "double (default) or float", false},
+            {"input", "a file or fifo of frames, one per line (default stdin)", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    double threshold = std::stod(args.at("threshold"));
+
+    std::string mode = "dtw";
+    if (ebt::in(std::string("mode"), args)) {
+        mode = args.at("mode");
+    }
+
+    if (mode != "dtw" && mode != "conv") {
+        std::cerr << "unknown mode " << mode << std::endl;
+        exit(1);
+    }
+
+    if (mode == "conv" && !ebt::in(std::string("basis-batch"), args)) {
+        std::cerr << "conv mode needs --basis-batch" << std::endl;
+        exit(1);
+    }
+
+    int band = -1;
+    if (ebt::in(std::string("band"), args)) {
+        band = std::stoi(args.at("band"));
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    // the frames arrive on stdin unless --input is given
+    if (args.at("target") == "-" && !ebt::in(std::string("input"), args)) {
+        std::cerr << "--target=- needs --input for the frames" << std::endl;
+        exit(1);
+    }
+
+    std::vector<seg_t> targets;
+    std::vector<std::string> names;
+
+    {
+        frame_store::stream target_batch;
+        target_batch.open(args.at("target"));
+
+        std::string name;
+        seg_t target;
+
+        while (target_batch.next(name, target)) {
+            names.push_back(name);
+            targets.push_back(target);
+
+            if (targets.back().size() == 0) {
+                std::cerr << "target " << name << " has no frames" << std::endl;
+                exit(1);
+            }
+
+            for (auto& f: targets.back()) {
+                if (f.size() != targets.front().front().size()) {
+                    std::cerr << "target " << name << " has frames of dimension " << f.size()
+                        << ", expecting " << targets.front().front().size() << std::endl;
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    if (targets.size() == 0) {
+        std::cerr << "no targets in " << args.at("target") << std::endl;
+        exit(1);
+    }
+
+    // dtw keeps one column of the subsequence DTW per target; conv keeps
+    // a window as long as the target and compares embeddings
+    std::vector<subseq::matcher> matchers;
+
+    std::vector<subseq::basic_matcher<float>> matchers32;
+
+    // every frame must match the targets, or the distances and the conv
+    // read past the end of it
+    int frame_dim = targets.front().front().size();
+
+    la::tensor<double> basis_tensor;
+    std::unique_ptr<stream::conv_response> response;
+    std::vector<stream::conv_window> windows;
+    std::vector<la::vector<double>> target_embeds;
+
+    if (mode == "dtw" && prec == precision::scalar::f32) {
+        for (auto& target: targets) {
+            matchers32.push_back(subseq::basic_matcher<float> { precision::convert<float>(target), band });
+        }
+    } else if (mode == "dtw") {
+        for (auto& target: targets) {
+            matchers.push_back(subseq::matcher { target, band });
+        }
+    } else {
+        std::vector<seg_t> basis;
+        std::ifstream basis_batch { args.at("basis-batch") };
+
+        while (1) {
+            seg_t frames = speech::load_frame_batch(basis_batch);
+
+            if (!basis_batch) {
+                break;
+            }
+
+            if (frames.size() == 0) {
+                std::cerr << "basis entry " << basis.size() << " is empty" << std::endl;
+                exit(1);
+            }
+
+            basis.push_back(frames);
+        }
+
+        basis_tensor = embed::to_tensor(basis);
+
+        if (basis_tensor.size(1) > frame_dim) {
+            std::cerr << "conv basis frames of dimension " << basis_tensor.size(1)
+                << " are wider than the target frames of dimension " << frame_dim << std::endl;
+            exit(1);
+        }
+
+        response.reset(new stream::conv_response { basis_tensor });
+
+        for (auto& target: targets) {
+            if (target.size() < basis_tensor.size(0)) {
+                std::cerr << "target shorter than the conv basis" << std::endl;
+                exit(1);
+            }
+
+            la::tensor<double> e = embed::conv_embed(embed::to_tensor(target), basis_tensor);
+            la::vector<double> v = e.as_vector();
+            la::imul(v, 1.0 / la::norm(v));
+
+            target_embeds.push_back(v);
+            windows.push_back(stream::conv_window { int(target.size()), response->width(), response->dim() });
+        }
+    }
+
+    std::ifstream input_file;
+
+    if (ebt::in(std::string("input"), args)) {
+        input_file.open(args.at("input"));
+
+        if (!input_file) {
+            std::cerr << "failed to open " << args.at("input") << std::endl;
+            exit(1);
+        }
+    }
+
+    std::istream& input = ebt::in(std::string("input"), args) ? input_file : std::cin;
+
+    // a detection fires as soon as a target's cost drops below the
+    // threshold; matches starting inside the last detection are the same
+    // occurrence and stay quiet
+    std::vector<long> last_end;
+    last_end.assign(targets.size(), 0);
+
+    stream::latency lat;
+
+    long t = 0;
+    long nframes = 0;
+    long ndetect = 0;
+
+    std::string line;
+    std::vector<double> frame;
+    std::vector<float> frame32;
+    std::vector<double> frame_response;
+    la::vector<double> window_embed;
+
+    while (std::getline(input, line)) {
+        // "." separates independent streams
+        if (line == ".") {
+            for (auto& m: matchers) {
+                m.reset();
+            }
+            for (auto& m: matchers32) {
+                m.reset();
+            }
+            if (response) {
+                response->reset();
+            }
+            for (auto& w: windows) {
+                w.reset();
+            }
+
+            last_end.assign(targets.size(), 0);
+            t = 0;
+
+            continue;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+
+        frame.clear();
+
+        std::istringstream ss { line };
+        double v;
+        while (ss >> v) {
+            frame.push_back(v);
+        }
+
+        if (frame.size() == 0) {
+            continue;
+        }
+
+        if (frame.size() != frame_dim) {
+            std::cerr << "frame " << t << " has dimension " << frame.size()
+                << ", expecting " << frame_dim << std::endl;
+            exit(1);
+        }
+
+        if (prec == precision::scalar::f32) {
+            frame32.assign(frame.begin(), frame.end());
+        }
+
+        // the filter responses are shared by every target window
+        bool has_response = response && response->push(frame, frame_response);
+
+        for (int i = 0; i < targets.size(); ++i) {
+            double cost;
+            long start;
+
+            if (mode == "dtw" && prec == precision::scalar::f32) {
+                matchers32[i].push(frame32);
+                cost = matchers32[i].cost();
+                start = matchers32[i].start();
+            } else if (mode == "dtw") {
+                matchers[i].push(frame);
+                cost = matchers[i].cost();
+                start = matchers[i].start();
+            } else {
+                if (!has_response || !windows[i].push(frame_response, window_embed)) {
+                    continue;
+                }
+
+                double norm = la::norm(window_embed);
+
+                if (norm == 0) {
+                    continue;
+                }
+
+                double dot = 0;
+                for (int d = 0; d < window_embed.size(); ++d) {
+                    dot += window_embed(d) / norm * target_embeds[i](d);
+                }
+
+                cost = std::sqrt(std::max(0.0, 2 - 2 * dot));
+                start = t + 1 - targets[i].size();
+            }
+
+            if (cost < threshold && start >= last_end[i]) {
+                last_end[i] = t + 1;
+                ++ndetect;
+
+                if (output::enabled(output::results)) {
+                    std::cout << names[i] << " " << start << " " << t + 1 << " " << cost << '\n';
+                    std::cout.flush();
+                }
+            }
+        }
+
+        lat.add(std::chrono::steady_clock::now() - begin);
+
+        ++t;
+        ++nframes;
+    }
+
+    profile::count("frames", nframes);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "frames: " << nframes << '\n';
+        std::cout << "detections: " << ndetect << '\n';
+        std::cout << "latency mean: " << lat.mean_us() << " us" << '\n';
+        std::cout << "latency p50: <= " << lat.quantile_us(0.5) << " us" << '\n';
+        std::cout << "latency p99: <= " << lat.quantile_us(0.99) << " us" << '\n';
+        std::cout << "latency max: " << lat.max_us() << " us" << '\n';
+    }
+
+    return 0;
+}
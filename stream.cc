@@ -0,0 +1,175 @@
+#include "stream.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace stream {
+
+    conv_response::conv_response(la::tensor<double> const& basis_tensor)
+        : basis_tensor(basis_tensor)
+    {
+        width_ = basis_tensor.size(0);
+        height = basis_tensor.size(1);
+
+        reset();
+    }
+
+    void conv_response::reset()
+    {
+        t = 0;
+        ring.clear();
+        ring.resize(width_);
+    }
+
+    int conv_response::width() const
+    {
+        return width_;
+    }
+
+    int conv_response::dim() const
+    {
+        return basis_tensor.size(2);
+    }
+
+    bool conv_response::push(std::vector<double> const& frame, std::vector<double>& response)
+    {
+        ring[t % width_] = frame;
+        ++t;
+
+        if (t < width_) {
+            return false;
+        }
+
+        // filter position p covers frames [p, p + width)
+        int p = t - width_;
+        int nfreq = int(frame.size()) - height + 1;
+
+        response.resize(dim());
+
+        for (int c = 0; c < dim(); ++c) {
+            double r = -std::numeric_limits<double>::infinity();
+
+            for (int j = 0; j < nfreq; ++j) {
+                double sum = 0;
+
+                for (int k = 0; k < width_; ++k) {
+                    std::vector<double> const& f = ring[(p + k) % width_];
+
+                    for (int h = 0; h < height; ++h) {
+                        sum += basis_tensor({k, h, c}) * f[j + h];
+                    }
+                }
+
+                r = std::max(r, sum);
+            }
+
+            response[c] = r;
+        }
+
+        return true;
+    }
+
+    conv_window::conv_window(int window, int width, int dim)
+        : window(window), width(width)
+    {
+        max.resize(dim);
+
+        reset();
+    }
+
+    void conv_window::reset()
+    {
+        p = 0;
+
+        for (auto& q: max) {
+            q.clear();
+        }
+    }
+
+    bool conv_window::push(std::vector<double> const& response, la::vector<double>& embed)
+    {
+        // the window ending at frame t - 1 holds positions [t - window, p]
+        int t = p + width;
+
+        for (int c = 0; c < max.size(); ++c) {
+            auto& q = max[c];
+
+            while (!q.empty() && q.back().second <= response[c]) {
+                q.pop_back();
+            }
+
+            q.push_back(std::make_pair(p, response[c]));
+
+            while (q.front().first < t - window) {
+                q.pop_front();
+            }
+        }
+
+        ++p;
+
+        if (t < window) {
+            return false;
+        }
+
+        embed.resize(max.size());
+
+        for (int c = 0; c < max.size(); ++c) {
+            embed(c) = max[c].front().second;
+        }
+
+        return true;
+    }
+
+    latency::latency()
+        : n(0), sum(0), max(0)
+    {
+        bucket.resize(40);
+    }
+
+    void latency::add(std::chrono::steady_clock::duration d)
+    {
+        double us = std::chrono::duration<double, std::micro>(d).count();
+
+        int b = 0;
+        while (b + 1 < bucket.size() && (1L << b) < us) {
+            ++b;
+        }
+
+        ++bucket[b];
+        ++n;
+        sum += us;
+        max = std::max(max, us);
+    }
+
+    long latency::count() const
+    {
+        return n;
+    }
+
+    double latency::mean_us() const
+    {
+        return n == 0 ? 0 : sum / n;
+    }
+
+    double latency::max_us() const
+    {
+        return max;
+    }
+
+    double latency::quantile_us(double q) const
+    {
+        long target = std::ceil(q * n);
+        long seen = 0;
+
+        for (int b = 0; b < bucket.size(); ++b) {
+            seen += bucket[b];
+
+            if (seen >= target) {
+                return 1L << b;
+            }
+        }
+
+        return max;
+    }
+
+}
@@ -0,0 +1,96 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "la/la.h"
+#include <vector>
+#include <deque>
+#include <chrono>
+
+namespace stream {
+
+    /*
+     * Per-filter conv responses of a stream, one filter position per new
+     * frame.  The last filter-width frames are kept in a ring, and the
+     * response of a filter at a position is its maximum over frequency.
+     * The responses only depend on the basis, so one conv_response feeds
+     * the windows of every target.
+     */
+    struct conv_response {
+
+        conv_response(la::tensor<double> const& basis_tensor);
+
+        // false until the first width frames are in; the response is then
+        // that of the position covering the last width frames
+        bool push(std::vector<double> const& frame, std::vector<double>& response);
+
+        void reset();
+
+        int width() const;
+
+        // number of filters
+        int dim() const;
+
+    private:
+        la::tensor<double> const& basis_tensor;
+        int width_;
+        int height;
+        int t;
+
+        std::vector<std::vector<double>> ring;
+
+    };
+
+    /*
+     * Conv embedding of the last window frames of a stream, updated one
+     * filter position at a time from the responses of a conv_response.
+     * A monotonic deque per filter keeps the running maximum over the
+     * positions in the window, so memory is O(window) per filter whatever
+     * the stream length.
+     */
+    struct conv_window {
+
+        conv_window(int window, int width, int dim);
+
+        // false until the first window is full
+        bool push(std::vector<double> const& response, la::vector<double>& embed);
+
+        void reset();
+
+    private:
+        int window;
+        int width;
+        int p;
+
+        // (position, response) pairs with decreasing responses
+        std::vector<std::deque<std::pair<int, double>>> max;
+
+    };
+
+    /*
+     * Per-frame latency in power-of-two buckets of microseconds, so that
+     * an endless stream keeps constant memory.
+     */
+    struct latency {
+
+        latency();
+
+        void add(std::chrono::steady_clock::duration d);
+
+        long count() const;
+        double mean_us() const;
+        double max_us() const;
+
+        // upper bound of the bucket holding quantile q
+        double quantile_us(double q) const;
+
+    private:
+        std::vector<long> bucket;
+        long n;
+        double sum;
+        double max;
+
+    };
+
+}
+
+#endif
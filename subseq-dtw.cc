@@ -0,0 +1,145 @@
+#include "ebt/ebt.h"
+#include <fstream>
+#include <algorithm>
+#include "speech/speech.h"
+#include "thread-pool.h"
+#include "subseq.h"
+#include "precision.h"
+#include "frame-store.h"
+#include "profile.h"
+#include "output.h"
+
+using seg_t = std::vector<std::vector<double>>;
+
+int main(int argc, char *argv[])
+{
+    output::init();
+
+    ebt::ArgumentSpec spec {
+        "subseq-dtw",
+        "Find occurrences of a query in whole utterances with subsequence DTW",
+        {
+            {"frame-batch", "utterances: text batch, frame store, or - for stdin", true},
+            {"query", "a frame batch holding the query", true},
+            {"threshold", "report local minima of the normalized cost below this", true},
+            {"band", "maximum distance from the diagonal, in frames", false},
+            {"precision", "double (default) or float", false},
+            {"nthread", "", false},
+            {"profile", "", false},
+            {"verbosity", "quiet, results, summary or detail (default)", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    output::echo(argc, argv);
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    output::setup(args);
+
+    double threshold = std::stod(args.at("threshold"));
+
+    int band = -1;
+    if (ebt::in(std::string("band"), args)) {
+        band = std::stoi(args.at("band"));
+    }
+
+    precision::scalar prec = precision::scalar::f64;
+
+    if (ebt::in(std::string("precision"), args) && !precision::parse(args.at("precision"), prec)) {
+        std::cerr << "unknown precision " << args.at("precision") << std::endl;
+        exit(1);
+    }
+
+    std::ifstream query_batch { args.at("query") };
+    seg_t query = speech::load_frame_batch(query_batch);
+    query_batch.close();
+
+    if (query.size() == 0) {
+        std::cerr << "empty query in " << args.at("query") << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<float>> query32 = precision::convert<float>(query);
+
+    thread_pool::pool& pool = thread_pool::global();
+
+    frame_store::stream frame_batch;
+    frame_batch.open(args.at("frame-batch"));
+
+    int nutt = 0;
+
+    // utterances are independent; a batch is searched in parallel and
+    // reported in input order
+    int batch_size = 4 * pool.size();
+
+    long nframes = 0;
+    long nmatches = 0;
+
+    bool more = true;
+
+    while (more) {
+        std::vector<seg_t> utts;
+        std::vector<std::string> names;
+
+        {
+            profile::scope prof { "load_frame_batch" };
+
+            while (utts.size() < batch_size) {
+                std::string name;
+                seg_t utt;
+
+                if (!frame_batch.next(name, utt)) {
+                    more = false;
+                    break;
+                }
+
+                names.push_back(name);
+                utts.push_back(utt);
+            }
+        }
+
+        nutt += utts.size();
+
+        std::vector<std::vector<subseq::match>> matches;
+        matches.resize(utts.size());
+
+        {
+            profile::scope prof { "subseq_dtw" };
+
+            pool.parallel_for(utts.size(), [&](int i) {
+                if (prec == precision::scalar::f32) {
+                    matches[i] = subseq::search(query32, precision::convert<float>(utts[i]), band, threshold);
+                } else {
+                    matches[i] = subseq::search(query, utts[i], band, threshold);
+                }
+            });
+        }
+
+        for (int i = 0; i < utts.size(); ++i) {
+            nframes += utts[i].size();
+            nmatches += matches[i].size();
+
+            if (output::enabled(output::results)) {
+                for (auto& m: matches[i]) {
+                    std::cout << names[i] << " " << m.start << " " << m.end + 1
+                        << " " << m.cost << '\n';
+                }
+            }
+        }
+    }
+
+    profile::count("utterances", nutt);
+    profile::count("frames", nframes);
+
+    if (output::enabled(output::summary)) {
+        std::cout << "utterances: " << nutt << '\n';
+        std::cout << "matches: " << nmatches << '\n';
+    }
+
+    return 0;
+}
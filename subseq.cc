@@ -0,0 +1,227 @@
+#include "subseq.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace subseq {
+
+    template <class T>
+    double frame_dist(std::vector<T> const& a, std::vector<T> const& b)
+    {
+        T const *pa = a.data();
+        T const *pb = b.data();
+        int n = a.size();
+
+        double sum = 0;
+
+        for (int i = 0; i < n; ++i) {
+            double d = double(pa[i]) - pb[i];
+            sum += d * d;
+        }
+
+        return std::sqrt(sum);
+    }
+
+    template <class T>
+    basic_matcher<T>::basic_matcher(std::vector<std::vector<T>> const& query, int band)
+        : query(query), band(band), t(0)
+    {
+        if (query.size() == 0) {
+            throw std::runtime_error("subsequence matcher needs a non-empty query");
+        }
+
+        reset();
+    }
+
+    template <class T>
+    void basic_matcher<T>::reset()
+    {
+        double inf = std::numeric_limits<double>::infinity();
+
+        t = 0;
+
+        acc.assign(query.size(), inf);
+        len.assign(query.size(), 0);
+        from.assign(query.size(), -1);
+
+        prev_acc.assign(query.size(), inf);
+        prev_len.assign(query.size(), 0);
+        prev_from.assign(query.size(), -1);
+    }
+
+    template <class T>
+    void basic_matcher<T>::push(std::vector<T> const& frame)
+    {
+        double inf = std::numeric_limits<double>::infinity();
+
+        std::swap(acc, prev_acc);
+        std::swap(len, prev_len);
+        std::swap(from, prev_from);
+
+        for (int i = 0; i < query.size(); ++i) {
+            double d = frame_dist(query[i], frame);
+
+            if (i == 0) {
+                // free start: the first query frame may align anywhere
+                acc[0] = d;
+                len[0] = 1;
+                from[0] = t;
+                continue;
+            }
+
+            // predecessors: (i - 1, t - 1), (i, t - 1), (i - 1, t),
+            // compared by normalized cost so long paths are not penalized
+            double best = inf;
+            int best_len = 0;
+            int best_from = -1;
+
+            auto consider = [&](double a, int l, int f) {
+                if (l > 0 && a / l < (best_len == 0 ? inf : best / best_len)) {
+                    best = a;
+                    best_len = l;
+                    best_from = f;
+                }
+            };
+
+            consider(prev_acc[i - 1], prev_len[i - 1], prev_from[i - 1]);
+            consider(prev_acc[i], prev_len[i], prev_from[i]);
+            consider(acc[i - 1], len[i - 1], from[i - 1]);
+
+            if (best_len == 0 || (band >= 0 && std::abs((t - best_from) - i) > band)) {
+                acc[i] = inf;
+                len[i] = 0;
+                from[i] = -1;
+            } else {
+                acc[i] = best + d;
+                len[i] = best_len + 1;
+                from[i] = best_from;
+            }
+        }
+
+        ++t;
+    }
+
+    template <class T>
+    double basic_matcher<T>::cost() const
+    {
+        int last = query.size() - 1;
+
+        if (len[last] == 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+
+        return acc[last] / len[last];
+    }
+
+    template <class T>
+    int basic_matcher<T>::start() const
+    {
+        return from[query.size() - 1];
+    }
+
+    template <class T>
+    int basic_matcher<T>::frames() const
+    {
+        return t;
+    }
+
+    template <class T>
+    void cost_curve(std::vector<std::vector<T>> const& query,
+        std::vector<std::vector<T>> const& utt, int band,
+        std::vector<double>& cost, std::vector<int>& start)
+    {
+        cost.resize(utt.size());
+        start.resize(utt.size());
+
+        if (query.size() == 0) {
+            cost.assign(utt.size(), std::numeric_limits<double>::infinity());
+            start.assign(utt.size(), -1);
+            return;
+        }
+
+        basic_matcher<T> m { query, band };
+
+        for (int t = 0; t < utt.size(); ++t) {
+            m.push(utt[t]);
+            cost[t] = m.cost();
+            start[t] = m.start();
+        }
+    }
+
+    std::vector<match> local_minima(std::vector<double> const& cost,
+        std::vector<int> const& start, double threshold)
+    {
+        std::vector<match> cand;
+
+        for (int t = 0; t < cost.size(); ++t) {
+            if (!(cost[t] < threshold)) {
+                continue;
+            }
+
+            if (t > 0 && cost[t - 1] < cost[t]) {
+                continue;
+            }
+
+            if (t + 1 < cost.size() && cost[t + 1] <= cost[t]) {
+                continue;
+            }
+
+            cand.push_back(match { start[t], t, cost[t] });
+        }
+
+        std::sort(cand.begin(), cand.end(), [](match const& a, match const& b) {
+            return a.cost < b.cost;
+        });
+
+        std::vector<match> result;
+
+        for (auto& c: cand) {
+            bool overlap = false;
+
+            for (auto& r: result) {
+                if (c.start <= r.end && r.start <= c.end) {
+                    overlap = true;
+                    break;
+                }
+            }
+
+            if (!overlap) {
+                result.push_back(c);
+            }
+        }
+
+        return result;
+    }
+
+    template <class T>
+    std::vector<match> search(std::vector<std::vector<T>> const& query,
+        std::vector<std::vector<T>> const& utt, int band, double threshold)
+    {
+        std::vector<double> cost;
+        std::vector<int> start;
+
+        cost_curve(query, utt, band, cost, start);
+
+        return local_minima(cost, start, threshold);
+    }
+
+    template double frame_dist(std::vector<double> const& a, std::vector<double> const& b);
+    template double frame_dist(std::vector<float> const& a, std::vector<float> const& b);
+
+    template struct basic_matcher<double>;
+    template struct basic_matcher<float>;
+
+    template void cost_curve(std::vector<std::vector<double>> const& query,
+        std::vector<std::vector<double>> const& utt, int band,
+        std::vector<double>& cost, std::vector<int>& start);
+    template void cost_curve(std::vector<std::vector<float>> const& query,
+        std::vector<std::vector<float>> const& utt, int band,
+        std::vector<double>& cost, std::vector<int>& start);
+
+    template std::vector<match> search(std::vector<std::vector<double>> const& query,
+        std::vector<std::vector<double>> const& utt, int band, double threshold);
+    template std::vector<match> search(std::vector<std::vector<float>> const& query,
+        std::vector<std::vector<float>> const& utt, int band, double threshold);
+
+}
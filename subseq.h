@@ -0,0 +1,90 @@
+#ifndef SUBSEQ_H
+#define SUBSEQ_H
+
+#include <vector>
+#include <limits>
+
+namespace subseq {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    /*
+     * Euclidean distance, summed in double.  The kernels below are
+     * defined for T = double and T = float; float only narrows the frames
+     * they read, and costs accumulate in double either way.
+     */
+    template <class T>
+    double frame_dist(std::vector<T> const& a, std::vector<T> const& b);
+
+    /*
+     * Subsequence DTW of a query against a stream of frames, one column
+     * per frame.  The match may start and end anywhere in the stream;
+     * each cell keeps its accumulated cost, its path length and the
+     * stream frame its path started at.  With band >= 0, a path that
+     * strays more than band frames from the diagonal through its start
+     * is dropped.  Memory is O(query length).  The matcher keeps its
+     * own copy of the query, which must not be empty.
+     */
+    template <class T>
+    struct basic_matcher {
+
+        basic_matcher(std::vector<std::vector<T>> const& query, int band = -1);
+
+        // feeds stream frame t (frames must come in order from 0)
+        void push(std::vector<T> const& frame);
+
+        // after a push: the path-length-normalized cost of the best match
+        // ending at the last frame, and where it starts
+        double cost() const;
+        int start() const;
+
+        int frames() const;
+
+        void reset();
+
+    private:
+        std::vector<std::vector<T>> query;
+        int band;
+        int t;
+
+        std::vector<double> acc;
+        std::vector<int> len;
+        std::vector<int> from;
+
+        std::vector<double> prev_acc;
+        std::vector<int> prev_len;
+        std::vector<int> prev_from;
+
+    };
+
+    using matcher = basic_matcher<double>;
+
+    struct match {
+        int start;
+        int end;
+        double cost;
+    };
+
+    /*
+     * The normalized cost of the best match ending at every frame of utt,
+     * in one O(|query| |utt|) pass.
+     */
+    template <class T>
+    void cost_curve(std::vector<std::vector<T>> const& query,
+        std::vector<std::vector<T>> const& utt, int band,
+        std::vector<double>& cost, std::vector<int>& start);
+
+    /*
+     * Local minima of the cost curve under threshold, best first, with
+     * matches that overlap a better one dropped.
+     */
+    std::vector<match> local_minima(std::vector<double> const& cost,
+        std::vector<int> const& start, double threshold);
+
+    template <class T>
+    std::vector<match> search(std::vector<std::vector<T>> const& query,
+        std::vector<std::vector<T>> const& utt, int band, double threshold);
+
+}
+
+#endif
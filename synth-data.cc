@@ -0,0 +1,125 @@
+#include "la/la.h"
+#include "ebt/ebt.h"
+#include <fstream>
+#include <random>
+#include "nn/tensor-tree.h"
+#include "synth.h"
+
+std::shared_ptr<tensor_tree::vertex> make_tensor_tree()
+{
+    tensor_tree::vertex root;
+
+    root.children.push_back(tensor_tree::make_tensor("filters"));
+
+    return std::make_shared<tensor_tree::vertex>(root);
+}
+
+int main(int argc, char *argv[])
+{
+    ebt::ArgumentSpec spec {
+        "synth-data",
+        "Generate a deterministic synthetic corpus",
+        {
+            {"output-dir", "", true},
+            {"nutt", "", false},
+            {"utt-frames", "", false},
+            {"nseg", "", false},
+            {"seg-frames", "", false},
+            {"dim", "", false},
+            {"nbasis", "", false},
+            {"basis-frames", "", false},
+            {"nlabel", "", false},
+            {"nfilter", "", false},
+            {"filter-frames", "", false},
+            {"seed", "", false},
+        }
+    };
+
+    if (argc == 1) {
+        ebt::usage(spec);
+        exit(1);
+    }
+
+    for (int i = 0; i < argc; ++i) {
+        std::cout << argv[i] << " ";
+    }
+    std::cout << std::endl;
+
+    std::unordered_map<std::string, std::string> args = ebt::parse_args(argc, argv, spec);
+
+    auto get = [&](std::string const& key, int value) {
+        return ebt::in(key, args) ? std::stoi(args.at(key)) : value;
+    };
+
+    std::string dir = args.at("output-dir");
+
+    int nutt = get("nutt", 100);
+    int utt_frames = get("utt-frames", 300);
+    int nseg = get("nseg", 500);
+    int seg_frames = get("seg-frames", 40);
+    int dim = get("dim", 40);
+    int nbasis = get("nbasis", 50);
+    int basis_frames = get("basis-frames", 30);
+    int nlabel = get("nlabel", 10);
+    int nfilter = get("nfilter", 16);
+    int filter_frames = get("filter-frames", 10);
+
+    std::default_random_engine gen { (unsigned long) get("seed", 1) };
+
+    // lengths vary by +-50% around the requested mean
+    auto length = [&](int mean) {
+        std::uniform_int_distribution<int> dist { std::max(2, mean / 2), std::max(2, mean * 3 / 2) };
+        return dist(gen);
+    };
+
+    std::ofstream utt_ofs { dir + "/utt.logmel" };
+    for (int i = 0; i < nutt; ++i) {
+        synth::write_frame_batch(utt_ofs, std::to_string(i) + ".logmel", synth::logmel(length(utt_frames), dim, gen));
+    }
+    utt_ofs.close();
+
+    // segments stay under 100 frames, the longest duration rsg models
+    std::ofstream seg_ofs { dir + "/seg.logmel" };
+    std::ofstream label_ofs { dir + "/seg.label" };
+    std::uniform_int_distribution<int> label_dist { 0, nlabel - 1 };
+    for (int i = 0; i < nseg; ++i) {
+        synth::write_frame_batch(seg_ofs, std::to_string(i) + ".logmel",
+            synth::logmel(std::min(99, length(seg_frames)), dim, gen));
+        label_ofs << i << ".label" << std::endl;
+        label_ofs << "u" << label_dist(gen) << std::endl;
+        label_ofs << "." << std::endl;
+    }
+    seg_ofs.close();
+    label_ofs.close();
+
+    std::ofstream label_set_ofs { dir + "/label-set" };
+    for (int i = 0; i < nlabel; ++i) {
+        label_set_ofs << "u" << i << std::endl;
+    }
+    label_set_ofs.close();
+
+    std::ofstream basis_ofs { dir + "/basis.logmel" };
+    for (int i = 0; i < nbasis; ++i) {
+        synth::write_frame_batch(basis_ofs, std::to_string(i) + ".logmel", synth::logmel(basis_frames, dim, gen));
+    }
+    basis_ofs.close();
+
+    std::ofstream target_ofs { dir + "/target.logmel" };
+    synth::write_frame_batch(target_ofs, "target.logmel", synth::logmel(seg_frames, dim, gen));
+    target_ofs.close();
+
+    std::shared_ptr<tensor_tree::vertex> param = make_tensor_tree();
+    la::tensor<double>& filters = tensor_tree::get_tensor(param->children[0]);
+    filters.resize({ (unsigned int) filter_frames, (unsigned int) dim, (unsigned int) nfilter });
+
+    std::normal_distribution<double> normal { 0, 1 };
+    for (int i = 0; i < filters.vec_size(); ++i) {
+        filters.data()[i] = normal(gen);
+    }
+
+    std::ofstream param_ofs { dir + "/conv-param" };
+    tensor_tree::save_tensor(param, param_ofs);
+    param_ofs.close();
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "synth.h"
+#include <cmath>
+#include <algorithm>
+
+namespace synth {
+
+    seg_t logmel(int nframes, int dim, std::default_random_engine& gen)
+    {
+        std::uniform_real_distribution<double> unif { 0, 1 };
+        std::normal_distribution<double> normal { 0, 1 };
+
+        int npeak = 3;
+
+        std::vector<double> center;
+        std::vector<double> height;
+
+        for (int p = 0; p < npeak; ++p) {
+            center.push_back(unif(gen) * dim);
+            height.push_back(2 + 3 * unif(gen));
+        }
+
+        double energy = 0;
+
+        seg_t result;
+
+        for (int t = 0; t < nframes; ++t) {
+            energy = 0.9 * energy + 0.3 * normal(gen);
+
+            for (int p = 0; p < npeak; ++p) {
+                center[p] += 0.5 * normal(gen);
+                center[p] = std::max(0.0, std::min<double>(dim - 1, center[p]));
+            }
+
+            std::vector<double> frame;
+            frame.resize(dim);
+
+            for (int d = 0; d < dim; ++d) {
+                double v = -2.0 * d / dim + energy;
+
+                for (int p = 0; p < npeak; ++p) {
+                    double x = (d - center[p]) / (0.05 * dim + 1);
+                    v += height[p] * std::exp(-0.5 * x * x);
+                }
+
+                frame[d] = v + 0.2 * normal(gen);
+            }
+
+            result.push_back(frame);
+        }
+
+        return result;
+    }
+
+    void write_frame_batch(std::ostream& os, std::string const& name, seg_t const& seg)
+    {
+        os << name << "\n";
+
+        for (auto& f: seg) {
+            for (int j = 0; j < f.size(); ++j) {
+                os << f[j];
+                if (j != f.size() - 1) {
+                    os << " ";
+                }
+            }
+            os << "\n";
+        }
+
+        os << ".\n";
+    }
+
+}
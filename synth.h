@@ -0,0 +1,25 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <vector>
+#include <string>
+#include <random>
+#include <ostream>
+
+namespace synth {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    /*
+     * Log-mel-like frames: a few slowly drifting spectral peaks over a
+     * sloped floor, plus frame noise.  Neighbouring frames and bins are
+     * correlated the way real filterbank features are, which matters for
+     * DTW paths and for text size.
+     */
+    seg_t logmel(int nframes, int dim, std::default_random_engine& gen);
+
+    void write_frame_batch(std::ostream& os, std::string const& name, seg_t const& seg);
+
+}
+
+#endif
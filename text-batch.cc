@@ -0,0 +1,478 @@
+#include "text-batch.h"
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace text_batch {
+
+    static char const index_magic[4] = { 'T', 'B', 'I', '2' };
+
+    static double const pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // the mapped file is not NUL terminated, so strtod gets a copy of
+    // the token
+    static char const* slow_parse(char const *p, char const *end, double& v)
+    {
+        char const *q = p;
+        while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') {
+            ++q;
+        }
+
+        std::string token { p, q };
+
+        char *e;
+        v = std::strtod(token.c_str(), &e);
+
+        return p + (e - token.c_str());
+    }
+
+    char const* parse_double(char const *p, char const *end, double& v)
+    {
+        char const *start = p;
+
+        bool neg = false;
+
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg = (*p == '-');
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exp10 = 0;
+        bool any = false;
+
+        // leading zeros carry no significant digits
+        while (p < end && *p == '0') {
+            any = true;
+            ++p;
+        }
+
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                ++digits;
+            } else {
+                ++exp10;
+            }
+
+            any = true;
+            ++p;
+        }
+
+        bool truncated = (exp10 > 0);
+
+        if (p < end && *p == '.') {
+            ++p;
+
+            if (digits == 0) {
+                while (p < end && *p == '0') {
+                    --exp10;
+                    any = true;
+                    ++p;
+                }
+            }
+
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    ++digits;
+                    --exp10;
+                } else {
+                    truncated = true;
+                }
+
+                any = true;
+                ++p;
+            }
+        }
+
+        if (!any) {
+            // inf, nan and the like
+            return slow_parse(start, end, v);
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            char const *q = p + 1;
+            bool exp_neg = false;
+
+            if (q < end && (*q == '-' || *q == '+')) {
+                exp_neg = (*q == '-');
+                ++q;
+            }
+
+            if (q < end && *q >= '0' && *q <= '9') {
+                int e = 0;
+
+                while (q < end && *q >= '0' && *q <= '9') {
+                    if (e < 100000) {
+                        e = e * 10 + (*q - '0');
+                    }
+                    ++q;
+                }
+
+                exp10 += exp_neg ? -e : e;
+                p = q;
+            }
+        }
+
+        // exact when the mantissa fits in a double and the power of ten
+        // is exact, since one correctly rounded operation is then the
+        // correctly rounded result
+        if (!truncated && mantissa < (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+            double m = double(mantissa);
+            v = exp10 < 0 ? m / pow10[-exp10] : m * pow10[exp10];
+
+            if (neg) {
+                v = -v;
+            }
+
+            return p;
+        }
+
+        return slow_parse(start, end, v);
+    }
+
+    file::file()
+        : base(nullptr), length(0), data(nullptr)
+    {}
+
+    file::~file()
+    {
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+    }
+
+    void file::open(std::string const& filename, thread_pool::pool& pool)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd == -1) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        length = st.st_size;
+
+        if (length == 0) {
+            ::close(fd);
+            pos.clear();
+            return;
+        }
+
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            throw std::runtime_error("failed to map " + filename);
+        }
+
+        data = static_cast<char const*>(base);
+
+        madvise(base, length, MADV_SEQUENTIAL);
+
+        // a rewrite within the same second keeps st_mtime but not the
+        // nanoseconds, and a file replaced by rename has a new inode
+        std::vector<int64_t> key {
+            (int64_t) st.st_size,
+            (int64_t) st.st_ino,
+            (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec,
+            (int64_t) st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec
+        };
+
+        if (!load_index(filename + ".idx", key)) {
+            scan(pool);
+
+            // the sidecar is an optimization; a read-only directory is fine
+            try {
+                save_index(filename + ".idx", key);
+            } catch (std::exception const&) {
+            }
+        }
+    }
+
+    void file::scan(thread_pool::pool& pool)
+    {
+        // a record starts at 0 and after every "\n.\n"; each chunk
+        // reports the starts that fall inside it
+        int nchunk = std::max<int>(1, std::min<long>(length / (1 << 20) + 1, 4 * pool.size()));
+
+        std::vector<std::vector<long>> starts;
+        starts.resize(nchunk);
+
+        pool.parallel_for(nchunk, [&](int c) {
+            long begin = (long) length * c / nchunk;
+            long end = (long) length * (c + 1) / nchunk;
+
+            std::vector<long>& s = starts[c];
+
+            if (begin == 0) {
+                s.push_back(0);
+            }
+
+            // a start at p means data[p - 3, p) is "\n.\n"; the newline
+            // is searched in [begin - 1, end - 1) so starts land in
+            // [begin, end)
+            long p = std::max(begin, 2L);
+
+            while (p < end) {
+                void const *hit = std::memchr(data + p - 1, '\n', end - p);
+
+                if (hit == nullptr) {
+                    break;
+                }
+
+                long nl = static_cast<char const*>(hit) - data;
+
+                if (nl >= 1 && data[nl - 1] == '.' && (nl == 1 || data[nl - 2] == '\n')
+                        && nl + 1 < length) {
+                    s.push_back(nl + 1);
+                }
+
+                p = nl + 2;
+            }
+        });
+
+        pos.clear();
+
+        for (auto& s: starts) {
+            pos.insert(pos.end(), s.begin(), s.end());
+        }
+    }
+
+    bool file::load_index(std::string const& filename, std::vector<int64_t> const& key)
+    {
+        std::ifstream ifs { filename, std::ios::binary };
+
+        if (!ifs) {
+            return false;
+        }
+
+        char magic[4];
+        std::vector<int64_t> h;
+        h.resize(key.size());
+        int64_t n;
+
+        ifs.read(magic, sizeof(magic));
+        ifs.read(reinterpret_cast<char*>(h.data()), h.size() * sizeof(int64_t));
+        ifs.read(reinterpret_cast<char*>(&n), sizeof(int64_t));
+
+        if (!ifs || std::memcmp(magic, index_magic, sizeof(magic)) != 0
+                || h != key || n < 0 || n > (int64_t) length) {
+            return false;
+        }
+
+        std::vector<int64_t> offsets;
+        offsets.resize(n);
+        ifs.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(int64_t));
+
+        if (!ifs) {
+            return false;
+        }
+
+        pos.assign(offsets.begin(), offsets.end());
+
+        return true;
+    }
+
+    void file::save_index(std::string const& filename, std::vector<int64_t> const& key) const
+    {
+        std::ofstream ofs { filename + ".tmp", std::ios::binary };
+
+        int64_t n = pos.size();
+
+        ofs.write(index_magic, sizeof(index_magic));
+        ofs.write(reinterpret_cast<char const*>(key.data()), key.size() * sizeof(int64_t));
+        ofs.write(reinterpret_cast<char const*>(&n), sizeof(int64_t));
+
+        std::vector<int64_t> offsets { pos.begin(), pos.end() };
+        ofs.write(reinterpret_cast<char const*>(offsets.data()), offsets.size() * sizeof(int64_t));
+
+        ofs.close();
+
+        if (!ofs || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            std::remove((filename + ".tmp").c_str());
+            throw std::runtime_error("failed to write " + filename);
+        }
+    }
+
+    int file::size() const
+    {
+        return pos.size();
+    }
+
+    std::string file::name(int i) const
+    {
+        char const *p = data + pos[i];
+        char const *end = data + length;
+
+        char const *nl = static_cast<char const*>(std::memchr(p, '\n', end - p));
+
+        return std::string { p, nl == nullptr ? end : nl };
+    }
+
+    void file::load_flat(int i, std::vector<double>& frames, int& nframes, int& dim) const
+    {
+        parse(pos[i], frames, nframes, dim);
+    }
+
+    void file::parse(long offset, std::vector<double>& frames, int& nframes, int& dim) const
+    {
+        char const *p = data + offset;
+        char const *end = data + length;
+
+        frames.clear();
+        nframes = 0;
+        dim = 0;
+
+        // skip the name line
+        char const *nl = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        p = (nl == nullptr ? end : nl + 1);
+
+        while (p < end) {
+            char const *eol = static_cast<char const*>(std::memchr(p, '\n', end - p));
+            if (eol == nullptr) {
+                eol = end;
+            }
+
+            if (eol - p == 1 && *p == '.') {
+                break;
+            }
+
+            int count = 0;
+
+            while (1) {
+                while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) {
+                    ++p;
+                }
+
+                if (p == eol) {
+                    break;
+                }
+
+                double v;
+                char const *q = parse_double(p, eol, v);
+
+                if (q == p) {
+                    throw std::runtime_error("bad number at byte " + std::to_string(p - data));
+                }
+
+                frames.push_back(v);
+                ++count;
+                p = q;
+            }
+
+            if (nframes == 0) {
+                dim = count;
+            } else if (count != dim) {
+                throw std::runtime_error("ragged frames in record at byte " + std::to_string(offset));
+            }
+
+            ++nframes;
+            p = eol + 1;
+        }
+    }
+
+    seg_t file::load(int i) const
+    {
+        return load_at(pos[i]);
+    }
+
+    seg_t file::load_at(long offset) const
+    {
+        std::vector<double> frames;
+        int nframes;
+        int dim;
+
+        parse(offset, frames, nframes, dim);
+
+        seg_t result;
+        result.resize(nframes);
+
+        for (int t = 0; t < nframes; ++t) {
+            result[t].assign(frames.begin() + (long) t * dim, frames.begin() + (long) (t + 1) * dim);
+        }
+
+        return result;
+    }
+
+    std::vector<seg_t> file::load_all(thread_pool::pool& pool) const
+    {
+        std::vector<seg_t> result;
+        result.resize(pos.size());
+
+        int nchunk = std::max<int>(1, std::min<int>(pos.size(), 4 * pool.size()));
+
+        pool.parallel_for(nchunk, [&](int c) {
+            int begin = (long) pos.size() * c / nchunk;
+            int end = (long) pos.size() * (c + 1) / nchunk;
+
+            for (int i = begin; i < end; ++i) {
+                result[i] = load(i);
+            }
+        });
+
+        return result;
+    }
+
+    bool read(std::istream& is, std::string& name, seg_t& frames)
+    {
+        frames.clear();
+
+        if (!std::getline(is, name)) {
+            return false;
+        }
+
+        std::string line;
+
+        while (std::getline(is, line) && line != ".") {
+            std::vector<double> f;
+
+            char const *p = line.data();
+            char const *end = p + line.size();
+
+            while (1) {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+                    ++p;
+                }
+
+                if (p == end) {
+                    break;
+                }
+
+                double v;
+                char const *q = parse_double(p, end, v);
+
+                if (q == p) {
+                    throw std::runtime_error("bad number in record " + name);
+                }
+
+                f.push_back(v);
+                p = q;
+            }
+
+            if (frames.size() != 0 && f.size() != frames.front().size()) {
+                throw std::runtime_error("ragged frames in record " + name);
+            }
+
+            frames.push_back(std::move(f));
+        }
+
+        return true;
+    }
+
+}
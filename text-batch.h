@@ -0,0 +1,83 @@
+#ifndef TEXT_BATCH_H
+#define TEXT_BATCH_H
+
+#include "thread-pool.h"
+#include <vector>
+#include <string>
+#include <istream>
+#include <cstddef>
+#include <cstdint>
+
+namespace text_batch {
+
+    using seg_t = std::vector<std::vector<double>>;
+
+    /*
+     * A text frame batch (name line, one frame per line, "." line per
+     * record) mapped read-only.  Record offsets are found by scanning
+     * chunks of the file in parallel and saved to filename.idx, keyed
+     * on the file's size, inode, and modification and change times to
+     * the nanosecond, so later opens skip the scan.  Records parse to the same values as speech::load_frame_batch.
+     */
+    struct file {
+
+        file();
+        ~file();
+
+        file(file const&) = delete;
+        file& operator=(file const&) = delete;
+
+        void open(std::string const& filename, thread_pool::pool& pool);
+
+        // same offsets as speech::batch_indices::pos
+        std::vector<long> pos;
+
+        int size() const;
+
+        std::string name(int i) const;
+
+        seg_t load(int i) const;
+
+        // the record starting at byte offset, as when pos has been
+        // shuffled or sliced
+        seg_t load_at(long offset) const;
+
+        // the frames of record i as one row-major nframes x dim block
+        void load_flat(int i, std::vector<double>& data, int& nframes, int& dim) const;
+
+        // all records, parsed in parallel
+        std::vector<seg_t> load_all(thread_pool::pool& pool) const;
+
+    private:
+        void *base;
+        size_t length;
+
+        char const *data;
+
+        void parse(long offset, std::vector<double>& frames, int& nframes, int& dim) const;
+
+        void scan(thread_pool::pool& pool);
+        bool load_index(std::string const& filename, std::vector<int64_t> const& key);
+        void save_index(std::string const& filename, std::vector<int64_t> const& key) const;
+
+    };
+
+    /*
+     * Reads the next record of a text frame batch from a stream that
+     * cannot seek, such as a pipe.  Returns false at the end.  Throws on
+     * ragged frames, as file::load does.
+     */
+    bool read(std::istream& is, std::string& name, seg_t& frames);
+
+    /*
+     * Parses a decimal float at p, stopping before end, and returns the
+     * position after it, or p if there is none.  Numbers with at most 19
+     * significant digits and small exponents are converted exactly with
+     * one multiply or divide by an exact power of ten; everything else
+     * falls back to strtod, so results always match strtod.
+     */
+    char const* parse_double(char const *p, char const *end, double& v);
+
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include "thread-pool.h"
+#include <algorithm>
+
+namespace thread_pool {
+
+    pool::pool(int nthread)
+        : pending(0), next_queue(0), stop(false)
+    {
+        if (nthread < 1) {
+            nthread = 1;
+        }
+
+        // queue nthread - 1 belongs to whichever thread calls parallel_for
+        for (int i = 0; i < nthread; ++i) {
+            queues.push_back(std::unique_ptr<worker_queue>(new worker_queue));
+        }
+
+        for (int i = 0; i < nthread - 1; ++i) {
+            threads.push_back(std::thread { [this, i]() { worker(i); } });
+        }
+    }
+
+    pool::~pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock { sleep_mutex };
+            stop = true;
+        }
+
+        wake.notify_all();
+
+        for (auto& t: threads) {
+            t.join();
+        }
+    }
+
+    int pool::size() const
+    {
+        return queues.size();
+    }
+
+    bool pool::pop(int q, task& t)
+    {
+        std::lock_guard<std::mutex> lock { queues[q]->mutex };
+
+        if (queues[q]->tasks.empty()) {
+            return false;
+        }
+
+        t = queues[q]->tasks.back();
+        queues[q]->tasks.pop_back();
+        --pending;
+
+        return true;
+    }
+
+    bool pool::steal(int q, task& t)
+    {
+        for (int k = 1; k <= queues.size(); ++k) {
+            int v = (q + k) % queues.size();
+
+            std::lock_guard<std::mutex> lock { queues[v]->mutex };
+
+            if (!queues[v]->tasks.empty()) {
+                t = queues[v]->tasks.front();
+                queues[v]->tasks.pop_front();
+                --pending;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void pool::run(task& t)
+    {
+        t.j->f(t.index);
+
+        if (--t.j->remaining == 0) {
+            std::lock_guard<std::mutex> lock { t.j->mutex };
+            t.j->done.notify_all();
+        }
+    }
+
+    void pool::worker(int q)
+    {
+        while (1) {
+            task t;
+
+            if (pop(q, t) || steal(q, t)) {
+                run(t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock { sleep_mutex };
+            wake.wait(lock, [this]() { return stop || pending > 0; });
+
+            if (stop) {
+                break;
+            }
+        }
+    }
+
+    void pool::parallel_for(int n, std::function<void(int)> f)
+    {
+        if (n == 0) {
+            return;
+        }
+
+        if (n == 1 || queues.size() == 1) {
+            for (int i = 0; i < n; ++i) {
+                f(i);
+            }
+
+            return;
+        }
+
+        std::shared_ptr<job> j = std::make_shared<job>();
+        j->f = f;
+        j->remaining = n;
+
+        // deal contiguous ranges so that neighbouring tasks, which tend to
+        // share inputs, start on the same worker
+        int nqueue = queues.size();
+        unsigned int first = next_queue++;
+
+        for (int q = 0; q < nqueue; ++q) {
+            int begin = (long) n * q / nqueue;
+            int end = (long) n * (q + 1) / nqueue;
+
+            int v = (first + q) % nqueue;
+
+            std::lock_guard<std::mutex> lock { queues[v]->mutex };
+
+            for (int i = begin; i < end; ++i) {
+                queues[v]->tasks.push_back(task { j, i });
+            }
+
+            pending += end - begin;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock { sleep_mutex };
+        }
+        wake.notify_all();
+
+        int self = nqueue - 1;
+
+        while (j->remaining > 0) {
+            task t;
+
+            if (pop(self, t) || steal(self, t)) {
+                run(t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock { j->mutex };
+            j->done.wait(lock, [&j]() { return j->remaining == 0; });
+        }
+    }
+
+    static int global_nthread = 0;
+
+    void set_threads(int nthread)
+    {
+        global_nthread = nthread;
+    }
+
+    pool& global()
+    {
+        if (global_nthread == 0) {
+            global_nthread = std::max<int>(1, std::thread::hardware_concurrency());
+        }
+
+        static pool p { global_nthread };
+
+        return p;
+    }
+
+}
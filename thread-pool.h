@@ -0,0 +1,72 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+namespace thread_pool {
+
+    struct job {
+        std::function<void(int)> f;
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    struct task {
+        std::shared_ptr<job> j;
+        int index;
+    };
+
+    /*
+     * A fixed set of workers, each owning a deque of tasks.  Workers pop
+     * from the back of their own deque and steal from the front of the
+     * others.  The thread calling parallel_for helps until its job is done,
+     * so nested or concurrent calls never deadlock.
+     */
+    struct pool {
+
+        pool(int nthread);
+        ~pool();
+
+        int size() const;
+
+        void parallel_for(int n, std::function<void(int)> f);
+
+    private:
+
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        std::vector<std::unique_ptr<worker_queue>> queues;
+        std::vector<std::thread> threads;
+
+        std::atomic<int> pending;
+        std::atomic<unsigned int> next_queue;
+        bool stop;
+
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+
+        bool pop(int q, task& t);
+        bool steal(int q, task& t);
+        void run(task& t);
+        void worker(int q);
+
+    };
+
+    void set_threads(int nthread);
+
+    pool& global();
+
+}
+
+#endif